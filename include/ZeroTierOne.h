@@ -1152,7 +1152,7 @@ void ZT_Node_delete(ZT_Node *node);
  * @param now Current clock in milliseconds
  * @param localAddress Local address, or point to ZT_SOCKADDR_NULL if unspecified
  * @param remoteAddress Origin of packet
- * @param packetData Packet data
+ * @param packetData Packet data (may be modified in place, e.g. when relaying; not retained after call)
  * @param packetLength Packet length
  * @param nextBackgroundTaskDeadline Value/result: set to deadline for next call to processBackgroundTasks()
  * @return OK (0) or error code if a fatal error condition has occurred
@@ -1162,10 +1162,35 @@ enum ZT_ResultCode ZT_Node_processWirePacket(
 	uint64_t now,
 	const struct sockaddr_storage *localAddress,
 	const struct sockaddr_storage *remoteAddress,
-	const void *packetData,
+	void *packetData,
 	unsigned int packetLength,
 	volatile uint64_t *nextBackgroundTaskDeadline);
 
+/**
+ * Enable or disable staging of packets received from the physical wire
+ *
+ * With staging enabled, packets passed to processWirePacket() may be held
+ * and then authenticated and decrypted together, which is considerably
+ * faster for many small packets from different peers. Callers that enable
+ * this must call ZT_Node_flushWirePackets() after each batch of received
+ * datagrams (e.g. after each poll cycle or recvmmsg() call). Staged packets
+ * are also flushed by processBackgroundTasks(). Staging is off by default.
+ *
+ * @param node Node instance
+ * @param enabled Non-zero to enable staging, zero to disable (flushes staged packets)
+ */
+void ZT_Node_setWirePacketStaging(ZT_Node *node,int enabled);
+
+/**
+ * Process any packets staged by processWirePacket()
+ *
+ * @param node Node instance
+ * @param now Current clock in milliseconds
+ * @param nextBackgroundTaskDeadline Value/result: set to deadline for next call to processBackgroundTasks()
+ * @return OK (0) or error code if a fatal error condition has occurred
+ */
+enum ZT_ResultCode ZT_Node_flushWirePackets(ZT_Node *node,uint64_t now,volatile uint64_t *nextBackgroundTaskDeadline);
+
 /**
  * Process a frame from a virtual network port (tap)
  *
@@ -13,6 +13,7 @@ LOCAL_SRC_FILES := \
 	$(ZT1)/ext/lz4/lz4.c \
 	$(ZT1)/ext/json-parser/json.c \
 	$(ZT1)/ext/http-parser/http_parser.c \
+	$(ZT1)/node/AES.cpp \
 	$(ZT1)/node/C25519.cpp \
 	$(ZT1)/node/CertificateOfMembership.cpp \
 	$(ZT1)/node/DeferredPackets.cpp \
@@ -35,6 +36,7 @@ LOCAL_SRC_FILES := \
 	$(ZT1)/node/Switch.cpp \
 	$(ZT1)/node/Topology.cpp \
 	$(ZT1)/node/Utils.cpp \
+	$(ZT1)/node/ValidatedIdentityCache.cpp \
 	$(ZT1)/osdep/Http.cpp \
 	$(ZT1)/osdep/OSUtils.cpp
 
@@ -0,0 +1,551 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2015  ZeroTier, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * ZeroTier may be used and distributed under the terms of the GPLv3, which
+ * are available at: http://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * If you would like to embed ZeroTier into a commercial application or
+ * redistribute it in a modified binary form, please contact ZeroTier Networks
+ * LLC. Start here: http://www.zerotier.com/
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "Constants.hpp"
+#include "AES.hpp"
+#include "Utils.hpp"
+
+#if (!defined(ZT_AES_NO_AESNI)) && (defined(__amd64) || defined(__amd64__) || defined(__x86_64) || defined(__x86_64__) || defined(__AMD64) || defined(__AMD64__)) && (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ >= 6)))
+#define ZT_AES_AESNI 1
+#include <wmmintrin.h>
+#include <smmintrin.h>
+#include <tmmintrin.h>
+#endif
+
+namespace ZeroTier {
+
+namespace {
+
+//////////////////////////////////////////////////////////////////////////////
+// Portable byte-oriented AES-256 and bitwise GHASH (NIST SP 800-38D alg. 1)
+
+static const uint8_t AES_SBOX[256] = {
+	0x63,0x7c,0x77,0x7b,0xf2,0x6b,0x6f,0xc5,0x30,0x01,0x67,0x2b,0xfe,0xd7,0xab,0x76,
+	0xca,0x82,0xc9,0x7d,0xfa,0x59,0x47,0xf0,0xad,0xd4,0xa2,0xaf,0x9c,0xa4,0x72,0xc0,
+	0xb7,0xfd,0x93,0x26,0x36,0x3f,0xf7,0xcc,0x34,0xa5,0xe5,0xf1,0x71,0xd8,0x31,0x15,
+	0x04,0xc7,0x23,0xc3,0x18,0x96,0x05,0x9a,0x07,0x12,0x80,0xe2,0xeb,0x27,0xb2,0x75,
+	0x09,0x83,0x2c,0x1a,0x1b,0x6e,0x5a,0xa0,0x52,0x3b,0xd6,0xb3,0x29,0xe3,0x2f,0x84,
+	0x53,0xd1,0x00,0xed,0x20,0xfc,0xb1,0x5b,0x6a,0xcb,0xbe,0x39,0x4a,0x4c,0x58,0xcf,
+	0xd0,0xef,0xaa,0xfb,0x43,0x4d,0x33,0x85,0x45,0xf9,0x02,0x7f,0x50,0x3c,0x9f,0xa8,
+	0x51,0xa3,0x40,0x8f,0x92,0x9d,0x38,0xf5,0xbc,0xb6,0xda,0x21,0x10,0xff,0xf3,0xd2,
+	0xcd,0x0c,0x13,0xec,0x5f,0x97,0x44,0x17,0xc4,0xa7,0x7e,0x3d,0x64,0x5d,0x19,0x73,
+	0x60,0x81,0x4f,0xdc,0x22,0x2a,0x90,0x88,0x46,0xee,0xb8,0x14,0xde,0x5e,0x0b,0xdb,
+	0xe0,0x32,0x3a,0x0a,0x49,0x06,0x24,0x5c,0xc2,0xd3,0xac,0x62,0x91,0x95,0xe4,0x79,
+	0xe7,0xc8,0x37,0x6d,0x8d,0xd5,0x4e,0xa9,0x6c,0x56,0xf4,0xea,0x65,0x7a,0xae,0x08,
+	0xba,0x78,0x25,0x2e,0x1c,0xa6,0xb4,0xc6,0xe8,0xdd,0x74,0x1f,0x4b,0xbd,0x8b,0x8a,
+	0x70,0x3e,0xb5,0x66,0x48,0x03,0xf6,0x0e,0x61,0x35,0x57,0xb9,0x86,0xc1,0x1d,0x9e,
+	0xe1,0xf8,0x98,0x11,0x69,0xd9,0x8e,0x94,0x9b,0x1e,0x87,0xe9,0xce,0x55,0x28,0xdf,
+	0x8c,0xa1,0x89,0x0d,0xbf,0xe6,0x42,0x68,0x41,0x99,0x2d,0x0f,0xb0,0x54,0xbb,0x16
+};
+
+static inline uint8_t aes_xtime(uint8_t x) { return (uint8_t)((x << 1) ^ ((x & 0x80) ? 0x1b : 0x00)); }
+
+static void aes_expand_portable(const uint8_t *key,uint8_t *rk)
+{
+	memcpy(rk,key,32);
+	uint8_t rcon = 0x01;
+	for(unsigned int i=8;i<60;++i) {
+		uint8_t t[4];
+		memcpy(t,rk + ((i - 1) * 4),4);
+		if ((i % 8) == 0) {
+			const uint8_t t0 = t[0];
+			t[0] = AES_SBOX[t[1]] ^ rcon;
+			t[1] = AES_SBOX[t[2]];
+			t[2] = AES_SBOX[t[3]];
+			t[3] = AES_SBOX[t0];
+			rcon = aes_xtime(rcon);
+		} else if ((i % 8) == 4) {
+			for(unsigned int j=0;j<4;++j)
+				t[j] = AES_SBOX[t[j]];
+		}
+		for(unsigned int j=0;j<4;++j)
+			rk[(i * 4) + j] = rk[((i - 8) * 4) + j] ^ t[j];
+	}
+}
+
+static void aes_encrypt_portable(const uint8_t *rk,const uint8_t *in,uint8_t *out)
+{
+	uint8_t s[16],t[16];
+	for(unsigned int i=0;i<16;++i)
+		s[i] = in[i] ^ rk[i];
+	for(unsigned int r=1;r<=14;++r) {
+		// SubBytes and ShiftRows (state is column major)
+		for(unsigned int c=0;c<4;++c) {
+			for(unsigned int row=0;row<4;++row)
+				t[(c * 4) + row] = AES_SBOX[s[(((c + row) & 3) * 4) + row]];
+		}
+		if (r < 14) {
+			// MixColumns
+			for(unsigned int c=0;c<4;++c) {
+				uint8_t *const col = t + (c * 4);
+				const uint8_t a0 = col[0],a1 = col[1],a2 = col[2],a3 = col[3];
+				const uint8_t x = a0 ^ a1 ^ a2 ^ a3;
+				col[0] = a0 ^ x ^ aes_xtime(a0 ^ a1);
+				col[1] = a1 ^ x ^ aes_xtime(a1 ^ a2);
+				col[2] = a2 ^ x ^ aes_xtime(a2 ^ a3);
+				col[3] = a3 ^ x ^ aes_xtime(a3 ^ a0);
+			}
+		}
+		for(unsigned int i=0;i<16;++i)
+			s[i] = t[i] ^ rk[(r * 16) + i];
+	}
+	memcpy(out,s,16);
+}
+
+static inline uint64_t gcm_load64(const uint8_t *p)
+{
+	return (((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) | ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32) | ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) | ((uint64_t)p[6] << 8) | (uint64_t)p[7]);
+}
+
+static inline void gcm_store64(uint8_t *p,uint64_t v)
+{
+	for(int i=7;i>=0;--i) {
+		p[i] = (uint8_t)v;
+		v >>= 8;
+	}
+}
+
+// y = (y ^ x) * H for one block, all big-endian as in the spec
+static void ghash_block_portable(const uint64_t h[2],uint64_t y[2],const uint8_t *x)
+{
+	uint64_t xh = y[0] ^ gcm_load64(x);
+	uint64_t xl = y[1] ^ gcm_load64(x + 8);
+	uint64_t vh = h[0],vl = h[1];
+	uint64_t zh = 0,zl = 0;
+	for(unsigned int i=0;i<128;++i) {
+		const uint64_t bit = (i < 64) ? ((xh >> (63 - i)) & 1) : ((xl >> (127 - i)) & 1);
+		const uint64_t m = (uint64_t)0 - bit;
+		zh ^= vh & m;
+		zl ^= vl & m;
+		const uint64_t lsb = (uint64_t)0 - (vl & 1);
+		vl = (vl >> 1) | (vh << 63);
+		vh = (vh >> 1) ^ (0xe100000000000000ULL & lsb);
+	}
+	y[0] = zh;
+	y[1] = zl;
+}
+
+static void ghash_update_portable(const uint64_t h[2],uint64_t y[2],const uint8_t *p,unsigned int len)
+{
+	while (len >= 16) {
+		ghash_block_portable(h,y,p);
+		p += 16;
+		len -= 16;
+	}
+	if (len) {
+		uint8_t last[16];
+		memset(last,0,16);
+		memcpy(last,p,len);
+		ghash_block_portable(h,y,last);
+	}
+}
+
+#ifdef ZT_AES_AESNI
+
+//////////////////////////////////////////////////////////////////////////////
+// AES-NI and PCLMULQDQ kernels, built with per-function target attributes
+// and chosen at runtime. GHASH works on byte reversed blocks and uses the
+// shift-and-reduce multiply from Intel's carry-less multiplication white
+// paper, aggregating four blocks per reduction with H^4..H.
+
+#define ZT_AES_TARGET __attribute__((target("aes,pclmul,sse4.1,ssse3")))
+
+static int aes_detect_accel(void)
+{
+	__builtin_cpu_init();
+	return ((__builtin_cpu_supports("aes"))&&(__builtin_cpu_supports("pclmul"))&&(__builtin_cpu_supports("sse4.1"))) ? 1 : 0;
+}
+static const int aes_accel_supported = aes_detect_accel();
+static int aes_accel = aes_accel_supported;
+
+ZT_AES_TARGET static inline __m128i aesni_bswap(__m128i x)
+{
+	return _mm_shuffle_epi8(x,_mm_set_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15));
+}
+
+ZT_AES_TARGET static inline __m128i aesni_expand_a(__m128i k,__m128i t)
+{
+	t = _mm_shuffle_epi32(t,0xff);
+	k = _mm_xor_si128(k,_mm_slli_si128(k,4));
+	k = _mm_xor_si128(k,_mm_slli_si128(k,4));
+	k = _mm_xor_si128(k,_mm_slli_si128(k,4));
+	return _mm_xor_si128(k,t);
+}
+
+ZT_AES_TARGET static inline __m128i aesni_expand_b(__m128i k,__m128i t)
+{
+	t = _mm_shuffle_epi32(t,0xaa);
+	k = _mm_xor_si128(k,_mm_slli_si128(k,4));
+	k = _mm_xor_si128(k,_mm_slli_si128(k,4));
+	k = _mm_xor_si128(k,_mm_slli_si128(k,4));
+	return _mm_xor_si128(k,t);
+}
+
+ZT_AES_TARGET static void aes_expand_aesni(const uint8_t *key,uint8_t *rk)
+{
+	__m128i k[15];
+	k[0] = _mm_loadu_si128((const __m128i *)key);
+	k[1] = _mm_loadu_si128((const __m128i *)(key + 16));
+#define ZT_AESNI_EXPAND_STEP(i,rcon) \
+	k[i] = aesni_expand_a(k[i - 2],_mm_aeskeygenassist_si128(k[i - 1],rcon)); \
+	if ((i + 1) < 15) k[i + 1] = aesni_expand_b(k[i - 1],_mm_aeskeygenassist_si128(k[i],0x00));
+	ZT_AESNI_EXPAND_STEP(2,0x01)
+	ZT_AESNI_EXPAND_STEP(4,0x02)
+	ZT_AESNI_EXPAND_STEP(6,0x04)
+	ZT_AESNI_EXPAND_STEP(8,0x08)
+	ZT_AESNI_EXPAND_STEP(10,0x10)
+	ZT_AESNI_EXPAND_STEP(12,0x20)
+	k[14] = aesni_expand_a(k[12],_mm_aeskeygenassist_si128(k[13],0x40));
+#undef ZT_AESNI_EXPAND_STEP
+	for(unsigned int i=0;i<15;++i)
+		_mm_storeu_si128((__m128i *)(rk + (i * 16)),k[i]);
+}
+
+ZT_AES_TARGET static inline __m128i aes_encrypt_aesni(const __m128i *k,__m128i x)
+{
+	x = _mm_xor_si128(x,k[0]);
+	for(unsigned int r=1;r<14;++r)
+		x = _mm_aesenc_si128(x,k[r]);
+	return _mm_aesenclast_si128(x,k[14]);
+}
+
+ZT_AES_TARGET static inline void aesni_load_keys(const uint64_t *rk,__m128i *k)
+{
+	for(unsigned int i=0;i<15;++i)
+		k[i] = _mm_loadu_si128((const __m128i *)(rk + (i * 2)));
+}
+
+// 256-bit unreduced product of a and b, accumulated into lo:hi
+ZT_AES_TARGET static inline void gfmul_acc(__m128i a,__m128i b,__m128i &lo,__m128i &mid,__m128i &hi)
+{
+	lo = _mm_xor_si128(lo,_mm_clmulepi64_si128(a,b,0x00));
+	mid = _mm_xor_si128(mid,_mm_xor_si128(_mm_clmulepi64_si128(a,b,0x10),_mm_clmulepi64_si128(a,b,0x01)));
+	hi = _mm_xor_si128(hi,_mm_clmulepi64_si128(a,b,0x11));
+}
+
+ZT_AES_TARGET static inline __m128i gfmul_reduce(__m128i lo,__m128i mid,__m128i hi)
+{
+	lo = _mm_xor_si128(lo,_mm_slli_si128(mid,8));
+	hi = _mm_xor_si128(hi,_mm_srli_si128(mid,8));
+
+	// Shift the 256-bit product left by one to account for bit reflection
+	__m128i t7 = _mm_srli_epi32(lo,31);
+	__m128i t8 = _mm_srli_epi32(hi,31);
+	lo = _mm_slli_epi32(lo,1);
+	hi = _mm_slli_epi32(hi,1);
+	__m128i t9 = _mm_srli_si128(t7,12);
+	t8 = _mm_slli_si128(t8,4);
+	t7 = _mm_slli_si128(t7,4);
+	lo = _mm_or_si128(lo,t7);
+	hi = _mm_or_si128(hi,t8);
+	hi = _mm_or_si128(hi,t9);
+
+	// Reduce modulo x^128 + x^7 + x^2 + x + 1
+	t7 = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo,31),_mm_slli_epi32(lo,30)),_mm_slli_epi32(lo,25));
+	t8 = _mm_srli_si128(t7,4);
+	t7 = _mm_slli_si128(t7,12);
+	lo = _mm_xor_si128(lo,t7);
+	__m128i t2 = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(lo,1),_mm_srli_epi32(lo,2)),_mm_srli_epi32(lo,7));
+	t2 = _mm_xor_si128(t2,t8);
+	lo = _mm_xor_si128(lo,t2);
+	return _mm_xor_si128(hi,lo);
+}
+
+ZT_AES_TARGET static inline __m128i gfmul(__m128i a,__m128i b)
+{
+	__m128i lo = _mm_setzero_si128(),mid = _mm_setzero_si128(),hi = _mm_setzero_si128();
+	gfmul_acc(a,b,lo,mid,hi);
+	return gfmul_reduce(lo,mid,hi);
+}
+
+ZT_AES_TARGET static __m128i ghash_update_aesni(const uint64_t *hpw,__m128i y,const uint8_t *p,unsigned int len)
+{
+	const __m128i h1 = _mm_loadu_si128((const __m128i *)hpw);
+	if (len >= 64) {
+		const __m128i h2 = _mm_loadu_si128((const __m128i *)(hpw + 2));
+		const __m128i h3 = _mm_loadu_si128((const __m128i *)(hpw + 4));
+		const __m128i h4 = _mm_loadu_si128((const __m128i *)(hpw + 6));
+		while (len >= 64) {
+			__m128i lo = _mm_setzero_si128(),mid = _mm_setzero_si128(),hi = _mm_setzero_si128();
+			gfmul_acc(_mm_xor_si128(y,aesni_bswap(_mm_loadu_si128((const __m128i *)p))),h4,lo,mid,hi);
+			gfmul_acc(aesni_bswap(_mm_loadu_si128((const __m128i *)(p + 16))),h3,lo,mid,hi);
+			gfmul_acc(aesni_bswap(_mm_loadu_si128((const __m128i *)(p + 32))),h2,lo,mid,hi);
+			gfmul_acc(aesni_bswap(_mm_loadu_si128((const __m128i *)(p + 48))),h1,lo,mid,hi);
+			y = gfmul_reduce(lo,mid,hi);
+			p += 64;
+			len -= 64;
+		}
+	}
+	while (len >= 16) {
+		y = gfmul(_mm_xor_si128(y,aesni_bswap(_mm_loadu_si128((const __m128i *)p))),h1);
+		p += 16;
+		len -= 16;
+	}
+	if (len) {
+		uint8_t last[16];
+		memset(last,0,16);
+		memcpy(last,p,len);
+		y = gfmul(_mm_xor_si128(y,aesni_bswap(_mm_loadu_si128((const __m128i *)last))),h1);
+	}
+	return y;
+}
+
+ZT_AES_TARGET static void aes_init_aesni(const uint8_t *key,uint64_t *rk,uint64_t *h,uint64_t *hpw)
+{
+	aes_expand_aesni(key,reinterpret_cast<uint8_t *>(rk));
+	__m128i k[15];
+	aesni_load_keys(rk,k);
+	const __m128i hraw = aes_encrypt_aesni(k,_mm_setzero_si128());
+	uint8_t hb[16];
+	_mm_storeu_si128((__m128i *)hb,hraw);
+	h[0] = gcm_load64(hb);
+	h[1] = gcm_load64(hb + 8);
+	const __m128i h1 = aesni_bswap(hraw);
+	const __m128i h2 = gfmul(h1,h1);
+	const __m128i h3 = gfmul(h2,h1);
+	const __m128i h4 = gfmul(h3,h1);
+	_mm_storeu_si128((__m128i *)hpw,h1);
+	_mm_storeu_si128((__m128i *)(hpw + 2),h2);
+	_mm_storeu_si128((__m128i *)(hpw + 4),h3);
+	_mm_storeu_si128((__m128i *)(hpw + 6),h4);
+	for(unsigned int i=0;i<15;++i)
+		k[i] = _mm_setzero_si128();
+}
+
+ZT_AES_TARGET static void aes_ghash_aesni(const uint64_t *hpw,const uint8_t *aad,unsigned int aadLen,const uint8_t *data,unsigned int len,uint8_t *s)
+{
+	__m128i y = _mm_setzero_si128();
+	if (aadLen)
+		y = ghash_update_aesni(hpw,y,aad,aadLen);
+	if (len)
+		y = ghash_update_aesni(hpw,y,data,len);
+	y = gfmul(_mm_xor_si128(y,_mm_set_epi64x((long long)((uint64_t)aadLen * 8),(long long)((uint64_t)len * 8))),_mm_loadu_si128((const __m128i *)hpw));
+	_mm_storeu_si128((__m128i *)s,aesni_bswap(y));
+}
+
+ZT_AES_TARGET static void aes_ctr_aesni(const uint64_t *rk,const uint8_t *j0,uint8_t *p,unsigned int len)
+{
+	__m128i k[15];
+	aesni_load_keys(rk,k);
+	const __m128i iv = _mm_loadu_si128((const __m128i *)j0);
+	uint32_t ctr = (((uint32_t)j0[12] << 24) | ((uint32_t)j0[13] << 16) | ((uint32_t)j0[14] << 8) | (uint32_t)j0[15]) + 1;
+
+	while (len >= 64) {
+		__m128i c0 = _mm_xor_si128(_mm_insert_epi32(iv,(int)__builtin_bswap32(ctr),3),k[0]);
+		__m128i c1 = _mm_xor_si128(_mm_insert_epi32(iv,(int)__builtin_bswap32(ctr + 1),3),k[0]);
+		__m128i c2 = _mm_xor_si128(_mm_insert_epi32(iv,(int)__builtin_bswap32(ctr + 2),3),k[0]);
+		__m128i c3 = _mm_xor_si128(_mm_insert_epi32(iv,(int)__builtin_bswap32(ctr + 3),3),k[0]);
+		ctr += 4;
+		for(unsigned int r=1;r<14;++r) {
+			c0 = _mm_aesenc_si128(c0,k[r]);
+			c1 = _mm_aesenc_si128(c1,k[r]);
+			c2 = _mm_aesenc_si128(c2,k[r]);
+			c3 = _mm_aesenc_si128(c3,k[r]);
+		}
+		c0 = _mm_aesenclast_si128(c0,k[14]);
+		c1 = _mm_aesenclast_si128(c1,k[14]);
+		c2 = _mm_aesenclast_si128(c2,k[14]);
+		c3 = _mm_aesenclast_si128(c3,k[14]);
+		_mm_storeu_si128((__m128i *)p,_mm_xor_si128(c0,_mm_loadu_si128((const __m128i *)p)));
+		_mm_storeu_si128((__m128i *)(p + 16),_mm_xor_si128(c1,_mm_loadu_si128((const __m128i *)(p + 16))));
+		_mm_storeu_si128((__m128i *)(p + 32),_mm_xor_si128(c2,_mm_loadu_si128((const __m128i *)(p + 32))));
+		_mm_storeu_si128((__m128i *)(p + 48),_mm_xor_si128(c3,_mm_loadu_si128((const __m128i *)(p + 48))));
+		p += 64;
+		len -= 64;
+	}
+	while (len >= 16) {
+		const __m128i c = aes_encrypt_aesni(k,_mm_insert_epi32(iv,(int)__builtin_bswap32(ctr++),3));
+		_mm_storeu_si128((__m128i *)p,_mm_xor_si128(c,_mm_loadu_si128((const __m128i *)p)));
+		p += 16;
+		len -= 16;
+	}
+	if (len) {
+		uint8_t ks[16];
+		_mm_storeu_si128((__m128i *)ks,aes_encrypt_aesni(k,_mm_insert_epi32(iv,(int)__builtin_bswap32(ctr),3)));
+		for(unsigned int i=0;i<len;++i)
+			p[i] ^= ks[i];
+	}
+}
+
+ZT_AES_TARGET static void aes_encrypt_block_aesni(const uint64_t *rk,const uint8_t *in,uint8_t *out)
+{
+	__m128i k[15];
+	aesni_load_keys(rk,k);
+	_mm_storeu_si128((__m128i *)out,aes_encrypt_aesni(k,_mm_loadu_si128((const __m128i *)in)));
+}
+
+#endif // ZT_AES_AESNI
+
+} // anonymous namespace
+
+AES::Accel AES::accelSupported()
+	throw()
+{
+#ifdef ZT_AES_AESNI
+	return (Accel)aes_accel_supported;
+#else
+	return ACCEL_NONE;
+#endif
+}
+
+AES::Accel AES::accel()
+	throw()
+{
+#ifdef ZT_AES_AESNI
+	return (Accel)aes_accel;
+#else
+	return ACCEL_NONE;
+#endif
+}
+
+void AES::setAccel(Accel a)
+	throw()
+{
+#ifdef ZT_AES_AESNI
+	aes_accel = (((int)a < aes_accel_supported) ? (int)a : aes_accel_supported);
+#endif
+}
+
+void AES::init(const void *key)
+	throw()
+{
+#ifdef ZT_AES_AESNI
+	if (aes_accel) {
+		aes_init_aesni(reinterpret_cast<const uint8_t *>(key),_k,_h,_hp);
+		return;
+	}
+#endif
+	aes_expand_portable(reinterpret_cast<const uint8_t *>(key),reinterpret_cast<uint8_t *>(_k));
+	uint8_t h[16];
+	memset(h,0,16);
+	aes_encrypt_portable(reinterpret_cast<const uint8_t *>(_k),h,h);
+	_h[0] = gcm_load64(h);
+	_h[1] = gcm_load64(h + 8);
+	memset(_hp,0,sizeof(_hp));
+}
+
+void AES::encryptBlock(const void *in,void *out) const
+	throw()
+{
+#ifdef ZT_AES_AESNI
+	if (aes_accel) {
+		aes_encrypt_block_aesni(_k,reinterpret_cast<const uint8_t *>(in),reinterpret_cast<uint8_t *>(out));
+		return;
+	}
+#endif
+	aes_encrypt_portable(reinterpret_cast<const uint8_t *>(_k),reinterpret_cast<const uint8_t *>(in),reinterpret_cast<uint8_t *>(out));
+}
+
+void AES::gcmEncrypt(const void *iv,const void *aad,unsigned int aadLen,void *data,unsigned int len,void *tag) const
+	throw()
+{
+	uint8_t j0[16];
+	memcpy(j0,iv,12);
+	j0[12] = 0; j0[13] = 0; j0[14] = 0; j0[15] = 1;
+	_ctr(j0,data,len);
+	uint8_t s[16];
+	_ghash(aad,aadLen,data,len,s);
+	uint8_t ek[16];
+	encryptBlock(j0,ek);
+	for(unsigned int i=0;i<16;++i)
+		reinterpret_cast<uint8_t *>(tag)[i] = ek[i] ^ s[i];
+}
+
+bool AES::gcmDecrypt(const void *iv,const void *aad,unsigned int aadLen,void *data,unsigned int len,const void *tag,unsigned int tagLen) const
+	throw()
+{
+	if ((tagLen == 0)||(tagLen > 16))
+		return false;
+	uint8_t j0[16];
+	memcpy(j0,iv,12);
+	j0[12] = 0; j0[13] = 0; j0[14] = 0; j0[15] = 1;
+	uint8_t s[16];
+	_ghash(aad,aadLen,data,len,s);
+	uint8_t ek[16];
+	encryptBlock(j0,ek);
+	for(unsigned int i=0;i<16;++i)
+		s[i] ^= ek[i];
+	if (!Utils::secureEq(s,tag,tagLen))
+		return false;
+	_ctr(j0,data,len);
+	return true;
+}
+
+void AES::_ghash(const void *aad,unsigned int aadLen,const void *data,unsigned int len,unsigned char *s) const
+	throw()
+{
+#ifdef ZT_AES_AESNI
+	if (aes_accel) {
+		aes_ghash_aesni(_hp,reinterpret_cast<const uint8_t *>(aad),aadLen,reinterpret_cast<const uint8_t *>(data),len,s);
+		return;
+	}
+#endif
+	uint64_t y[2] = { 0,0 };
+	if (aadLen)
+		ghash_update_portable(_h,y,reinterpret_cast<const uint8_t *>(aad),aadLen);
+	if (len)
+		ghash_update_portable(_h,y,reinterpret_cast<const uint8_t *>(data),len);
+	uint8_t lens[16];
+	gcm_store64(lens,(uint64_t)aadLen * 8);
+	gcm_store64(lens + 8,(uint64_t)len * 8);
+	ghash_block_portable(_h,y,lens);
+	gcm_store64(s,y[0]);
+	gcm_store64(s + 8,y[1]);
+}
+
+void AES::_ctr(const unsigned char *j0,void *data,unsigned int len) const
+	throw()
+{
+#ifdef ZT_AES_AESNI
+	if (aes_accel) {
+		aes_ctr_aesni(_k,j0,reinterpret_cast<uint8_t *>(data),len);
+		return;
+	}
+#endif
+	uint8_t *p = reinterpret_cast<uint8_t *>(data);
+	uint8_t cb[16],ks[16];
+	memcpy(cb,j0,16);
+	uint32_t ctr = (((uint32_t)j0[12] << 24) | ((uint32_t)j0[13] << 16) | ((uint32_t)j0[14] << 8) | (uint32_t)j0[15]);
+	while (len) {
+		++ctr;
+		cb[12] = (uint8_t)(ctr >> 24);
+		cb[13] = (uint8_t)(ctr >> 16);
+		cb[14] = (uint8_t)(ctr >> 8);
+		cb[15] = (uint8_t)ctr;
+		aes_encrypt_portable(reinterpret_cast<const uint8_t *>(_k),cb,ks);
+		const unsigned int n = (len < 16) ? len : 16;
+		for(unsigned int i=0;i<n;++i)
+			p[i] ^= ks[i];
+		p += n;
+		len -= n;
+	}
+}
+
+} // namespace ZeroTier
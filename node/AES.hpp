@@ -0,0 +1,157 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2015  ZeroTier, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * ZeroTier may be used and distributed under the terms of the GPLv3, which
+ * are available at: http://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * If you would like to embed ZeroTier into a commercial application or
+ * redistribute it in a modified binary form, please contact ZeroTier Networks
+ * LLC. Start here: http://www.zerotier.com/
+ */
+
+#ifndef ZT_AES_HPP
+#define ZT_AES_HPP
+
+#include <stdint.h>
+
+#include "Constants.hpp"
+#include "Utils.hpp"
+
+#define ZT_AES_KEY_LEN 32
+#define ZT_AES_GCM_IV_LEN 12
+#define ZT_AES_GCM_TAG_LEN 16
+
+namespace ZeroTier {
+
+/**
+ * AES-256 in GCM mode
+ *
+ * On x86_64 CPUs with AES-NI and PCLMULQDQ this uses those instructions,
+ * chosen at runtime. Elsewhere a portable byte-oriented implementation is
+ * used, which is much slower and not hardened against cache timing, so
+ * nodes only advertise AES-GCM to peers when it is accelerated.
+ */
+class AES
+{
+public:
+	/**
+	 * Kernels, in order of preference
+	 */
+	enum Accel
+	{
+		ACCEL_NONE = 0,
+		ACCEL_AESNI = 1
+	};
+
+	AES() throw() {}
+
+	/**
+	 * @param key 256-bit key
+	 */
+	AES(const void *key) throw() { init(key); }
+
+	~AES()
+	{
+		Utils::burn(_k,sizeof(_k));
+		Utils::burn(_h,sizeof(_h));
+		Utils::burn(_hp,sizeof(_hp));
+	}
+
+	/**
+	 * @return Fastest kernel supported by this CPU and build
+	 */
+	static Accel accelSupported()
+		throw();
+
+	/**
+	 * @return Kernel currently in use
+	 */
+	static Accel accel()
+		throw();
+
+	/**
+	 * Limit kernel selection (mostly for testing and benchmarks)
+	 *
+	 * This is global and not thread safe, and objects initialized before
+	 * a change must not be used after it.
+	 *
+	 * @param a Maximum kernel to use (clamped to accelSupported())
+	 */
+	static void setAccel(Accel a)
+		throw();
+
+	/**
+	 * Expand a key and compute the GHASH key for it
+	 *
+	 * @param key 256-bit key
+	 */
+	void init(const void *key)
+		throw();
+
+	/**
+	 * Encrypt a single 16-byte block
+	 *
+	 * @param in Input block
+	 * @param out Output block (may be the same as in)
+	 */
+	void encryptBlock(const void *in,void *out) const
+		throw();
+
+	/**
+	 * Encrypt in place and compute a GCM authentication tag
+	 *
+	 * @param iv 96-bit IV (must never repeat under the same key)
+	 * @param aad Additional authenticated data or NULL
+	 * @param aadLen Length of additional data
+	 * @param data Data to encrypt in place
+	 * @param len Length of data
+	 * @param tag Buffer to receive 16-byte tag
+	 */
+	void gcmEncrypt(const void *iv,const void *aad,unsigned int aadLen,void *data,unsigned int len,void *tag) const
+		throw();
+
+	/**
+	 * Check a GCM authentication tag and decrypt in place if it is valid
+	 *
+	 * If the tag does not match, data is left unmodified.
+	 *
+	 * @param iv 96-bit IV
+	 * @param aad Additional authenticated data or NULL
+	 * @param aadLen Length of additional data
+	 * @param data Data to decrypt in place
+	 * @param len Length of data
+	 * @param tag Expected tag (possibly truncated)
+	 * @param tagLen Length of expected tag in bytes (1-16)
+	 * @return True if tag matched and data was decrypted
+	 */
+	bool gcmDecrypt(const void *iv,const void *aad,unsigned int aadLen,void *data,unsigned int len,const void *tag,unsigned int tagLen) const
+		throw();
+
+private:
+	void _ghash(const void *aad,unsigned int aadLen,const void *data,unsigned int len,unsigned char *s) const throw();
+	void _ctr(const unsigned char *j0,void *data,unsigned int len) const throw();
+
+	uint64_t _k[30]; // 15 round keys in standard byte order
+	uint64_t _h[2]; // GHASH key H = E(0^128) as two big-endian words
+	uint64_t _hp[8]; // H, H^2, H^3, H^4 byte reversed for the PCLMULQDQ kernel
+};
+
+} // namespace ZeroTier
+
+#endif
@@ -102,6 +102,14 @@ public:
 		_l = l;
 	}
 
+	// Explicit copy so that only the used portion of the buffer is copied
+	Buffer(const Buffer &b)
+		throw() :
+		_l(b._l)
+	{
+		memcpy(_b,b._b,_l);
+	}
+
 	template<unsigned int C2>
 	Buffer(const Buffer<C2> &b)
 		throw(std::out_of_range)
@@ -131,6 +139,14 @@ public:
 		return *this;
 	}
 
+	inline Buffer &operator=(const Buffer &b)
+		throw()
+	{
+		if (&b != this)
+			memcpy(_b,b._b,_l = b._l);
+		return *this;
+	}
+
 	inline Buffer &operator=(const std::string &s)
 		throw(std::out_of_range)
 	{
@@ -22,6 +22,13 @@ Derived from public domain code by D. J. Bernstein.
 #pragma warning(disable: 4146)
 #endif
 
+// On 64-bit targets with a native 64x64->128 multiply the field arithmetic
+// below uses five 51-bit limbs instead of the reference 32x8-bit code. Define
+// ZT_C25519_NO_FE51 to force the portable reference implementation.
+#if (!defined(ZT_C25519_NO_FE51)) && (!defined(ZT_C25519_FE51)) && defined(__SIZEOF_INT128__) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__amd64__) || defined(__aarch64__))
+#define ZT_C25519_FE51 1
+#endif
+
 namespace ZeroTier {
 
 //////////////////////////////////////////////////////////////////////////////
@@ -33,6 +40,8 @@ namespace ZeroTier {
 #define crypto_uint64 uint64_t
 #define crypto_hash_sha512_BYTES 64
 
+#ifndef ZT_C25519_FE51
+
 static inline void add(unsigned int out[32],const unsigned int a[32],const unsigned int b[32])
 {
   unsigned int j;
@@ -298,6 +307,8 @@ static inline int crypto_scalarmult_base(unsigned char *q,
   return crypto_scalarmult(q,n,base);
 }
 
+#endif // !ZT_C25519_FE51
+
 //////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////
 
@@ -306,6 +317,217 @@ static inline int crypto_scalarmult_base(unsigned char *q,
 
 // Also public domain, newer version than the Ed25519 found in NaCl
 
+#ifdef ZT_C25519_FE51
+
+// Radix 2^51: v[0] + v[1]*2^51 + v[2]*2^102 + v[3]*2^153 + v[4]*2^204
+// Every operation leaves limbs weakly reduced (below 2^51 plus a small carry)
+// so outputs can be fed back into any other operation without extra carries.
+
+typedef unsigned __int128 crypto_uint128;
+
+#define FE51_MASK 0x7ffffffffffffULL
+
+typedef struct
+{
+  crypto_uint64 v[5];
+}
+fe25519;
+
+static inline crypto_uint64 fe51_load64(const unsigned char *x)
+{
+  return ( (crypto_uint64)x[0] | ((crypto_uint64)x[1] << 8) | ((crypto_uint64)x[2] << 16) | ((crypto_uint64)x[3] << 24) | ((crypto_uint64)x[4] << 32) | ((crypto_uint64)x[5] << 40) | ((crypto_uint64)x[6] << 48) | ((crypto_uint64)x[7] << 56) );
+}
+
+static inline void fe51_store64(unsigned char *r,crypto_uint64 x)
+{
+  int i;
+  for(i=0;i<8;i++) { r[i] = (unsigned char)x; x >>= 8; }
+}
+
+static inline void fe51_carry(fe25519 *r)
+{
+  crypto_uint64 c;
+  c = r->v[0] >> 51; r->v[0] &= FE51_MASK; r->v[1] += c;
+  c = r->v[1] >> 51; r->v[1] &= FE51_MASK; r->v[2] += c;
+  c = r->v[2] >> 51; r->v[2] &= FE51_MASK; r->v[3] += c;
+  c = r->v[3] >> 51; r->v[3] &= FE51_MASK; r->v[4] += c;
+  c = r->v[4] >> 51; r->v[4] &= FE51_MASK; r->v[0] += c * 19;
+}
+
+static inline void fe51_carry_wide(fe25519 *r,crypto_uint128 t0,crypto_uint128 t1,crypto_uint128 t2,crypto_uint128 t3,crypto_uint128 t4)
+{
+  crypto_uint64 c;
+  t1 += (crypto_uint64)(t0 >> 51); r->v[0] = (crypto_uint64)t0 & FE51_MASK;
+  t2 += (crypto_uint64)(t1 >> 51); r->v[1] = (crypto_uint64)t1 & FE51_MASK;
+  t3 += (crypto_uint64)(t2 >> 51); r->v[2] = (crypto_uint64)t2 & FE51_MASK;
+  t4 += (crypto_uint64)(t3 >> 51); r->v[3] = (crypto_uint64)t3 & FE51_MASK;
+  c = (crypto_uint64)(t4 >> 51); r->v[4] = (crypto_uint64)t4 & FE51_MASK;
+  r->v[0] += c * 19;
+  c = r->v[0] >> 51; r->v[0] &= FE51_MASK; r->v[1] += c;
+}
+
+/* reduction modulo 2^255-19 */
+static inline void fe25519_freeze(fe25519 *r)
+{
+  crypto_uint64 q;
+  fe51_carry(r);
+  fe51_carry(r);
+  q = (r->v[0] + 19) >> 51;
+  q = (r->v[1] + q) >> 51;
+  q = (r->v[2] + q) >> 51;
+  q = (r->v[3] + q) >> 51;
+  q = (r->v[4] + q) >> 51;
+  r->v[0] += 19 * q;
+  q = r->v[0] >> 51; r->v[0] &= FE51_MASK; r->v[1] += q;
+  q = r->v[1] >> 51; r->v[1] &= FE51_MASK; r->v[2] += q;
+  q = r->v[2] >> 51; r->v[2] &= FE51_MASK; r->v[3] += q;
+  q = r->v[3] >> 51; r->v[3] &= FE51_MASK; r->v[4] += q;
+  r->v[4] &= FE51_MASK;
+}
+
+static inline void fe25519_unpack(fe25519 *r, const unsigned char x[32])
+{
+  r->v[0] = fe51_load64(x) & FE51_MASK;
+  r->v[1] = (fe51_load64(x + 6) >> 3) & FE51_MASK;
+  r->v[2] = (fe51_load64(x + 12) >> 6) & FE51_MASK;
+  r->v[3] = (fe51_load64(x + 19) >> 1) & FE51_MASK;
+  r->v[4] = (fe51_load64(x + 24) >> 12) & FE51_MASK;
+}
+
+/* Assumes input x being reduced below 2^255 */
+static inline void fe25519_pack(unsigned char r[32], const fe25519 *x)
+{
+  fe25519 y = *x;
+  fe25519_freeze(&y);
+  fe51_store64(r,y.v[0] | (y.v[1] << 51));
+  fe51_store64(r + 8,(y.v[1] >> 13) | (y.v[2] << 38));
+  fe51_store64(r + 16,(y.v[2] >> 26) | (y.v[3] << 25));
+  fe51_store64(r + 24,(y.v[3] >> 39) | (y.v[4] << 12));
+}
+
+static int fe25519_iszero(const fe25519 *x)
+{
+  fe25519 t = *x;
+  fe25519_freeze(&t);
+  return (int)((((t.v[0] | t.v[1] | t.v[2] | t.v[3] | t.v[4]) - 1) >> 63) & 1);
+}
+
+static inline int fe25519_iseq_vartime(const fe25519 *x, const fe25519 *y)
+{
+  int i;
+  fe25519 t1 = *x;
+  fe25519 t2 = *y;
+  fe25519_freeze(&t1);
+  fe25519_freeze(&t2);
+  for(i=0;i<5;i++)
+    if(t1.v[i] != t2.v[i]) return 0;
+  return 1;
+}
+
+static inline void fe25519_cmov(fe25519 *r, const fe25519 *x, unsigned char b)
+{
+  int i;
+  crypto_uint64 mask = b;
+  mask = -mask;
+  for(i=0;i<5;i++) r->v[i] ^= mask & (x->v[i] ^ r->v[i]);
+}
+
+static inline unsigned char fe25519_getparity(const fe25519 *x)
+{
+  fe25519 t = *x;
+  fe25519_freeze(&t);
+  return (unsigned char)(t.v[0] & 1);
+}
+
+static inline void fe25519_setone(fe25519 *r)
+{
+  r->v[0] = 1;
+  r->v[1] = 0;
+  r->v[2] = 0;
+  r->v[3] = 0;
+  r->v[4] = 0;
+}
+
+static inline void fe25519_setzero(fe25519 *r)
+{
+  r->v[0] = 0;
+  r->v[1] = 0;
+  r->v[2] = 0;
+  r->v[3] = 0;
+  r->v[4] = 0;
+}
+
+static inline void fe25519_add(fe25519 *r, const fe25519 *x, const fe25519 *y)
+{
+  int i;
+  for(i=0;i<5;i++) r->v[i] = x->v[i] + y->v[i];
+  fe51_carry(r);
+}
+
+static inline void fe25519_sub(fe25519 *r, const fe25519 *x, const fe25519 *y)
+{
+  /* x + 2p - y; y is always weakly reduced so no limb can underflow */
+  r->v[0] = (x->v[0] + 0xfffffffffffdaULL) - y->v[0];
+  r->v[1] = (x->v[1] + 0xffffffffffffeULL) - y->v[1];
+  r->v[2] = (x->v[2] + 0xffffffffffffeULL) - y->v[2];
+  r->v[3] = (x->v[3] + 0xffffffffffffeULL) - y->v[3];
+  r->v[4] = (x->v[4] + 0xffffffffffffeULL) - y->v[4];
+  fe51_carry(r);
+}
+
+static inline void fe25519_neg(fe25519 *r, const fe25519 *x)
+{
+  fe25519 z;
+  fe25519_setzero(&z);
+  fe25519_sub(r, &z, x);
+}
+
+static inline void fe25519_mul(fe25519 *r, const fe25519 *x, const fe25519 *y)
+{
+  const crypto_uint64 x0 = x->v[0],x1 = x->v[1],x2 = x->v[2],x3 = x->v[3],x4 = x->v[4];
+  const crypto_uint64 y0 = y->v[0],y1 = y->v[1],y2 = y->v[2],y3 = y->v[3],y4 = y->v[4];
+  const crypto_uint64 y1_19 = y1 * 19,y2_19 = y2 * 19,y3_19 = y3 * 19,y4_19 = y4 * 19;
+  fe51_carry_wide(r,
+    (crypto_uint128)x0 * y0 + (crypto_uint128)x1 * y4_19 + (crypto_uint128)x2 * y3_19 + (crypto_uint128)x3 * y2_19 + (crypto_uint128)x4 * y1_19,
+    (crypto_uint128)x0 * y1 + (crypto_uint128)x1 * y0 + (crypto_uint128)x2 * y4_19 + (crypto_uint128)x3 * y3_19 + (crypto_uint128)x4 * y2_19,
+    (crypto_uint128)x0 * y2 + (crypto_uint128)x1 * y1 + (crypto_uint128)x2 * y0 + (crypto_uint128)x3 * y4_19 + (crypto_uint128)x4 * y3_19,
+    (crypto_uint128)x0 * y3 + (crypto_uint128)x1 * y2 + (crypto_uint128)x2 * y1 + (crypto_uint128)x3 * y0 + (crypto_uint128)x4 * y4_19,
+    (crypto_uint128)x0 * y4 + (crypto_uint128)x1 * y3 + (crypto_uint128)x2 * y2 + (crypto_uint128)x3 * y1 + (crypto_uint128)x4 * y0);
+}
+
+static inline void fe25519_square(fe25519 *r, const fe25519 *x)
+{
+  const crypto_uint64 x0 = x->v[0],x1 = x->v[1],x2 = x->v[2],x3 = x->v[3],x4 = x->v[4];
+  const crypto_uint64 x0_2 = x0 * 2,x1_2 = x1 * 2;
+  const crypto_uint64 x3_19 = x3 * 19,x4_19 = x4 * 19;
+  fe51_carry_wide(r,
+    (crypto_uint128)x0 * x0 + (crypto_uint128)x1_2 * x4_19 + (crypto_uint128)(x2 * 2) * x3_19,
+    (crypto_uint128)x0_2 * x1 + (crypto_uint128)(x2 * 2) * x4_19 + (crypto_uint128)x3 * x3_19,
+    (crypto_uint128)x0_2 * x2 + (crypto_uint128)x1 * x1 + (crypto_uint128)(x3 * 2) * x4_19,
+    (crypto_uint128)x0_2 * x3 + (crypto_uint128)x1_2 * x2 + (crypto_uint128)x4 * x4_19,
+    (crypto_uint128)x0_2 * x4 + (crypto_uint128)x1_2 * x3 + (crypto_uint128)x2 * x2);
+}
+
+static inline void fe25519_mul121665(fe25519 *r, const fe25519 *x)
+{
+  fe51_carry_wide(r,(crypto_uint128)x->v[0] * 121665,(crypto_uint128)x->v[1] * 121665,(crypto_uint128)x->v[2] * 121665,(crypto_uint128)x->v[3] * 121665,(crypto_uint128)x->v[4] * 121665);
+}
+
+/* Constant-time swap of (a,b) if s is 1 */
+static inline void fe25519_cswap(fe25519 *a, fe25519 *b, crypto_uint64 s)
+{
+  int i;
+  crypto_uint64 t;
+  const crypto_uint64 mask = -s;
+  for(i=0;i<5;i++) {
+    t = mask & (a->v[i] ^ b->v[i]);
+    a->v[i] ^= t;
+    b->v[i] ^= t;
+  }
+}
+
+#else // !ZT_C25519_FE51
+
 typedef struct 
 {
   crypto_uint32 v[32]; 
@@ -415,7 +637,6 @@ static inline void fe25519_pack(unsigned char r[32], const fe25519 *x)
     r[i] = y.v[i];
 }
 
-#if 0
 static int fe25519_iszero(const fe25519 *x)
 {
   int i;
@@ -427,7 +648,6 @@ static int fe25519_iszero(const fe25519 *x)
     r &= equal(t.v[i],0);
   return r;
 }
-#endif
 
 static inline int fe25519_iseq_vartime(const fe25519 *x, const fe25519 *y)
 {
@@ -518,6 +738,8 @@ static inline void fe25519_square(fe25519 *r, const fe25519 *x)
   fe25519_mul(r, x, x);
 }
 
+#endif // ZT_C25519_FE51 / !ZT_C25519_FE51
+
 static void fe25519_invert(fe25519 *r, const fe25519 *x)
 {
   fe25519 z2;
@@ -639,6 +861,78 @@ static void fe25519_pow2523(fe25519 *r, const fe25519 *x)
   /* 2^252 - 3 */ fe25519_mul(r,&t,x);
 }
 
+#ifdef ZT_C25519_FE51
+
+// X25519 Montgomery ladder over the 51-bit field (RFC 7748 formulation)
+static inline int crypto_scalarmult(unsigned char *q,
+  const unsigned char *n,
+  const unsigned char *p)
+{
+  fe25519 x1,x2,z2,x3,z3,a,aa,b,bb,e,c,d,da,cb;
+  unsigned char k[32];
+  crypto_uint64 swap = 0,bit;
+  int i;
+
+  for (i = 0;i < 32;++i) k[i] = n[i];
+  k[0] &= 248;
+  k[31] &= 127;
+  k[31] |= 64;
+
+  /* the reference ladder does not mask bit 255 of u, it counts as 2^255 = 19 */
+  fe25519_unpack(&x1,p);
+  x1.v[0] += 19 * (crypto_uint64)(p[31] >> 7);
+
+  fe25519_setone(&x2);
+  fe25519_setzero(&z2);
+  x3 = x1;
+  fe25519_setone(&z3);
+
+  for (i = 254;i >= 0;--i) {
+    bit = (k[i >> 3] >> (i & 7)) & 1;
+    swap ^= bit;
+    fe25519_cswap(&x2,&x3,swap);
+    fe25519_cswap(&z2,&z3,swap);
+    swap = bit;
+
+    fe25519_add(&a,&x2,&z2);
+    fe25519_square(&aa,&a);
+    fe25519_sub(&b,&x2,&z2);
+    fe25519_square(&bb,&b);
+    fe25519_sub(&e,&aa,&bb);
+    fe25519_add(&c,&x3,&z3);
+    fe25519_sub(&d,&x3,&z3);
+    fe25519_mul(&da,&d,&a);
+    fe25519_mul(&cb,&c,&b);
+    fe25519_add(&x3,&da,&cb);
+    fe25519_square(&x3,&x3);
+    fe25519_sub(&z3,&da,&cb);
+    fe25519_square(&z3,&z3);
+    fe25519_mul(&z3,&z3,&x1);
+    fe25519_mul(&x2,&aa,&bb);
+    fe25519_mul121665(&z2,&e);
+    fe25519_add(&z2,&z2,&aa);
+    fe25519_mul(&z2,&z2,&e);
+  }
+  fe25519_cswap(&x2,&x3,swap);
+  fe25519_cswap(&z2,&z3,swap);
+
+  fe25519_invert(&z2,&z2);
+  fe25519_mul(&x2,&x2,&z2);
+  fe25519_pack(q,&x2);
+
+  return 0;
+}
+
+static const unsigned char base[32] = {9};
+
+static inline int crypto_scalarmult_base(unsigned char *q,
+  const unsigned char *n)
+{
+  return crypto_scalarmult(q,n,base);
+}
+
+#endif // ZT_C25519_FE51
+
 typedef struct 
 {
   crypto_uint32 v[32]; 
@@ -970,14 +1264,27 @@ typedef struct
   fe25519 t;
 } ge25519;
 
+// The constants below are stored as 32 limbs of 8 bits (the reference field
+// representation). With ZT_C25519_FE51 they are converted once at startup.
+#ifdef ZT_C25519_FE51
+typedef struct { crypto_uint32 v[32]; } fe25519_bytes;
+#else
+typedef fe25519 fe25519_bytes;
+#define ge25519_ecd_bytes ge25519_ecd
+#define ge25519_ec2d_bytes ge25519_ec2d
+#define ge25519_sqrtm1_bytes ge25519_sqrtm1
+#define ge25519_base_bytes ge25519_base
+#define ge25519_base_multiples_affine_bytes ge25519_base_multiples_affine
+#endif
+
 /* d */
-static const fe25519 ge25519_ecd = {{0xA3, 0x78, 0x59, 0x13, 0xCA, 0x4D, 0xEB, 0x75, 0xAB, 0xD8, 0x41, 0x41, 0x4D, 0x0A, 0x70, 0x00, 
+static const fe25519_bytes ge25519_ecd_bytes = {{0xA3, 0x78, 0x59, 0x13, 0xCA, 0x4D, 0xEB, 0x75, 0xAB, 0xD8, 0x41, 0x41, 0x4D, 0x0A, 0x70, 0x00, 
                       0x98, 0xE8, 0x79, 0x77, 0x79, 0x40, 0xC7, 0x8C, 0x73, 0xFE, 0x6F, 0x2B, 0xEE, 0x6C, 0x03, 0x52}};
 /* 2*d */
-static const fe25519 ge25519_ec2d = {{0x59, 0xF1, 0xB2, 0x26, 0x94, 0x9B, 0xD6, 0xEB, 0x56, 0xB1, 0x83, 0x82, 0x9A, 0x14, 0xE0, 0x00, 
+static const fe25519_bytes ge25519_ec2d_bytes = {{0x59, 0xF1, 0xB2, 0x26, 0x94, 0x9B, 0xD6, 0xEB, 0x56, 0xB1, 0x83, 0x82, 0x9A, 0x14, 0xE0, 0x00, 
                        0x30, 0xD1, 0xF3, 0xEE, 0xF2, 0x80, 0x8E, 0x19, 0xE7, 0xFC, 0xDF, 0x56, 0xDC, 0xD9, 0x06, 0x24}};
 /* sqrt(-1) */
-static const fe25519 ge25519_sqrtm1 = {{0xB0, 0xA0, 0x0E, 0x4A, 0x27, 0x1B, 0xEE, 0xC4, 0x78, 0xE4, 0x2F, 0xAD, 0x06, 0x18, 0x43, 0x2F, 
+static const fe25519_bytes ge25519_sqrtm1_bytes = {{0xB0, 0xA0, 0x0E, 0x4A, 0x27, 0x1B, 0xEE, 0xC4, 0x78, 0xE4, 0x2F, 0xAD, 0x06, 0x18, 0x43, 0x2F, 
                          0xA7, 0xD7, 0xFB, 0x3D, 0x99, 0x00, 0x4D, 0x2B, 0x0B, 0xDF, 0xC1, 0x4F, 0x80, 0x24, 0x83, 0x2B}};
 
 #define ge25519_p3 ge25519
@@ -1003,9 +1310,17 @@ typedef struct
   fe25519 y;
 } ge25519_aff;
 
+#ifdef ZT_C25519_FE51
+typedef struct { fe25519_bytes x,y,z,t; } ge25519_bytes;
+typedef struct { fe25519_bytes x,y; } ge25519_aff_bytes;
+#else
+typedef ge25519 ge25519_bytes;
+typedef ge25519_aff ge25519_aff_bytes;
+#endif
+
 
 /* Packed coordinates of the base point */
-static const ge25519 ge25519_base = {{{0x1A, 0xD5, 0x25, 0x8F, 0x60, 0x2D, 0x56, 0xC9, 0xB2, 0xA7, 0x25, 0x95, 0x60, 0xC7, 0x2C, 0x69, 
+static const ge25519_bytes ge25519_base_bytes = {{{0x1A, 0xD5, 0x25, 0x8F, 0x60, 0x2D, 0x56, 0xC9, 0xB2, 0xA7, 0x25, 0x95, 0x60, 0xC7, 0x2C, 0x69, 
                                 0x5C, 0xDC, 0xD6, 0xFD, 0x31, 0xE2, 0xA4, 0xC0, 0xFE, 0x53, 0x6E, 0xCD, 0xD3, 0x36, 0x69, 0x21}},
                               {{0x58, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 
                                 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66}},
@@ -1015,7 +1330,7 @@ static const ge25519 ge25519_base = {{{0x1A, 0xD5, 0x25, 0x8F, 0x60, 0x2D, 0x56,
                                 0x7D, 0xE3, 0xAB, 0x64, 0x8E, 0x4E, 0xEA, 0x66, 0x65, 0x76, 0x8B, 0xD7, 0x0F, 0x5F, 0x87, 0x67}}};
 
 /* Multiples of the base point in affine representation */
-static const ge25519_aff ge25519_base_multiples_affine[425] = {
+static const ge25519_aff_bytes ge25519_base_multiples_affine_bytes[425] = {
 {{{0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}}, 
  {{0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}}},
 {{{0x1a, 0xd5, 0x25, 0x8f, 0x60, 0x2d, 0x56, 0xc9, 0xb2, 0xa7, 0x25, 0x95, 0x60, 0xc7, 0x2c, 0x69, 0x5c, 0xdc, 0xd6, 0xfd, 0x31, 0xe2, 0xa4, 0xc0, 0xfe, 0x53, 0x6e, 0xcd, 0xd3, 0x36, 0x69, 0x21}} ,
@@ -1868,6 +2183,42 @@ static const ge25519_aff ge25519_base_multiples_affine[425] = {
  {{0x69, 0x3e, 0x47, 0x97, 0x2c, 0xaf, 0x52, 0x7c, 0x78, 0x83, 0xad, 0x1b, 0x39, 0x82, 0x2f, 0x02, 0x6f, 0x47, 0xdb, 0x2a, 0xb0, 0xe1, 0x91, 0x99, 0x55, 0xb8, 0x99, 0x3a, 0xa0, 0x44, 0x11, 0x51}}}
 };
 
+#ifdef ZT_C25519_FE51
+
+static fe25519 ge25519_ecd;
+static fe25519 ge25519_ec2d;
+static fe25519 ge25519_sqrtm1;
+static ge25519 ge25519_base;
+static ge25519_aff ge25519_base_multiples_affine[425];
+
+static void fe25519_from_bytes(fe25519 *r, const fe25519_bytes *x)
+{
+  unsigned char b[32];
+  int i;
+  for(i=0;i<32;i++) b[i] = (unsigned char)x->v[i];
+  fe25519_unpack(r,b);
+}
+
+static struct _FE51ConstantInit
+{
+  _FE51ConstantInit()
+  {
+    fe25519_from_bytes(&ge25519_ecd,&ge25519_ecd_bytes);
+    fe25519_from_bytes(&ge25519_ec2d,&ge25519_ec2d_bytes);
+    fe25519_from_bytes(&ge25519_sqrtm1,&ge25519_sqrtm1_bytes);
+    fe25519_from_bytes(&ge25519_base.x,&ge25519_base_bytes.x);
+    fe25519_from_bytes(&ge25519_base.y,&ge25519_base_bytes.y);
+    fe25519_from_bytes(&ge25519_base.z,&ge25519_base_bytes.z);
+    fe25519_from_bytes(&ge25519_base.t,&ge25519_base_bytes.t);
+    for(int i=0;i<425;i++) {
+      fe25519_from_bytes(&ge25519_base_multiples_affine[i].x,&ge25519_base_multiples_affine_bytes[i].x);
+      fe25519_from_bytes(&ge25519_base_multiples_affine[i].y,&ge25519_base_multiples_affine_bytes[i].y);
+    }
+  }
+} _fe51ConstantInit;
+
+#endif // ZT_C25519_FE51
+
 static inline void p1p1_to_p2(ge25519_p2 *r, const ge25519_p1p1 *p)
 {
   fe25519_mul(&r->x, &p->x, &p->t);
@@ -2054,7 +2405,6 @@ static inline void ge25519_pack(unsigned char r[32], const ge25519_p3 *p)
   r[31] ^= fe25519_getparity(&tx) << 7;
 }
 
-#if 0
 static int ge25519_isneutral_vartime(const ge25519_p3 *p)
 {
   int ret = 1;
@@ -2062,7 +2412,16 @@ static int ge25519_isneutral_vartime(const ge25519_p3 *p)
   if(!fe25519_iseq_vartime(&p->y, &p->z)) ret = 0;
   return ret;
 }
-#endif
+
+/* 1 if p is the canonical encoding of its y coordinate, i.e. y < 2^255-19 */
+static int ge25519_iscanonical_vartime(const unsigned char p[32])
+{
+  int i;
+  if((p[31] & 0x7f) != 0x7f) return 1;
+  for(i=30;i>0;i--)
+    if(p[i] != 0xff) return 1;
+  return (p[0] < 0xed);
+}
 
 /* computes [s1]p1 + [s2]p2 */
 static void ge25519_double_scalarmult_vartime(ge25519_p3 *r, const ge25519_p3 *p1, const sc25519 *s1, const ge25519_p3 *p2, const sc25519 *s2)
@@ -2110,6 +2469,108 @@ static void ge25519_double_scalarmult_vartime(ge25519_p3 *r, const ge25519_p3 *p
   }
 }
 
+/* r[i] = [2i+1]p for i = 0..7 */
+static void ge25519_oddmultiples_vartime(ge25519_p3 r[8], const ge25519_p3 *p)
+{
+  ge25519_p1p1 t;
+  ge25519_p3 p2;
+  int i;
+  r[0] = *p;
+  dbl_p1p1(&t, (const ge25519_p2 *)p);
+  p1p1_to_p3(&p2, &t);
+  for(i=1;i<8;i++)
+  {
+    add_p1p1(&t, &r[i-1], &p2);
+    p1p1_to_p3(&r[i], &t);
+  }
+}
+
+/* Signed sliding window recoding of s < 2^253: s = sum(r[i] * 2^i), each
+ * r[i] zero or odd in [-15,15] */
+static void sc25519_slide_vartime(signed char r[256], const unsigned char s[32])
+{
+  int i,b,k;
+  for(i=0;i<256;i++)
+    r[i] = 1 & (s[i >> 3] >> (i & 7));
+  for(i=0;i<256;i++)
+  {
+    if(!r[i]) continue;
+    for(b=1;(b <= 6)&&((i + b) < 256);b++)
+    {
+      if(!r[i+b]) continue;
+      if((r[i] + (r[i+b] << b)) <= 15)
+      {
+        r[i] += r[i+b] << b;
+        r[i+b] = 0;
+      }
+      else if((r[i] - (r[i+b] << b)) >= -15)
+      {
+        r[i] -= r[i+b] << b;
+        for(k=i+b;k<256;k++)
+        {
+          if(!r[k])
+          {
+            r[k] = 1;
+            break;
+          }
+          r[k] = 0;
+        }
+      }
+      else break;
+    }
+  }
+}
+
+/* computes sum([s_k]p_k) for k = 0..n-1 with shared doublings (Straus)
+ * pre must hold 8*n points and slide 256*n digits */
+static void ge25519_multi_scalarmult_vartime(ge25519_p3 *r, const ge25519_p3 *p, const sc25519 *s, unsigned int n, ge25519_p3 *pre, signed char *slide)
+{
+  ge25519_p1p1 tp1p1;
+  ge25519_p3 q;
+  unsigned char b[32];
+  unsigned int k;
+  int i,top = -1;
+
+  for(k=0;k<n;k++)
+  {
+    ge25519_oddmultiples_vartime(pre + (8*k), p + k);
+    sc25519_to32bytes(b, s + k);
+    sc25519_slide_vartime(slide + (256*k), b);
+    for(i=255;i>top;i--)
+    {
+      if(slide[(256*k)+i])
+      {
+        top = i;
+        break;
+      }
+    }
+  }
+
+  setneutral(r);
+  for(i=top;i>=0;i--)
+  {
+    dbl_p1p1(&tp1p1, (ge25519_p2 *)r);
+    for(k=0;k<n;k++)
+    {
+      const signed char d = slide[(256*k)+i];
+      if(d > 0)
+      {
+        p1p1_to_p3(r, &tp1p1);
+        add_p1p1(&tp1p1, r, &pre[(8*k)+(d/2)]);
+      }
+      else if(d < 0)
+      {
+        q = pre[(8*k)+((-d)/2)];
+        fe25519_neg(&q.x, &q.x);
+        fe25519_neg(&q.t, &q.t);
+        p1p1_to_p3(r, &tp1p1);
+        add_p1p1(&tp1p1, r, &q);
+      }
+    }
+    p1p1_to_p3(r, &tp1p1);
+  }
+}
+
 static inline void ge25519_scalarmult_base(ge25519_p3 *r, const sc25519 *s)
 {
   signed char b[85];
@@ -2365,6 +2826,121 @@ bool C25519::verify(const C25519::Public &their,const void *msg,unsigned int len
   return Utils::secureEq(sig,t2,32);
 }
 
+// Verify up to ZT_C25519_VERIFY_BATCH_MAX signatures with one multi-scalar
+// multiplication, falling back to verify() for each if the batch fails.
+static void _verifyBatchChunk(const C25519::Public *const *keys,const void *const *msgs,const unsigned int *lens,const void *const *signatures,bool *results,unsigned int count)
+{
+  ge25519_p3 pts[(ZT_C25519_VERIFY_BATCH_MAX * 2) + 1];
+  sc25519 scs[(ZT_C25519_VERIFY_BATCH_MAX * 2) + 1];
+  const unsigned char *akeys[ZT_C25519_VERIFY_BATCH_MAX];
+  unsigned int member[ZT_C25519_VERIFY_BATCH_MAX];
+  unsigned char z[ZT_C25519_VERIFY_BATCH_MAX][32];
+  unsigned char hram[crypto_hash_sha512_BYTES];
+  unsigned char m[96];
+  unsigned char digest[64];
+  sc25519 sch,scsig,scz;
+  ge25519 res;
+  unsigned int nmembers = 0,nkeys = 0;
+
+  // Points are [0,nmembers) -R_i, then [n,n+nkeys) -A_j, then B at the end.
+  // A random 128-bit z_i per signature makes the sum of z_i([S_i]B - [h_i]A_i - R_i)
+  // zero only if every term is, and terms for the same signer share one
+  // point so a burst of signatures from one controller costs little more
+  // than the R_i. That holds only up to small-order components: a signer
+  // can give R_i or A_i a torsion component that verify() rejects but that
+  // z_i cancels here with small probability, so the batch result matches
+  // verify() except for signatures crafted that way by their own signer.
+  memset(z,0,sizeof(z));
+  Utils::getSecureRandom(z,sizeof(z));
+  memset(&scs[ZT_C25519_VERIFY_BATCH_MAX * 2],0,sizeof(sc25519));
+
+  for(unsigned int i=0;i<count;++i) {
+    const unsigned char *const sig = (const unsigned char *)signatures[i];
+    const unsigned char *const a = keys[i]->data + 32;
+    results[i] = false;
+
+    SHA512::hash(digest,msgs[i],lens[i]);
+    if (!Utils::secureEq(sig + 64,digest,32))
+      continue;
+
+    unsigned int j = 0;
+    for(;j<nkeys;++j) {
+      if (!memcmp(akeys[j],a,32))
+        break;
+    }
+    if (j == nkeys) {
+      if (ge25519_unpackneg_vartime(&pts[ZT_C25519_VERIFY_BATCH_MAX + j],a))
+        continue;
+      memset(&scs[ZT_C25519_VERIFY_BATCH_MAX + j],0,sizeof(sc25519));
+      akeys[nkeys++] = a;
+    }
+
+    // verify() compares against the canonical encoding of R, so anything
+    // else can't verify
+    if ((!ge25519_iscanonical_vartime(sig))||(ge25519_unpackneg_vartime(&pts[nmembers],sig)))
+      continue;
+    if ((fe25519_iszero(&pts[nmembers].x))&&(sig[31] >> 7))
+      continue;
+
+    for(unsigned int k=16;k<32;++k)
+      z[nmembers][k] = 0;
+    sc25519_from32bytes(&scz,z[nmembers]);
+    scs[nmembers] = scz;
+
+    get_hram(hram,sig,a,m,96);
+    sc25519_from64bytes(&sch,hram);
+    sc25519_mul(&sch,&sch,&scz);
+    sc25519_add(&scs[ZT_C25519_VERIFY_BATCH_MAX + j],&scs[ZT_C25519_VERIFY_BATCH_MAX + j],&sch);
+
+    sc25519_from32bytes(&scsig,sig + 32);
+    sc25519_mul(&scsig,&scsig,&scz);
+    sc25519_add(&scs[ZT_C25519_VERIFY_BATCH_MAX * 2],&scs[ZT_C25519_VERIFY_BATCH_MAX * 2],&scsig);
+
+    member[nmembers++] = i;
+  }
+
+  if (nmembers >= 2) {
+    const unsigned int npts = nmembers + nkeys + 1;
+    ge25519_p3 *const pre = (ge25519_p3 *)malloc((sizeof(ge25519_p3) * 8 * npts) + (256 * npts));
+    if (pre) {
+      // Pack the points and scalars together
+      for(unsigned int j=0;j<nkeys;++j) {
+        pts[nmembers + j] = pts[ZT_C25519_VERIFY_BATCH_MAX + j];
+        scs[nmembers + j] = scs[ZT_C25519_VERIFY_BATCH_MAX + j];
+      }
+      pts[nmembers + nkeys] = ge25519_base;
+      scs[nmembers + nkeys] = scs[ZT_C25519_VERIFY_BATCH_MAX * 2];
+
+      ge25519_multi_scalarmult_vartime(&res,pts,scs,npts,pre,(signed char *)(pre + (8 * npts)));
+      free(pre);
+
+      if (ge25519_isneutral_vartime(&res)) {
+        for(unsigned int k=0;k<nmembers;++k)
+          results[member[k]] = true;
+        return;
+      }
+    }
+  }
+
+  for(unsigned int k=0;k<nmembers;++k)
+    results[member[k]] = C25519::verify(*(keys[member[k]]),msgs[member[k]],lens[member[k]],signatures[member[k]]);
+}
+
+void C25519::verifyBatch(const Public *const *keys,const void *const *msgs,const unsigned int *lens,const void *const *signatures,bool *results,unsigned int count)
+  throw()
+{
+  while (count) {
+    const unsigned int n = (count < ZT_C25519_VERIFY_BATCH_MAX) ? count : ZT_C25519_VERIFY_BATCH_MAX;
+    _verifyBatchChunk(keys,msgs,lens,signatures,results,n);
+    keys += n;
+    msgs += n;
+    lens += n;
+    signatures += n;
+    results += n;
+    count -= n;
+  }
+}
+
 void C25519::_calcPubDH(C25519::Pair &kp)
   throw()
 {
@@ -224,4 +224,40 @@ bool CertificateOfMembership::verify(const Identity &id) const
 	return valid;
 }
 
+void CertificateOfMembership::verifyBatch(const CertificateOfMembership *const *coms,const Identity *const *ids,bool *results,unsigned int count)
+{
+	std::vector< std::vector<uint64_t> > bufs(count);
+	std::vector<const C25519::Public *> keys;
+	std::vector<const void *> msgs,sigs;
+	std::vector<unsigned int> lens,idx;
+
+	for(unsigned int i=0;i<count;++i) {
+		const CertificateOfMembership &com = *(coms[i]);
+		results[i] = false;
+		if ((!com._signedBy)||(ids[i]->address() != com._signedBy))
+			continue;
+
+		std::vector<uint64_t> &buf = bufs[i];
+		for(std::vector<_Qualifier>::const_iterator q(com._qualifiers.begin());q!=com._qualifiers.end();++q) {
+			buf.push_back(Utils::hton(q->id));
+			buf.push_back(Utils::hton(q->value));
+			buf.push_back(Utils::hton(q->maxDelta));
+		}
+
+		keys.push_back(&(ids[i]->publicKey()));
+		msgs.push_back((buf.empty()) ? (const void *)0 : (const void *)&(buf[0]));
+		lens.push_back((unsigned int)(buf.size() * sizeof(uint64_t)));
+		sigs.push_back(com._signature.data);
+		idx.push_back(i);
+	}
+
+	if (!idx.empty()) {
+		bool *const r = new bool[idx.size()];
+		C25519::verifyBatch(&(keys[0]),&(msgs[0]),&(lens[0]),&(sigs[0]),r,(unsigned int)idx.size());
+		for(unsigned int k=0;k<(unsigned int)idx.size();++k)
+			results[idx[k]] = r[k];
+		delete [] r;
+	}
+}
+
 } // namespace ZeroTier
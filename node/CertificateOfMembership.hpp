@@ -305,6 +305,21 @@ public:
 	 */
 	bool verify(const Identity &id) const;
 
+	/**
+	 * Verify several certificates at once
+	 *
+	 * Results are the same as calling verify() on each, except for
+	 * signatures a controller deliberately built with a small-order
+	 * component (see C25519::verifyBatch()). Signatures are checked
+	 * together with C25519::verifyBatch().
+	 *
+	 * @param coms Certificates to verify
+	 * @param ids Identity to verify each certificate against
+	 * @param results Filled with the result for each certificate
+	 * @param count Number of certificates
+	 */
+	static void verifyBatch(const CertificateOfMembership *const *coms,const Identity *const *ids,bool *results,unsigned int count);
+
 	/**
 	 * @return True if signed
 	 */
@@ -130,10 +130,22 @@
 #define ZT_EOL_S "\n"
 #endif
 
+// Storage class for plain-old-data thread local variables
+#ifdef __WINDOWS__
+#define ZT_THREAD_LOCAL __declspec(thread)
+#else
+#define ZT_THREAD_LOCAL __thread
+#endif
+
 #ifndef __BYTE_ORDER
 #include <endian.h>
 #endif
 
+/**
+ * Maximum number of spare IncomingPacket objects kept per thread
+ */
+#define ZT_INCOMINGPACKET_POOL_SIZE 256
+
 /**
  * Length of a ZeroTier address in bytes
  */
@@ -176,6 +188,24 @@
  */
 #define ZT_FRAGMENTED_PACKET_RECEIVE_TIMEOUT 500
 
+/**
+ * Number of independently locked shards in Switch's reassembly queue (power of two)
+ */
+#define ZT_DEFRAG_QUEUE_SHARDS 8
+
+/**
+ * Size of the blocks fragment payloads are stored in while awaiting reassembly
+ */
+#define ZT_DEFRAG_ARENA_BLOCK_SIZE 256
+
+/**
+ * Maximum fragment payload bytes held for reassembly per shard
+ *
+ * Fragments that arrive while a shard is full are dropped, which bounds
+ * what a flood of fragments that never complete can cost us.
+ */
+#define ZT_DEFRAG_ARENA_MAX_BYTES 1048576
+
 /**
  * Length of secret key in bytes -- 256-bit -- do not change
  */
@@ -196,6 +226,15 @@
  */
 #define ZT_PEER_IN_MEMORY_EXPIRATION 600000
 
+/**
+ * Number of independently locked shards in Topology's peer table (power of two)
+ *
+ * Peer lookups happen for every packet in and out, so the table is split
+ * by address to keep threads processing traffic for different peers from
+ * contending on one lock.
+ */
+#define ZT_TOPOLOGY_PEER_SHARDS 16
+
 /**
  * Delay between WHOIS retries in ms
  */
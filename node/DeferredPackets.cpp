@@ -30,6 +30,11 @@
 #include "IncomingPacket.hpp"
 #include "RuntimeEnvironment.hpp"
 #include "Node.hpp"
+#include "Peer.hpp"
+#include "Topology.hpp"
+#include "Network.hpp"
+#include "Identity.hpp"
+#include "VerifiedComCache.hpp"
 
 namespace ZeroTier {
 
@@ -65,6 +70,21 @@ bool DeferredPackets::enqueue(IncomingPacket *pkt)
 	}
 }
 
+bool DeferredPackets::enqueue(const SharedPtr<Peer> &peer,const CertificateOfMembership &com)
+{
+	_q_m.lock();
+	if (_coms.size() >= ZT_DEFFEREDPACKETS_MAX_COMS) {
+		_q_m.unlock();
+		return false;
+	}
+	_coms.push_back(_PendingCom());
+	_coms.back().peer = peer;
+	_coms.back().com = com;
+	_q_m.unlock();
+	_q_s.post();
+	return true;
+}
+
 int DeferredPackets::process()
 {
 	SharedPtr<IncomingPacket> pkt;
@@ -75,7 +95,7 @@ int DeferredPackets::process()
 		_q_s.post();
 		return -1;
 	}
-	while (_readPtr == _writePtr) {
+	while ((_readPtr == _writePtr)&&(_coms.empty())) {
 		_q_m.unlock();
 		_q_s.wait();
 		_q_m.lock();
@@ -85,6 +105,16 @@ int DeferredPackets::process()
 			return -1;
 		}
 	}
+
+	if (!_coms.empty()) {
+		// Take everything that has accumulated and verify it as one batch
+		std::vector<_PendingCom> coms;
+		coms.swap(_coms);
+		_q_m.unlock();
+		_verifyComs(coms);
+		return (int)coms.size();
+	}
+
 	pkt.swap(_q[_readPtr++ % ZT_DEFFEREDPACKETS_MAX]);
 	_q_m.unlock();
 
@@ -92,4 +122,56 @@ int DeferredPackets::process()
 	return 1;
 }
 
+void DeferredPackets::_verifyComs(const std::vector<_PendingCom> &coms)
+{
+	std::vector<const CertificateOfMembership *> batch;
+	std::vector<const Identity *> ids;
+	std::vector<unsigned int> cached;
+	std::vector<unsigned int> idx;
+	std::vector< SharedPtr<Peer> > signers; // keeps identities in ids valid
+
+	for(unsigned int i=0;i<(unsigned int)coms.size();++i) {
+		const CertificateOfMembership &com = coms[i].com;
+		if ((!com)||(com.issuedTo() != coms[i].peer->address())||(com.signedBy() != Network::controllerFor(com.networkId())))
+			continue; // would be rejected without a signature check anyway
+		if (com.signedBy() == RR->identity.address()) {
+			ids.push_back(&(RR->identity));
+		} else {
+			SharedPtr<Peer> signer(RR->topology->getPeer(com.signedBy()));
+			if (!signer) {
+				coms[i].peer->validateAndSetNetworkMembershipCertificate(RR,com.networkId(),com); // requests WHOIS for signer
+				continue;
+			}
+			signers.push_back(signer);
+			ids.push_back(&(signer->identity()));
+		}
+		if (RR->comCache->has(com,*(ids.back()))) {
+			ids.pop_back();
+			cached.push_back(i);
+			continue;
+		}
+		batch.push_back(&com);
+		idx.push_back(i);
+	}
+	for(std::vector<unsigned int>::const_iterator i(cached.begin());i!=cached.end();++i)
+		coms[*i].peer->validateAndSetNetworkMembershipCertificate(RR,coms[*i].com.networkId(),coms[*i].com,true);
+	if (batch.empty())
+		return;
+
+	bool *const results = new bool[batch.size()];
+	try {
+		CertificateOfMembership::verifyBatch(&(batch[0]),&(ids[0]),results,(unsigned int)batch.size());
+		for(unsigned int k=0;k<(unsigned int)batch.size();++k) {
+			const _PendingCom &pc = coms[idx[k]];
+			if (results[k]) {
+				RR->comCache->add(pc.com,*(ids[k]));
+				pc.peer->validateAndSetNetworkMembershipCertificate(RR,pc.com.networkId(),pc.com,true);
+			} else {
+				TRACE("rejected network membership certificate for %.16llx signed by %s: signature check failed",(unsigned long long)pc.com.networkId(),pc.com.signedBy().toString().c_str());
+			}
+		}
+	} catch ( ... ) {}
+	delete [] results;
+}
+
 } // namespace ZeroTier
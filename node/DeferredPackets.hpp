@@ -28,21 +28,30 @@
 #ifndef ZT_DEFERREDPACKETS_HPP
 #define ZT_DEFERREDPACKETS_HPP
 
+#include <vector>
+
 #include "Constants.hpp"
 #include "SharedPtr.hpp"
 #include "Mutex.hpp"
 #include "DeferredPackets.hpp"
 #include "BinarySemaphore.hpp"
+#include "CertificateOfMembership.hpp"
 
 /**
  * Maximum number of deferred packets
  */
 #define ZT_DEFFEREDPACKETS_MAX 1024
 
+/**
+ * Maximum number of certificates of membership waiting for verification
+ */
+#define ZT_DEFFEREDPACKETS_MAX_COMS 1024
+
 namespace ZeroTier {
 
 class IncomingPacket;
 class RuntimeEnvironment;
+class Peer;
 
 /**
  * Deferred packets
@@ -72,6 +81,21 @@ public:
 	 */
 	bool enqueue(IncomingPacket *pkt);
 
+	/**
+	 * Enqueue a certificate of membership for background verification
+	 *
+	 * Certificates that pile up while the background thread(s) are busy are
+	 * verified together with CertificateOfMembership::verifyBatch() and then
+	 * handed to Peer::validateAndSetNetworkMembershipCertificate(). This is
+	 * only for COMs that nothing is waiting on, e.g. those pushed with
+	 * NETWORK_MEMBERSHIP_CERTIFICATE.
+	 *
+	 * @param peer Peer that sent the COM
+	 * @param com Certificate of membership
+	 * @return False if queue is full
+	 */
+	bool enqueue(const SharedPtr<Peer> &peer,const CertificateOfMembership &com);
+
 	/**
 	 * Wait for and then process a deferred packet
 	 *
@@ -84,6 +108,15 @@ public:
 	int process();
 
 private:
+	struct _PendingCom
+	{
+		SharedPtr<Peer> peer;
+		CertificateOfMembership com;
+	};
+
+	void _verifyComs(const std::vector<_PendingCom> &coms);
+
+	std::vector<_PendingCom> _coms;
 	SharedPtr<IncomingPacket> _q[ZT_DEFFEREDPACKETS_MAX];
 	const RuntimeEnvironment *const RR;
 	unsigned long _readPtr;
@@ -28,11 +28,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <new>
 #include <stdexcept>
 #include <vector>
 #include <utility>
 #include <algorithm>
 
+#if (!defined(ZT_HASHTABLE_SSE2)) && (!defined(ZT_HASHTABLE_NO_SSE2)) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)))
+#define ZT_HASHTABLE_SSE2 1
+#endif
+
+#ifdef ZT_HASHTABLE_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace ZeroTier {
 
 /**
@@ -42,29 +51,43 @@ namespace ZeroTier {
  * limitations. Keys can be uint64_t or an object, and if the latter they
  * must implement a method called hashCode() that returns an unsigned long
  * value that is evenly distributed.
+ *
+ * Entries are stored in place in one flat array (open addressing) with a
+ * parallel array of control bytes, in the style of SwissTable. Each control
+ * byte is empty, deleted, or seven bits of the key's hash, and lookups scan
+ * a group of 16 of them at a time (with SSE2 where available) before
+ * comparing any keys. Erased entries leave a deleted marker behind rather
+ * than moving anything, which is what makes erasing during iteration safe.
+ * Values may move when keys are added, so don't hold pointers or references
+ * across set() or operator[].
  */
 template<typename K,typename V>
 class Hashtable
 {
 private:
-	struct _Bucket
+	struct _Slot
 	{
-		_Bucket(const K &k,const V &v) : k(k),v(v) {}
-		_Bucket(const K &k) : k(k),v() {}
-		_Bucket(const _Bucket &b) : k(b.k),v(b.v) {}
-		inline _Bucket &operator=(const _Bucket &b) { k = b.k; v = b.v; return *this; }
+		_Slot(const K &k,const V &v) : k(k),v(v) {}
+		_Slot(const K &k) : k(k),v() {}
 		K k;
 		V v;
-		_Bucket *next; // must be set manually for each _Bucket
+	};
+
+	enum {
+		_GROUP = 16,        // control bytes probed together
+		_EMPTY = 0x80,      // never used since last rehash
+		_DELETED = 0xfe,    // erased, but probes must continue past it
+		_PAD = 0xff         // past the end of a table smaller than a group
 	};
 
 public:
 	/**
 	 * A simple forward iterator (different from STL)
 	 *
-	 * It's safe to erase the last key, but not others. Don't use set() since that
-	 * may rehash and invalidate the iterator. Note the erasing the key will destroy
-	 * the targets of the pointers returned by next().
+	 * It's safe to erase any key, including the current one, while iterating.
+	 * Don't use set() or operator[] since those may rehash and invalidate the
+	 * iterator. Note that erasing a key will destroy the targets of the
+	 * pointers returned for it by next().
 	 */
 	class Iterator
 	{
@@ -74,8 +97,7 @@ public:
 		 */
 		Iterator(Hashtable &ht) :
 			_idx(0),
-			_ht(&ht),
-			_b(ht._t[0])
+			_ht(&ht)
 		{
 		}
 
@@ -86,58 +108,47 @@ public:
 		 */
 		inline bool next(K *&kptr,V *&vptr)
 		{
-			for(;;) {
-				if (_b) {
-					kptr = &(_b->k);
-					vptr = &(_b->v);
-					_b = _b->next;
+			while (_idx < _ht->_bc) {
+				const unsigned long i = _idx++;
+				if (_ht->_ctrl[i] < _EMPTY) {
+					kptr = &(_ht->_t[i].k);
+					vptr = &(_ht->_t[i].v);
 					return true;
 				}
-				++_idx;
-				if (_idx >= _ht->_bc)
-					return false;
-				_b = _ht->_t[_idx];
 			}
+			return false;
 		}
 
 	private:
 		unsigned long _idx;
 		Hashtable *_ht;
-		_Bucket *_b;
 	};
 	friend class Hashtable::Iterator;
 
 	/**
-	 * @param bc Initial capacity in buckets (default: 128, must be nonzero)
+	 * @param bc Initial capacity in entries (default: 128, rounded up to a power of two)
 	 */
 	Hashtable(unsigned long bc = 128) :
-		_t(reinterpret_cast<_Bucket **>(::malloc(sizeof(_Bucket *) * bc))),
-		_bc(bc),
-		_s(0)
+		_t((_Slot *)0),
+		_ctrl((uint8_t *)0),
+		_bc(0),
+		_s(0),
+		_growthLeft(0)
 	{
-		if (!_t)
-			throw std::bad_alloc();
-		for(unsigned long i=0;i<bc;++i)
-			_t[i] = (_Bucket *)0;
+		_allocate(_capacityFor(bc));
 	}
 
 	Hashtable(const Hashtable<K,V> &ht) :
-		_t(reinterpret_cast<_Bucket **>(::malloc(sizeof(_Bucket *) * ht._bc))),
-		_bc(ht._bc),
-		_s(ht._s)
+		_t((_Slot *)0),
+		_ctrl((uint8_t *)0),
+		_bc(0),
+		_s(0),
+		_growthLeft(0)
 	{
-		if (!_t)
-			throw std::bad_alloc();
-		for(unsigned long i=0;i<_bc;++i)
-			_t[i] = (_Bucket *)0;
-		for(unsigned long i=0;i<_bc;++i) {
-			const _Bucket *b = ht._t[i];
-			while (b) {
-				_Bucket *nb = new _Bucket(*b);
-				nb->next = _t[i];
-				_t[i] = nb;
-				b = b->next;
-			}
+		_allocate(ht._bc);
+		for(unsigned long i=0;i<ht._bc;++i) {
+			if (ht._ctrl[i] < _EMPTY)
+				_insertNew(ht._t[i].k,&(ht._t[i].v));
 		}
 	}
 
@@ -145,18 +156,16 @@ public:
 	{
 		this->clear();
 		::free(_t);
+		::free(_ctrl);
 	}
 
 	inline Hashtable &operator=(const Hashtable<K,V> &ht)
 	{
-		this->clear();
-		if (ht._s) {
+		if (this != &ht) {
+			this->clear();
 			for(unsigned long i=0;i<ht._bc;++i) {
-				const _Bucket *b = ht._t[i];
-				while (b) {
-					this->set(b->k,b->v);
-					b = b->next;
-				}
+				if (ht._ctrl[i] < _EMPTY)
+					this->set(ht._t[i].k,ht._t[i].v);
 			}
 		}
 		return *this;
@@ -169,16 +178,14 @@ public:
 	{
 		if (_s) {
 			for(unsigned long i=0;i<_bc;++i) {
-				_Bucket *b = _t[i];
-				while (b) {
-					_Bucket *const nb = b->next;
-					delete b;
-					b = nb;
-				}
-				_t[i] = (_Bucket *)0;
+				if (_ctrl[i] < _EMPTY)
+					_t[i].~_Slot();
 			}
 			_s = 0;
 		}
+		for(unsigned long i=0;i<_bc;++i)
+			_ctrl[i] = _EMPTY;
+		_growthLeft = _maxLoad(_bc);
 	}
 
 	/**
@@ -190,11 +197,8 @@ public:
 		if (_s) {
 			k.reserve(_s);
 			for(unsigned long i=0;i<_bc;++i) {
-				_Bucket *b = _t[i];
-				while (b) {
-					k.push_back(b->k);
-					b = b->next;
-				}
+				if (_ctrl[i] < _EMPTY)
+					k.push_back(_t[i].k);
 			}
 		}
 		return k;
@@ -211,11 +215,8 @@ public:
 	{
 		if (_s) {
 			for(unsigned long i=0;i<_bc;++i) {
-				_Bucket *b = _t[i];
-				while (b) {
-					v.push_back(b->k);
-					b = b->next;
-				}
+				if (_ctrl[i] < _EMPTY)
+					v.push_back(_t[i].k);
 			}
 		}
 	}
@@ -229,11 +230,8 @@ public:
 		if (_s) {
 			k.reserve(_s);
 			for(unsigned long i=0;i<_bc;++i) {
-				_Bucket *b = _t[i];
-				while (b) {
-					k.push_back(std::pair<K,V>(b->k,b->v));
-					b = b->next;
-				}
+				if (_ctrl[i] < _EMPTY)
+					k.push_back(std::pair<K,V>(_t[i].k,_t[i].v));
 			}
 		}
 		return k;
@@ -245,13 +243,8 @@ public:
 	 */
 	inline V *get(const K &k)
 	{
-		_Bucket *b = _t[_hc(k) % _bc];
-		while (b) {
-			if (b->k == k)
-				return &(b->v);
-			b = b->next;
-		}
-		return (V *)0;
+		const unsigned long i = _find(k,_mix(_hc(k)));
+		return ((i < _bc) ? &(_t[i].v) : (V *)0);
 	}
 	inline const V *get(const K &k) const { return const_cast<Hashtable *>(this)->get(k); }
 
@@ -261,13 +254,7 @@ public:
 	 */
 	inline bool contains(const K &k) const
 	{
-		_Bucket *b = _t[_hc(k) % _bc];
-		while (b) {
-			if (b->k == k)
-				return true;
-			b = b->next;
-		}
-		return false;
+		return (_find(k,_mix(_hc(k))) < _bc);
 	}
 
 	/**
@@ -276,22 +263,20 @@ public:
 	 */
 	inline bool erase(const K &k)
 	{
-		const unsigned long bidx = _hc(k) % _bc;
-		_Bucket *lastb = (_Bucket *)0;
-		_Bucket *b = _t[bidx];
-		while (b) {
-			if (b->k == k) {
-				if (lastb)
-					lastb->next = b->next;
-				else _t[bidx] = b->next;
-				delete b;
-				--_s;
-				return true;
-			}
-			lastb = b;
-			b = b->next;
+		const unsigned long i = _find(k,_mix(_hc(k)));
+		if (i >= _bc)
+			return false;
+		_t[i].~_Slot();
+		// A group that still has an empty slot never made any probe go past
+		// it, so the erased slot can go straight back to empty
+		if (_match(_ctrl + (i & ~((unsigned long)_GROUP - 1)),_EMPTY)) {
+			_ctrl[i] = _EMPTY;
+			++_growthLeft;
+		} else {
+			_ctrl[i] = _DELETED;
 		}
-		return false;
+		--_s;
+		return true;
 	}
 
 	/**
@@ -301,28 +286,14 @@ public:
 	 */
 	inline V &set(const K &k,const V &v)
 	{
-		const unsigned long h = _hc(k);
-		unsigned long bidx = h % _bc;
-
-		_Bucket *b = _t[bidx];
-		while (b) {
-			if (b->k == k) {
-				b->v = v;
-				return b->v;
-			}
-			b = b->next;
+		const uint64_t h = _mix(_hc(k));
+		const unsigned long i = _find(k,h);
+		if (i < _bc) {
+			_t[i].v = v;
+			return _t[i].v;
 		}
-
-		if (_s >= _bc) {
-			_grow();
-			bidx = h % _bc;
-		}
-
-		b = new _Bucket(k,v);
-		b->next = _t[bidx];
-		_t[bidx] = b;
-		++_s;
-		return b->v;
+		const unsigned long ni = _insert(k,&v,h); // may rehash, so index _t only after
+		return _t[ni].v;
 	}
 
 	/**
@@ -331,26 +302,12 @@ public:
 	 */
 	inline V &operator[](const K &k)
 	{
-		const unsigned long h = _hc(k);
-		unsigned long bidx = h % _bc;
-
-		_Bucket *b = _t[bidx];
-		while (b) {
-			if (b->k == k)
-				return b->v;
-			b = b->next;
-		}
-
-		if (_s >= _bc) {
-			_grow();
-			bidx = h % _bc;
-		}
-
-		b = new _Bucket(k);
-		b->next = _t[bidx];
-		_t[bidx] = b;
-		++_s;
-		return b->v;
+		const uint64_t h = _mix(_hc(k));
+		const unsigned long i = _find(k,h);
+		if (i < _bc)
+			return _t[i].v;
+		const unsigned long ni = _insert(k,(const V *)0,h);
+		return _t[ni].v;
 	}
 
 	/**
@@ -371,11 +328,6 @@ private:
 	}
 	static inline unsigned long _hc(const uint64_t i)
 	{
-		/* NOTE: this assumes that 'i' is evenly distributed, which is the case for
-		 * packet IDs and network IDs -- the two use cases in ZT for uint64_t keys.
-		 * These values are also greater than 0xffffffff so they'll map onto a full
-		 * bucket count just fine no matter what happens. Normally you'd want to
-		 * hash an integer key index in a hash table. */
 		return (unsigned long)i;
 	}
 	static inline unsigned long _hc(const uint32_t i)
@@ -387,32 +339,154 @@ private:
 		return ((unsigned long)i * (unsigned long)0x9e3779b1);
 	}
 
-	inline void _grow()
+	/* hashCode() values and raw uint64_t keys are evenly distributed but not
+	 * necessarily in their low bits, which pick both the group and the seven
+	 * bits stored in the control byte, so mix them once more here. */
+	static inline uint64_t _mix(const unsigned long hc)
 	{
-		const unsigned long nc = _bc * 2;
-		_Bucket **nt = reinterpret_cast<_Bucket **>(::malloc(sizeof(_Bucket *) * nc));
-		if (nt) {
-			for(unsigned long i=0;i<nc;++i)
-				nt[i] = (_Bucket *)0;
-			for(unsigned long i=0;i<_bc;++i) {
-				_Bucket *b = _t[i];
-				while (b) {
-					_Bucket *const nb = b->next;
-					const unsigned long nidx = _hc(b->k) % nc;
-					b->next = nt[nidx];
-					nt[nidx] = b;
-					b = nb;
-				}
+		const uint64_t x = (uint64_t)hc * 0x9e3779b97f4a7c15ULL;
+		return (x ^ (x >> 32));
+	}
+
+	// Bit n of the result is set if byte n of the 16-byte group equals b
+	static inline unsigned int _match(const uint8_t *g,const uint8_t b)
+	{
+#ifdef ZT_HASHTABLE_SSE2
+		return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8((char)b),_mm_loadu_si128(reinterpret_cast<const __m128i *>(g))));
+#else
+		unsigned int m = 0;
+		for(unsigned int i=0;i<_GROUP;++i)
+			m |= ((unsigned int)(g[i] == b)) << i;
+		return m;
+#endif
+	}
+
+	static inline unsigned int _lowestBit(unsigned int m)
+	{
+#ifdef __GNUC__
+		return (unsigned int)__builtin_ctz(m);
+#else
+		unsigned int i = 0;
+		while (!(m & 1)) {
+			m >>= 1;
+			++i;
+		}
+		return i;
+#endif
+	}
+
+	static inline unsigned long _capacityFor(const unsigned long n)
+	{
+		unsigned long c = 4;
+		while (c < n)
+			c <<= 1;
+		return c;
+	}
+
+	// Keep at least one empty slot per table (and one per eight) so probes end
+	static inline unsigned long _maxLoad(const unsigned long c) { return ((c < 8) ? (c - 1) : (c - (c >> 3))); }
+
+	inline unsigned long _groupMask() const { return ((_bc > (unsigned long)_GROUP) ? ((_bc / _GROUP) - 1) : 0); }
+
+	/* Groups are probed quadratically (by triangular numbers), which visits
+	 * every group once when their count is a power of two. The search stops
+	 * at the first group holding an empty slot, since an insert for this key
+	 * would have stopped there too. Returns _bc if not found. */
+	inline unsigned long _find(const K &k,const uint64_t h) const
+	{
+		const uint8_t h2 = (uint8_t)(h & 0x7f);
+		const unsigned long gm = _groupMask();
+		unsigned long g = (unsigned long)(h >> 7) & gm;
+		for(unsigned long step=0;;) {
+			const uint8_t *const c = _ctrl + (g * _GROUP);
+			unsigned int m = _match(c,h2);
+			while (m) {
+				const unsigned long i = (g * _GROUP) + _lowestBit(m);
+				if (_t[i].k == k)
+					return i;
+				m &= m - 1;
+			}
+			if ((_match(c,_EMPTY))||(step >= gm))
+				return _bc;
+			g = (g + ++step) & gm;
+		}
+	}
+
+	// First empty or deleted slot on this hash's probe sequence
+	inline unsigned long _findFree(const uint64_t h) const
+	{
+		const unsigned long gm = _groupMask();
+		unsigned long g = (unsigned long)(h >> 7) & gm;
+		for(unsigned long step=0;;) {
+			const uint8_t *const c = _ctrl + (g * _GROUP);
+			const unsigned int m = _match(c,_EMPTY) | _match(c,_DELETED);
+			if (m)
+				return ((g * _GROUP) + _lowestBit(m));
+			g = (g + ++step) & gm;
+		}
+	}
+
+	// Insert a key known not to be present and return its slot (v NULL for default value)
+	inline unsigned long _insert(const K &k,const V *v,const uint64_t h)
+	{
+		unsigned long i = _findFree(h);
+		if ((!_growthLeft)&&(_ctrl[i] != _DELETED)) {
+			// Out of room: grow, or just sweep out deleted markers if at most half full
+			_rehash((_s < (_maxLoad(_bc) / 2)) ? _bc : (_bc * 2));
+			i = _findFree(h);
+		}
+		if (v)
+			new (&(_t[i])) _Slot(k,*v);
+		else new (&(_t[i])) _Slot(k);
+		if (_ctrl[i] == _EMPTY)
+			--_growthLeft;
+		_ctrl[i] = (uint8_t)(h & 0x7f);
+		++_s;
+		return i;
+	}
+	inline void _insertNew(const K &k,const V *v) { _insert(k,v,_mix(_hc(k))); }
+
+	inline void _allocate(const unsigned long c)
+	{
+		// Control bytes are padded out to at least one full group for _match()
+		const unsigned long cc = (c < (unsigned long)_GROUP) ? (unsigned long)_GROUP : c;
+		_Slot *const t = reinterpret_cast<_Slot *>(::malloc(sizeof(_Slot) * c));
+		uint8_t *const ctrl = reinterpret_cast<uint8_t *>(::malloc(cc));
+		if ((!t)||(!ctrl)) {
+			::free(t);
+			::free(ctrl);
+			throw std::bad_alloc();
+		}
+		for(unsigned long i=0;i<cc;++i)
+			ctrl[i] = (i < c) ? _EMPTY : _PAD;
+		_t = t;
+		_ctrl = ctrl;
+		_bc = c;
+		_s = 0;
+		_growthLeft = _maxLoad(c);
+	}
+
+	inline void _rehash(const unsigned long nc)
+	{
+		_Slot *const ot = _t;
+		uint8_t *const octrl = _ctrl;
+		const unsigned long obc = _bc;
+		_allocate(nc);
+		for(unsigned long i=0;i<obc;++i) {
+			if (octrl[i] < _EMPTY) {
+				_insertNew(ot[i].k,&(ot[i].v));
+				ot[i].~_Slot();
 			}
-			::free(_t);
-			_t = nt;
-			_bc = nc;
 		}
+		::free(ot);
+		::free(octrl);
 	}
 
-	_Bucket **_t;
+	_Slot *_t;
+	uint8_t *_ctrl;
 	unsigned long _bc;
 	unsigned long _s;
+	unsigned long _growthLeft;
 };
 
 } // namespace ZeroTier
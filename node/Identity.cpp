@@ -81,38 +81,62 @@ static inline void _computeMemoryHardHash(const void *publicKey,unsigned int pub
 }
 
 // Hashcash generation halting condition -- halt when first byte is less than
-// threshold value.
+// threshold value, or when the search has been aborted.
 struct _Identity_generate_cond
 {
 	_Identity_generate_cond() throw() {}
-	_Identity_generate_cond(unsigned char *sb,char *gm) throw() : digest(sb),genmem(gm) {}
+	_Identity_generate_cond(unsigned char *sb,char *gm,const volatile bool *a) throw() : digest(sb),genmem(gm),abort(a) {}
 	inline bool operator()(const C25519::Pair &kp) const
 		throw()
 	{
+		if ((abort)&&(*abort))
+			return true;
 		_computeMemoryHardHash(kp.pub.data,(unsigned int)kp.pub.size(),digest,genmem);
 		return (digest[0] < ZT_IDENTITY_GEN_HASHCASH_FIRST_BYTE_LESS_THAN);
 	}
 	unsigned char *digest;
 	char *genmem;
+	const volatile bool *abort;
 };
 
 void Identity::generate()
+{
+	generate(0,0,(const volatile bool *)0);
+}
+
+bool Identity::generate(uint64_t prefix,unsigned int prefixBits,const volatile bool *abort)
 {
 	unsigned char digest[64];
 	char *genmem = new char[ZT_IDENTITY_GEN_MEMORY];
 
+	if (prefixBits > (ZT_ADDRESS_LENGTH * 8))
+		prefixBits = ZT_ADDRESS_LENGTH * 8;
+	const uint64_t prefixMask = (prefixBits) ? ((0xffffffffffULL << ((ZT_ADDRESS_LENGTH * 8) - prefixBits)) & 0xffffffffffULL) : 0ULL;
+	prefix &= prefixMask;
+
 	C25519::Pair kp;
-	do {
-		kp = C25519::generateSatisfying(_Identity_generate_cond(digest,genmem));
-		_address.setTo(digest + 59,ZT_ADDRESS_LENGTH); // last 5 bytes are address
-	} while (_address.isReserved());
+	Address a;
+	for(;;) {
+		kp = C25519::generateSatisfying(_Identity_generate_cond(digest,genmem,abort));
+		if ((abort)&&(*abort)) {
+			delete [] genmem;
+			return false;
+		}
+		a.setTo(digest + 59,ZT_ADDRESS_LENGTH); // last 5 bytes are address
+		if ((!a.isReserved())&&((a.toInt() & prefixMask) == prefix))
+			break;
+	}
 
+	_address = a;
 	_publicKey = kp.pub;
 	if (!_privateKey)
 		_privateKey = new C25519::Private();
 	*_privateKey = kp.priv;
 
+	Utils::burn(&kp,sizeof(kp));
 	delete [] genmem;
+
+	return true;
 }
 
 bool Identity::locallyValidate() const
@@ -125,6 +125,21 @@ public:
 	 */
 	void generate();
 
+	/**
+	 * Generate a new identity, optionally with an address starting with a prefix
+	 *
+	 * Each call allocates its own work memory, so several threads may each
+	 * run this on their own Identity at once to search in parallel. Every bit
+	 * of prefix doubles the expected time. If the search is aborted this
+	 * identity is left unchanged.
+	 *
+	 * @param prefix Prefix in the most significant bits of a 40-bit address
+	 * @param prefixBits Number of prefix bits to match (0 for any address, max 40)
+	 * @param abort If non-NULL, give up once this becomes true
+	 * @return True if an identity was generated, false if aborted
+	 */
+	bool generate(uint64_t prefix,unsigned int prefixBits,const volatile bool *abort);
+
 	/**
 	 * Check the validity of this identity's pairing of key to address
 	 *
@@ -224,6 +239,11 @@ public:
 	 */
 	inline const Address &address() const throw() { return _address; }
 
+	/**
+	 * @return This identity's public key
+	 */
+	inline const C25519::Public &publicKey() const throw() { return _publicKey; }
+
 	/**
 	 * Serialize this identity (binary)
 	 * 
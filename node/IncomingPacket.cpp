@@ -47,6 +47,7 @@
 #include "Node.hpp"
 #include "AntiRecursion.hpp"
 #include "DeferredPackets.hpp"
+#include "ValidatedIdentityCache.hpp"
 
 namespace ZeroTier {
 
@@ -71,7 +72,9 @@ bool IncomingPacket::tryDecode(const RuntimeEnvironment *RR,bool deferred)
 
 		SharedPtr<Peer> peer(RR->topology->getPeer(sourceAddress));
 		if (peer) {
-			if (!dearmor(peer->key())) {
+			if (_dearmored) {
+				_dearmored = false;
+			} else if (!dearmor(peer->key())) {
 				TRACE("dropped packet from %s(%s), MAC authentication failed (size: %u)",peer->address().toString().c_str(),_remoteAddress.toString().c_str(),size());
 				return true;
 			}
@@ -109,6 +112,7 @@ bool IncomingPacket::tryDecode(const RuntimeEnvironment *RR,bool deferred)
 				case Packet::VERB_REQUEST_PROOF_OF_WORK:          return _doREQUEST_PROOF_OF_WORK(RR,peer);
 			}
 		} else {
+			_waitingFor = sourceAddress;
 			RR->sw->requestWhois(sourceAddress);
 			return false;
 		}
@@ -120,6 +124,40 @@ bool IncomingPacket::tryDecode(const RuntimeEnvironment *RR,bool deferred)
 	}
 }
 
+void IncomingPacket::dearmorBatch(const RuntimeEnvironment *RR,IncomingPacket *const *packets,unsigned int count)
+{
+	Packet *pkts[ZT_PACKET_DEARMOR_BATCH_MAX];
+	const void *keys[ZT_PACKET_DEARMOR_BATCH_MAX];
+	SharedPtr<Peer> peers[ZT_PACKET_DEARMOR_BATCH_MAX];
+	IncomingPacket *ips[ZT_PACKET_DEARMOR_BATCH_MAX];
+	bool results[ZT_PACKET_DEARMOR_BATCH_MAX];
+
+	unsigned int i = 0;
+	while (i < count) {
+		unsigned int n = 0;
+		for(;(i<count)&&(n<ZT_PACKET_DEARMOR_BATCH_MAX);++i) {
+			IncomingPacket *const ip = packets[i];
+			if ((ip->_dearmored)||(ip->size() < ZT_PROTO_MIN_PACKET_LENGTH)||((ip->cipher() == ZT_PROTO_CIPHER_SUITE__C25519_POLY1305_NONE)&&(ip->verb() == Packet::VERB_HELLO)))
+				continue;
+			peers[n] = RR->topology->getPeer(ip->source());
+			if (!peers[n])
+				continue;
+			pkts[n] = ip;
+			keys[n] = peers[n]->key(); // peers[] holds a reference so the key stays valid
+			ips[n++] = ip;
+		}
+		if (!n)
+			continue;
+
+		Packet::dearmorBatch(pkts,keys,results,n);
+
+		for(unsigned int k=0;k<n;++k) {
+			ips[k]->_dearmored = results[k];
+			peers[k].zero();
+		}
+	}
+}
+
 bool IncomingPacket::_doERROR(const RuntimeEnvironment *RR,const SharedPtr<Peer> &peer)
 {
 	try {
@@ -214,14 +252,17 @@ bool IncomingPacket::_doHELLO(const RuntimeEnvironment *RR,SharedPtr<Peer> &peer
 		InetAddress externalSurfaceAddress;
 		uint64_t worldId = ZT_WORLD_ID_NULL;
 		uint64_t worldTimestamp = 0;
+		unsigned int cipherSuites = 0;
 		{
 			unsigned int ptr = ZT_PROTO_VERB_HELLO_IDX_IDENTITY + id.deserialize(*this,ZT_PROTO_VERB_HELLO_IDX_IDENTITY);
 			if (ptr < size()) // ZeroTier One < 1.0.3 did not include physical destination address info
 				ptr += externalSurfaceAddress.deserialize(*this,ptr);
 			if ((ptr + 16) <= size()) { // older versions also did not include World IDs or timestamps
 				worldId = at<uint64_t>(ptr); ptr += 8;
-				worldTimestamp = at<uint64_t>(ptr);
+				worldTimestamp = at<uint64_t>(ptr); ptr += 8;
 			}
+			if ((ptr + 2) <= size()) // nor optional cipher suites
+				cipherSuites = at<uint16_t>(ptr);
 		}
 
 		if (protoVersion < ZT_PROTO_VERSION_MIN) {
@@ -272,8 +313,8 @@ bool IncomingPacket::_doHELLO(const RuntimeEnvironment *RR,SharedPtr<Peer> &peer
 			} else {
 				// We don't already have an identity with this address -- validate and learn it
 
-				// Check identity proof of work
-				if (!id.locallyValidate()) {
+				// Check identity proof of work (cached across restarts for identities seen before)
+				if (!RR->idCache->validate(id,RR->node->now())) {
 					TRACE("dropped HELLO from %s(%s): identity invalid",id.address().toString().c_str(),_remoteAddress.toString().c_str());
 					return true;
 				}
@@ -343,12 +384,14 @@ bool IncomingPacket::_doHELLO(const RuntimeEnvironment *RR,SharedPtr<Peer> &peer
 		} else {
 			outp.append((uint16_t)0); // no world update needed
 		}
+		outp.append((uint16_t)Packet::supportedCipherSuites());
 
 		outp.armor(peer->key(),true);
 		RR->antiRec->logOutgoingZT(outp.data(),outp.size());
 		RR->node->putPacket(_localAddress,_remoteAddress,outp.data(),outp.size());
 
 		peer->setRemoteVersion(protoVersion,vMajor,vMinor,vRevision);
+		peer->setRemoteCipherSuites(cipherSuites);
 		peer->received(RR,_localAddress,_remoteAddress,hops(),pid,Packet::VERB_HELLO,0,Packet::VERB_NOP);
 	} catch ( ... ) {
 		TRACE("dropped HELLO from %s(%s): unexpected exception",source().toString().c_str(),_remoteAddress.toString().c_str());
@@ -384,20 +427,24 @@ bool IncomingPacket::_doOK(const RuntimeEnvironment *RR,const SharedPtr<Peer> &p
 				unsigned int ptr = ZT_PROTO_VERB_HELLO__OK__IDX_REVISION + 2;
 				if (ptr < size()) // ZeroTier One < 1.0.3 did not include this field
 					ptr += externalSurfaceAddress.deserialize(*this,ptr);
-				if ((trusted)&&((ptr + 2) <= size())) { // older versions also did not include this field, and right now we only use if from a root
-					World worldUpdate;
+				unsigned int cipherSuites = 0;
+				if ((ptr + 2) <= size()) { // older versions also did not include this field, and right now we only use if from a root
 					const unsigned int worldLen = at<uint16_t>(ptr); ptr += 2;
-					if (worldLen > 0) {
+					if ((trusted)&&(worldLen > 0)) {
 						World w;
 						w.deserialize(*this,ptr);
 						RR->topology->worldUpdateIfValid(w);
 					}
+					ptr += worldLen;
+					if ((ptr + 2) <= size()) // nor optional cipher suites
+						cipherSuites = at<uint16_t>(ptr);
 				}
 
 				TRACE("%s(%s): OK(HELLO), version %u.%u.%u, latency %u, reported external address %s",source().toString().c_str(),_remoteAddress.toString().c_str(),vMajor,vMinor,vRevision,latency,((externalSurfaceAddress) ? externalSurfaceAddress.toString().c_str() : "(none)"));
 
 				peer->addDirectLatencyMeasurment(latency);
 				peer->setRemoteVersion(vProto,vMajor,vMinor,vRevision);
+				peer->setRemoteCipherSuites(cipherSuites);
 
 				if (externalSurfaceAddress)
 					RR->sa->iam(peer->address(),_remoteAddress,externalSurfaceAddress,trusted,RR->node->now());
@@ -447,7 +494,8 @@ bool IncomingPacket::_doOK(const RuntimeEnvironment *RR,const SharedPtr<Peer> &p
 					// OK(MULTICAST_FRAME) includes certificate of membership update
 					CertificateOfMembership com;
 					offset += com.deserialize(*this,ZT_PROTO_VERB_MULTICAST_FRAME__OK__IDX_COM_AND_GATHER_RESULTS);
-					peer->validateAndSetNetworkMembershipCertificate(RR,nwid,com);
+					if ((RR->dpEnabled <= 0)||(com.networkId() != nwid)||(!RR->dp->enqueue(peer,com)))
+						peer->validateAndSetNetworkMembershipCertificate(RR,nwid,com);
 				}
 
 				if ((flags & 0x02) != 0) {
@@ -675,7 +723,9 @@ bool IncomingPacket::_doNETWORK_MEMBERSHIP_CERTIFICATE(const RuntimeEnvironment
 		unsigned int ptr = ZT_PACKET_IDX_PAYLOAD;
 		while (ptr < size()) {
 			ptr += com.deserialize(*this,ptr);
-			peer->validateAndSetNetworkMembershipCertificate(RR,com.networkId(),com);
+			// Nothing waits on these, so verify them in batches in the background if possible
+			if ((RR->dpEnabled <= 0)||(!RR->dp->enqueue(peer,com)))
+				peer->validateAndSetNetworkMembershipCertificate(RR,com.networkId(),com);
 		}
 
 		peer->received(RR,_localAddress,_remoteAddress,hops(),packetId(),Packet::VERB_NETWORK_MEMBERSHIP_CERTIFICATE,0,Packet::VERB_NOP);
@@ -984,6 +1034,7 @@ bool IncomingPacket::_doCIRCUIT_TEST(const RuntimeEnvironment *RR,const SharedPt
 		const Address originatorAddress(field(ZT_PACKET_IDX_PAYLOAD,ZT_ADDRESS_LENGTH),ZT_ADDRESS_LENGTH);
 		SharedPtr<Peer> originator(RR->topology->getPeer(originatorAddress));
 		if (!originator) {
+			_waitingFor = originatorAddress;
 			RR->sw->requestWhois(originatorAddress);
 			return false;
 		}
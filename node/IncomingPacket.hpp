@@ -37,6 +37,7 @@
 #include "AtomicCounter.hpp"
 #include "MulticastGroup.hpp"
 #include "Peer.hpp"
+#include "ObjectPool.hpp"
 
 /*
  * The big picture:
@@ -67,6 +68,12 @@ class IncomingPacket : public Packet
 	friend class SharedPtr<IncomingPacket>;
 
 public:
+	typedef ObjectPool<IncomingPacket,ZT_INCOMINGPACKET_POOL_SIZE> Pool;
+
+	// Storage is recycled through a per-thread pool when SharedPtr releases it
+	static inline void *operator new(size_t size) { return Pool::alloc(size); }
+	static inline void operator delete(void *p,size_t size) { Pool::free(p,size); }
+
 	/**
 	 * Create a new packet-in-decode
 	 *
@@ -80,8 +87,10 @@ public:
 	IncomingPacket(const void *data,unsigned int len,const InetAddress &localAddress,const InetAddress &remoteAddress,uint64_t now) :
  		Packet(data,len),
  		_receiveTime(now),
+ 		_waitingFor(),
  		_localAddress(localAddress),
  		_remoteAddress(remoteAddress),
+ 		_dearmored(false),
  		__refCount()
 	{
 	}
@@ -109,11 +118,30 @@ public:
 	 */
 	bool tryDecode(const RuntimeEnvironment *RR,bool deferred);
 
+	/**
+	 * Authenticate and decrypt several packets together ahead of tryDecode()
+	 *
+	 * Packets from known peers are dearmored with Packet::dearmorBatch() and
+	 * the next tryDecode() on each skips its own dearmor step. Packets that
+	 * can't be dearmored here (unknown peer, plaintext HELLO, bad MAC) are
+	 * left untouched and handled by tryDecode() as usual.
+	 *
+	 * @param RR Runtime environment
+	 * @param packets Packets that have not yet been passed to tryDecode()
+	 * @param count Number of packets
+	 */
+	static void dearmorBatch(const RuntimeEnvironment *RR,IncomingPacket *const *packets,unsigned int count);
+
 	/**
 	 * @return Time of packet receipt / start of decode
 	 */
 	inline uint64_t receiveTime() const throw() { return _receiveTime; }
 
+	/**
+	 * @return Address whose identity we were missing the last time tryDecode() returned false
+	 */
+	inline const Address &waitingFor() const throw() { return _waitingFor; }
+
 	/**
 	 * Compute the Salsa20/12+SHA512 proof of work function
 	 *
@@ -161,8 +189,10 @@ private:
 	void _sendErrorNeedCertificate(const RuntimeEnvironment *RR,const SharedPtr<Peer> &peer,uint64_t nwid);
 
 	uint64_t _receiveTime;
+	Address _waitingFor;
 	InetAddress _localAddress;
 	InetAddress _remoteAddress;
+	bool _dearmored; // set by dearmorBatch(), consumed by the next tryDecode()
 	AtomicCounter __refCount;
 };
 
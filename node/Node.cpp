@@ -43,11 +43,14 @@
 #include "Topology.hpp"
 #include "Buffer.hpp"
 #include "Packet.hpp"
+#include "IncomingPacket.hpp"
 #include "Address.hpp"
 #include "Identity.hpp"
 #include "SelfAwareness.hpp"
 #include "Cluster.hpp"
 #include "DeferredPackets.hpp"
+#include "VerifiedComCache.hpp"
+#include "ValidatedIdentityCache.hpp"
 
 const struct sockaddr_storage ZT_SOCKADDR_NULL = {0};
 
@@ -115,6 +118,9 @@ Node::Node(
 		RR->sw = new Switch(RR);
 		RR->mc = new Multicaster(RR);
 		RR->antiRec = new AntiRecursion();
+		RR->comCache = new VerifiedComCache();
+		RR->idCache = new ValidatedIdentityCache(RR->identity);
+		RR->idCache->deserialize(dataStoreGet("identities.validated"),now);
 		RR->topology = new Topology(RR);
 		RR->sa = new SelfAwareness(RR);
 		RR->dp = new DeferredPackets(RR);
@@ -122,6 +128,8 @@ Node::Node(
 		delete RR->dp;
 		delete RR->sa;
 		delete RR->topology;
+		delete RR->idCache;
+		delete RR->comCache;
 		delete RR->antiRec;
 		delete RR->mc;
 		delete RR->sw;
@@ -141,19 +149,28 @@ Node::~Node()
 	delete RR->dp;
 	delete RR->sa;
 	delete RR->topology;
+	if (RR->idCache->dirty()) {
+		try {
+			dataStorePut("identities.validated",RR->idCache->serialize(now()),true);
+		} catch ( ... ) {}
+	}
+	delete RR->idCache;
+	delete RR->comCache;
 	delete RR->antiRec;
 	delete RR->mc;
 	delete RR->sw;
 #ifdef ZT_ENABLE_CLUSTER
 	delete RR->cluster;
 #endif
+
+	IncomingPacket::Pool::drain();
 }
 
 ZT_ResultCode Node::processWirePacket(
 	uint64_t now,
 	const struct sockaddr_storage *localAddress,
 	const struct sockaddr_storage *remoteAddress,
-	const void *packetData,
+	void *packetData,
 	unsigned int packetLength,
 	volatile uint64_t *nextBackgroundTaskDeadline)
 {
@@ -162,6 +179,18 @@ ZT_ResultCode Node::processWirePacket(
 	return ZT_RESULT_OK;
 }
 
+void Node::setWirePacketStaging(bool enabled)
+{
+	RR->sw->setRxStaging(enabled);
+}
+
+ZT_ResultCode Node::flushWirePackets(uint64_t now,volatile uint64_t *nextBackgroundTaskDeadline)
+{
+	_now = now;
+	RR->sw->flushStagedPackets();
+	return ZT_RESULT_OK;
+}
+
 ZT_ResultCode Node::processVirtualNetworkFrame(
 	uint64_t now,
 	uint64_t nwid,
@@ -335,6 +364,8 @@ ZT_ResultCode Node::processBackgroundTasks(uint64_t now,volatile uint64_t *nextB
 			RR->topology->clean(now);
 			RR->sa->clean(now);
 			RR->mc->clean(now);
+			if (RR->idCache->shouldSave(now))
+				dataStorePut("identities.validated",RR->idCache->serialize(now),true);
 		} catch ( ... ) {
 			return ZT_RESULT_FATAL_ERROR_INTERNAL;
 		}
@@ -645,6 +676,21 @@ void Node::clusterStatus(ZT_ClusterStatus *cs)
 	memset(cs,0,sizeof(ZT_ClusterStatus));
 }
 
+void Node::verifiedComCacheStats(uint64_t &hits,uint64_t &misses,unsigned long &entries) const
+{
+	RR->comCache->stats(hits,misses,entries);
+}
+
+void Node::validatedIdentityCacheStats(uint64_t &hits,uint64_t &misses,unsigned long &entries) const
+{
+	RR->idCache->stats(hits,misses,entries);
+}
+
+void Node::pendingQueueStats(unsigned long &txPackets,unsigned long &txPeers,uint64_t &txOldest,unsigned long &rxPackets,unsigned long &rxPeers,uint64_t &rxOldest) const
+{
+	RR->sw->queueStats(now(),txPackets,txPeers,txOldest,rxPackets,rxPeers,rxOldest);
+}
+
 void Node::backgroundThreadMain()
 {
 	++RR->dpEnabled;
@@ -655,6 +701,7 @@ void Node::backgroundThreadMain()
 		} catch ( ... ) {} // sanity check -- should not throw
 	}
 	--RR->dpEnabled;
+	IncomingPacket::Pool::drain();
 }
 
 /****************************************************************************/
@@ -774,7 +821,7 @@ enum ZT_ResultCode ZT_Node_processWirePacket(
 	uint64_t now,
 	const struct sockaddr_storage *localAddress,
 	const struct sockaddr_storage *remoteAddress,
-	const void *packetData,
+	void *packetData,
 	unsigned int packetLength,
 	volatile uint64_t *nextBackgroundTaskDeadline)
 {
@@ -787,6 +834,24 @@ enum ZT_ResultCode ZT_Node_processWirePacket(
 	}
 }
 
+void ZT_Node_setWirePacketStaging(ZT_Node *node,int enabled)
+{
+	try {
+		reinterpret_cast<ZeroTier::Node *>(node)->setWirePacketStaging(enabled != 0);
+	} catch ( ... ) {}
+}
+
+enum ZT_ResultCode ZT_Node_flushWirePackets(ZT_Node *node,uint64_t now,volatile uint64_t *nextBackgroundTaskDeadline)
+{
+	try {
+		return reinterpret_cast<ZeroTier::Node *>(node)->flushWirePackets(now,nextBackgroundTaskDeadline);
+	} catch (std::bad_alloc &exc) {
+		return ZT_RESULT_FATAL_ERROR_OUT_OF_MEMORY;
+	} catch ( ... ) {
+		return ZT_RESULT_OK; // "OK" since invalid packets are simply dropped, but the system is still up
+	}
+}
+
 enum ZT_ResultCode ZT_Node_processVirtualNetworkFrame(
 	ZT_Node *node,
 	uint64_t now,
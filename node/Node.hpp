@@ -81,9 +81,11 @@ public:
 		uint64_t now,
 		const struct sockaddr_storage *localAddress,
 		const struct sockaddr_storage *remoteAddress,
-		const void *packetData,
+		void *packetData,
 		unsigned int packetLength,
 		volatile uint64_t *nextBackgroundTaskDeadline);
+	void setWirePacketStaging(bool enabled);
+	ZT_ResultCode flushWirePackets(uint64_t now,volatile uint64_t *nextBackgroundTaskDeadline);
 	ZT_ResultCode processVirtualNetworkFrame(
 		uint64_t now,
 		uint64_t nwid,
@@ -129,6 +131,36 @@ public:
 
 	// Internal functions ------------------------------------------------------
 
+	/**
+	 * Get verified certificate of membership cache statistics
+	 *
+	 * @param hits Result parameter: COM signature checks answered from cache
+	 * @param misses Result parameter: COM signature checks that needed Ed25519
+	 * @param entries Result parameter: cached COMs
+	 */
+	void verifiedComCacheStats(uint64_t &hits,uint64_t &misses,unsigned long &entries) const;
+
+	/**
+	 * Get validated identity cache statistics
+	 *
+	 * @param hits Result parameter: identity validations avoided
+	 * @param misses Result parameter: identity validations computed
+	 * @param entries Result parameter: identities known to be valid
+	 */
+	void validatedIdentityCacheStats(uint64_t &hits,uint64_t &misses,unsigned long &entries) const;
+
+	/**
+	 * Get depth and age of the queues of packets waiting on peer identities
+	 *
+	 * @param txPackets Result parameter: outgoing packets waiting to be sent
+	 * @param txPeers Result parameter: distinct destinations they're waiting on
+	 * @param txOldest Result parameter: age of oldest outgoing packet in ms (0 if none)
+	 * @param rxPackets Result parameter: incoming packets waiting to be decoded
+	 * @param rxPeers Result parameter: distinct identities they're waiting on
+	 * @param rxOldest Result parameter: age of oldest incoming packet in ms (0 if none)
+	 */
+	void pendingQueueStats(unsigned long &txPackets,unsigned long &txPeers,uint64_t &txOldest,unsigned long &rxPackets,unsigned long &rxPeers,uint64_t &rxOldest) const;
+
 	/**
 	 * Convenience threadMain() for easy background thread launch
 	 *
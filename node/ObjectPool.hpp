@@ -0,0 +1,209 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2015  ZeroTier, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * ZeroTier may be used and distributed under the terms of the GPLv3, which
+ * are available at: http://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * If you would like to embed ZeroTier into a commercial application or
+ * redistribute it in a modified binary form, please contact ZeroTier Networks
+ * LLC. Start here: http://www.zerotier.com/
+ */
+
+
+#ifndef ZT_OBJECTPOOL_HPP
+#define ZT_OBJECTPOOL_HPP
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <new>
+
+#include "Constants.hpp"
+#include "Mutex.hpp"
+
+#ifdef __UNIX_LIKE__
+#include <pthread.h>
+#endif
+
+namespace ZeroTier {
+
+/**
+ * Per-thread free list of storage for objects of type T
+ *
+ * A class opts in by defining class-scope operator new and operator delete
+ * that call alloc() and free(). Since SharedPtr<> releases objects with
+ * delete, storage goes back to the list of whichever thread drops the last
+ * reference. No locks are taken on the allocation path. Each thread keeps
+ * at most MAX_FREE spare blocks and returns anything beyond that to the heap.
+ *
+ * A thread's spare blocks are freed by drain(). On Unix-like systems this
+ * also happens automatically when a thread that has cached any exits.
+ * Elsewhere threads should call drain() before exiting.
+ *
+ * Hits and misses are counted per thread and folded into global totals
+ * every so often, so stats() may lag slightly behind.
+ *
+ * @tparam T Pooled type (allocations of any other size bypass the pool)
+ * @tparam MAX_FREE Maximum free blocks kept per thread
+ */
+template<typename T,unsigned int MAX_FREE>
+class ObjectPool
+{
+public:
+	static inline void *alloc(size_t size)
+	{
+		if (size == sizeof(T)) {
+			_List &l = _list;
+			if (l.head) {
+				_Free *const f = l.head;
+				l.head = f->next;
+				--l.count;
+				++l.hits;
+				if (++l.ops >= 1024)
+					_fold(l);
+				return (void *)f;
+			}
+			++l.misses;
+			if (++l.ops >= 1024)
+				_fold(l);
+		}
+		void *p = ::malloc((size > sizeof(_Free)) ? size : sizeof(_Free));
+		if (!p)
+			throw std::bad_alloc();
+		return p;
+	}
+
+	static inline void free(void *p,size_t size)
+		throw()
+	{
+		if (p) {
+			_List &l = _list;
+			if ((size == sizeof(T))&&(l.count < MAX_FREE)) {
+				_Free *const f = (_Free *)p;
+				f->next = l.head;
+				l.head = f;
+				++l.count;
+#ifdef __UNIX_LIKE__
+				if (!l.exitHook) {
+					pthread_once(&_exitKeyOnce,&_makeExitKey);
+					pthread_setspecific(_exitKey,(void *)&l);
+					l.exitHook = true;
+				}
+#endif
+			} else {
+				::free(p);
+			}
+		}
+	}
+
+	/**
+	 * Get node-wide pool statistics
+	 *
+	 * @param hits Set to allocations satisfied from a free list
+	 * @param misses Set to allocations that had to go to the heap
+	 */
+	static inline void stats(uint64_t &hits,uint64_t &misses)
+	{
+		Mutex::Lock _l(_stats_m);
+		hits = _hits;
+		misses = _misses;
+	}
+
+	/**
+	 * Fold this thread's counters into the global totals now
+	 */
+	static inline void flushStats()
+	{
+		_fold(_list);
+	}
+
+	/**
+	 * Return this thread's spare blocks to the heap and fold its counters
+	 */
+	static inline void drain()
+		throw()
+	{
+		_List &l = _list;
+		while (l.head) {
+			_Free *const f = l.head;
+			l.head = f->next;
+			::free(f);
+		}
+		l.count = 0;
+		_fold(l);
+	}
+
+private:
+	struct _Free
+	{
+		_Free *next;
+	};
+
+	// Must stay plain-old-data to be thread local
+	struct _List
+	{
+		_Free *head;
+		unsigned int count;
+		unsigned int ops;
+		uint64_t hits;
+		uint64_t misses;
+		bool exitHook; // true once _exitKey is set for this thread
+	};
+
+	static inline void _fold(_List &l)
+	{
+		Mutex::Lock _l(_stats_m);
+		_hits += l.hits;
+		_misses += l.misses;
+		l.hits = 0;
+		l.misses = 0;
+		l.ops = 0;
+	}
+
+#ifdef __UNIX_LIKE__
+	static void _makeExitKey() { pthread_key_create(&_exitKey,&ObjectPool::_onThreadExit); }
+	static void _onThreadExit(void *) { drain(); }
+	static pthread_once_t _exitKeyOnce;
+	static pthread_key_t _exitKey;
+#endif
+
+	static ZT_THREAD_LOCAL _List _list;
+	static Mutex _stats_m;
+	static uint64_t _hits;
+	static uint64_t _misses;
+};
+
+template<typename T,unsigned int MAX_FREE>
+ZT_THREAD_LOCAL typename ObjectPool<T,MAX_FREE>::_List ObjectPool<T,MAX_FREE>::_list;
+template<typename T,unsigned int MAX_FREE>
+Mutex ObjectPool<T,MAX_FREE>::_stats_m;
+template<typename T,unsigned int MAX_FREE>
+uint64_t ObjectPool<T,MAX_FREE>::_hits = 0;
+template<typename T,unsigned int MAX_FREE>
+uint64_t ObjectPool<T,MAX_FREE>::_misses = 0;
+#ifdef __UNIX_LIKE__
+template<typename T,unsigned int MAX_FREE>
+pthread_once_t ObjectPool<T,MAX_FREE>::_exitKeyOnce = PTHREAD_ONCE_INIT;
+template<typename T,unsigned int MAX_FREE>
+pthread_key_t ObjectPool<T,MAX_FREE>::_exitKey;
+#endif
+
+} // namespace ZeroTier
+
+#endif
@@ -26,6 +26,7 @@
  */
 
 #include "Packet.hpp"
+#include "AES.hpp"
 
 namespace ZeroTier {
 
@@ -80,7 +81,7 @@ const char *Packet::errorString(ErrorCode e)
 
 #endif // ZT_TRACE
 
-void Packet::armor(const void *key,bool encryptPayload)
+void Packet::armor(const void *key,bool encryptPayload,bool aesGcm)
 {
 	unsigned char mangledKey[32];
 	unsigned char macKey[32];
@@ -88,6 +89,19 @@ void Packet::armor(const void *key,bool encryptPayload)
 	const unsigned int payloadLen = size() - ZT_PACKET_IDX_VERB;
 	unsigned char *const payload = field(ZT_PACKET_IDX_VERB,payloadLen);
 
+	if ((encryptPayload)&&(aesGcm)) {
+		setCipher(ZT_PROTO_CIPHER_SUITE__C25519_AES256_GCM);
+		_salsa20MangleKey((const unsigned char *)key,mangledKey);
+		unsigned char iv[ZT_AES_GCM_IV_LEN];
+		memcpy(iv,field(ZT_PACKET_IDX_IV,8),8);
+		memset(iv + 8,0,4);
+		AES aes(mangledKey);
+		aes.gcmEncrypt(iv,(const void *)0,0,payload,payloadLen,mac);
+		memcpy(field(ZT_PACKET_IDX_MAC,8),mac,8);
+		Utils::burn(mangledKey,sizeof(mangledKey));
+		return;
+	}
+
 	// Set flag now, since it affects key mangle function
 	setCipher(encryptPayload ? ZT_PROTO_CIPHER_SUITE__C25519_POLY1305_SALSA2012 : ZT_PROTO_CIPHER_SUITE__C25519_POLY1305_NONE);
 
@@ -98,10 +112,19 @@ void Packet::armor(const void *key,bool encryptPayload)
 	// This is the same construction DJB's NaCl library uses
 	s20.encrypt12(ZERO_KEY,macKey,sizeof(macKey));
 
-	if (encryptPayload)
-		s20.encrypt12(payload,payload,payloadLen);
-
-	Poly1305::compute(mac,payload,payloadLen,macKey);
+	if (encryptPayload) {
+		// Encrypt and MAC each chunk while it is still in cache
+		Poly1305 p1305;
+		p1305.init(macKey);
+		for(unsigned int p=0;p<payloadLen;p+=ZT_PACKET_ARMOR_CHUNK_SIZE) {
+			const unsigned int n = ((payloadLen - p) < ZT_PACKET_ARMOR_CHUNK_SIZE) ? (payloadLen - p) : ZT_PACKET_ARMOR_CHUNK_SIZE;
+			s20.encrypt12(payload + p,payload + p,n);
+			p1305.update(payload + p,n);
+		}
+		p1305.finish(mac);
+	} else {
+		Poly1305::compute(mac,payload,payloadLen,macKey);
+	}
 	memcpy(field(ZT_PACKET_IDX_MAC,8),mac,8);
 }
 
@@ -119,6 +142,9 @@ bool Packet::dearmor(const void *key)
 		Salsa20 s20(mangledKey,256,field(ZT_PACKET_IDX_IV,8)/*,ZT_PROTO_SALSA20_ROUNDS*/);
 
 		s20.encrypt12(ZERO_KEY,macKey,sizeof(macKey));
+
+		// Check the MAC before decrypting anything, so forged or garbage
+		// packets cost one Poly1305 pass and the packet is left as it was
 		Poly1305::compute(mac,payload,payloadLen,macKey);
 		if (!Utils::secureEq(mac,field(ZT_PACKET_IDX_MAC,8),8))
 			return false;
@@ -127,9 +153,82 @@ bool Packet::dearmor(const void *key)
 			s20.decrypt12(payload,payload,payloadLen);
 
 		return true;
+	} else if (cs == ZT_PROTO_CIPHER_SUITE__C25519_AES256_GCM) {
+		// Decryption only happens if the tag checks out, so a failed
+		// dearmor() leaves the packet as it was here too.
+		_salsa20MangleKey((const unsigned char *)key,mangledKey);
+		unsigned char iv[ZT_AES_GCM_IV_LEN];
+		memcpy(iv,field(ZT_PACKET_IDX_IV,8),8);
+		memset(iv + 8,0,4);
+		AES aes(mangledKey);
+		Utils::burn(mangledKey,sizeof(mangledKey));
+		return aes.gcmDecrypt(iv,(const void *)0,0,payload,payloadLen,field(ZT_PACKET_IDX_MAC,8),8);
 	} else return false; // unrecognized cipher suite
 }
 
+unsigned int Packet::supportedCipherSuites()
+{
+	// The portable AES fallback is too slow (and not constant time) to be
+	// worth asking peers for, but dearmor() accepts AES-GCM regardless.
+	return ((AES::accel() != AES::ACCEL_NONE) ? ZT_PROTO_CIPHER_SUITE_SUPPORTED_AES256_GCM : 0);
+}
+
+void Packet::dearmorBatch(Packet *const *packets,const void *const *keys,bool *results,unsigned int count)
+{
+	unsigned char mangledKey[32];
+	unsigned char mac[16];
+	Salsa20 s20[ZT_PACKET_DEARMOR_BATCH_MAX];
+	Salsa20 *s20p[ZT_PACKET_DEARMOR_BATCH_MAX];
+	void *ksp[ZT_PACKET_DEARMOR_BATCH_MAX];
+	unsigned int blocks[ZT_PACKET_DEARMOR_BATCH_MAX];
+	unsigned int idx[ZT_PACKET_DEARMOR_BATCH_MAX];
+	unsigned char ks[ZT_PACKET_DEARMOR_BATCH_MAX][64 + ZT_PACKET_DEARMOR_BATCH_MAX_PAYLOAD];
+
+	unsigned int i = 0;
+	while (i < count) {
+		// Gather up to one batch of small packets, dearmoring anything else individually
+		unsigned int n = 0;
+		for(;(i<count)&&(n<ZT_PACKET_DEARMOR_BATCH_MAX);++i) {
+			Packet &pkt = *(packets[i]);
+			const unsigned int cs = pkt.cipher();
+			const unsigned int payloadLen = pkt.size() - ZT_PACKET_IDX_VERB;
+			if (((cs == ZT_PROTO_CIPHER_SUITE__C25519_POLY1305_NONE)||(cs == ZT_PROTO_CIPHER_SUITE__C25519_POLY1305_SALSA2012))&&(payloadLen <= ZT_PACKET_DEARMOR_BATCH_MAX_PAYLOAD)) {
+				pkt._salsa20MangleKey((const unsigned char *)keys[i],mangledKey);
+				s20[n].init(mangledKey,256,pkt.field(ZT_PACKET_IDX_IV,8));
+				s20p[n] = &(s20[n]);
+				ksp[n] = ks[n];
+				blocks[n] = 1 + ((cs == ZT_PROTO_CIPHER_SUITE__C25519_POLY1305_SALSA2012) ? ((payloadLen + 63) / 64) : 0);
+				idx[n++] = i;
+			} else {
+				results[i] = pkt.dearmor(keys[i]);
+			}
+		}
+		if (!n)
+			continue;
+
+		Salsa20::keystream12Multi(s20p,ksp,blocks,n);
+
+		// Block 0 of each key stream is the MAC key, the rest decrypts the payload
+		for(unsigned int l=0;l<n;++l) {
+			Packet &pkt = *(packets[idx[l]]);
+			const unsigned int payloadLen = pkt.size() - ZT_PACKET_IDX_VERB;
+			unsigned char *const payload = pkt.field(ZT_PACKET_IDX_VERB,payloadLen);
+			Poly1305::compute(mac,payload,payloadLen,ks[l]);
+			if (Utils::secureEq(mac,pkt.field(ZT_PACKET_IDX_MAC,8),8)) {
+				if (blocks[l] > 1) {
+					const unsigned char *const k = ks[l] + 64;
+					for(unsigned int b=0;b<payloadLen;++b)
+						payload[b] ^= k[b];
+				}
+				results[idx[l]] = true;
+			} else results[idx[l]] = false;
+			Utils::burn(ks[l],blocks[l] * 64);
+		}
+	}
+
+	Utils::burn(mangledKey,sizeof(mangledKey));
+}
+
 bool Packet::compress()
 {
 	unsigned char buf[ZT_PROTO_MAX_PACKET_LENGTH * 2];
@@ -101,6 +101,24 @@
  */
 #define ZT_PROTO_CIPHER_SUITE__C25519_POLY1305_SALSA2012 1
 
+/**
+ * Cipher suite: Curve25519/AES-256-GCM
+ *
+ * The payload is encrypted and authenticated with AES-256-GCM under a
+ * per-packet key mangled from the agreed key the same way as for Salsa20,
+ * with a nonce of the packet IV followed by four zero bytes. The GCM tag
+ * is truncated to 64 bits and stored in the MAC field. This is only used
+ * with peers that have advertised support for it in HELLO or OK(HELLO),
+ * and only by nodes that have hardware AES. Other nodes keep using the
+ * Salsa20/12 suite, which remains the default.
+ */
+#define ZT_PROTO_CIPHER_SUITE__C25519_AES256_GCM 2
+
+/**
+ * Cipher suite support bit advertised in HELLO and OK(HELLO) for AES-256-GCM
+ */
+#define ZT_PROTO_CIPHER_SUITE_SUPPORTED_AES256_GCM 0x0001
+
 /**
  * Cipher suite: PFS negotiated ephemeral cipher suite and authentication
  *
@@ -194,6 +212,31 @@
  */
 #define ZT_PROTO_SALSA20_ROUNDS 12
 
+/**
+ * Chunk size for the single-pass encrypt+MAC loop in armor()
+ *
+ * This must be a multiple of the 64-byte Salsa20 block size. It is one
+ * pass of the widest (16-block) Salsa20 kernel and small enough that each
+ * chunk is still in L1 cache when it is MACed. Smaller chunks measured
+ * slower since they split the vector kernels into narrower passes.
+ */
+#define ZT_PACKET_ARMOR_CHUNK_SIZE 1024
+
+/**
+ * Maximum number of packets dearmored together in one dearmorBatch() pass
+ *
+ * Larger batches are processed in groups of this many.
+ */
+#define ZT_PACKET_DEARMOR_BATCH_MAX 16
+
+/**
+ * Packets with payloads larger than this are dearmored individually
+ *
+ * Batching only pays off for small packets where per-packet Salsa20 setup
+ * dominates. Large packets already fill the wide vector kernels on their own.
+ */
+#define ZT_PACKET_DEARMOR_BATCH_MAX_PAYLOAD 512
+
 // Field indexes in packet header
 #define ZT_PACKET_IDX_IV 0
 #define ZT_PACKET_IDX_DEST 8
@@ -542,6 +585,7 @@ public:
 		 *   [<[...] destination address>]
 		 *   <[8] 64-bit world ID of current world>
 		 *   <[8] 64-bit timestamp of current world>
+		 *   [<[2] 16-bit bit mask of optional cipher suites supported>]
 		 *
 		 * This is the only message that ever must be sent in the clear, since it
 		 * is used to push an identity to a new peer.
@@ -568,6 +612,10 @@ public:
 		 *   [<[...] destination address>]
 		 *   <[2] 16-bit length of world update or 0 if none>
 		 *   [[...] world update]
+		 *   [<[2] 16-bit bit mask of optional cipher suites supported>]
+		 *
+		 * The optional cipher suite mask is absent in messages from older
+		 * peers, which is the same as zero (Salsa20/12 only).
 		 *
 		 * ERROR has no payload.
 		 */
@@ -1309,7 +1357,7 @@ public:
 		unsigned char &b = (*this)[ZT_PACKET_IDX_FLAGS];
 		b = (b & 0xc7) | (unsigned char)((c << 3) & 0x38); // bits: FFCCCHHH
 		// DEPRECATED "encrypted" flag -- used by pre-1.0.3 peers
-		if (c == ZT_PROTO_CIPHER_SUITE__C25519_POLY1305_SALSA2012)
+		if ((c == ZT_PROTO_CIPHER_SUITE__C25519_POLY1305_SALSA2012)||(c == ZT_PROTO_CIPHER_SUITE__C25519_AES256_GCM))
 			b |= ZT_PROTO_FLAG_ENCRYPTED;
 		else b &= (~ZT_PROTO_FLAG_ENCRYPTED);
 	}
@@ -1351,8 +1399,9 @@ public:
 	 *
 	 * @param key 32-byte key
 	 * @param encryptPayload If true, encrypt packet payload, else just MAC
+	 * @param aesGcm If true and encrypting, use AES-256-GCM instead of Salsa20/12 and Poly1305
 	 */
-	void armor(const void *key,bool encryptPayload);
+	void armor(const void *key,bool encryptPayload,bool aesGcm = false);
 
 	/**
 	 * Verify and (if encrypted) decrypt packet
@@ -1362,6 +1411,20 @@ public:
 	 */
 	bool dearmor(const void *key);
 
+	/**
+	 * Verify and (if encrypted) decrypt several packets under different keys
+	 *
+	 * This has the same result as calling dearmor() on each packet, but
+	 * generates the Salsa20 key streams of small packets together so that
+	 * each packet occupies one lane of the vector kernels.
+	 *
+	 * @param packets Packets to dearmor
+	 * @param keys 32-byte key for each packet
+	 * @param results Result of dearmor() for each packet
+	 * @param count Number of packets
+	 */
+	static void dearmorBatch(Packet *const *packets,const void *const *keys,bool *results,unsigned int count);
+
 	/**
 	 * Attempt to compress payload if not already (must be unencrypted)
 	 *
@@ -1384,6 +1447,11 @@ public:
 	 */
 	bool uncompress();
 
+	/**
+	 * @return Mask of optional cipher suites this node will accept and use (advertised in HELLO)
+	 */
+	static unsigned int supportedCipherSuites();
+
 private:
 	static const unsigned char ZERO_KEY[32];
 
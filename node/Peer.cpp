@@ -32,10 +32,12 @@
 #include "Node.hpp"
 #include "Switch.hpp"
 #include "Network.hpp"
+#include "VerifiedComCache.hpp"
 #include "AntiRecursion.hpp"
 #include "SelfAwareness.hpp"
 #include "Cluster.hpp"
 #include "Packet.hpp"
+#include "SHA512.hpp"
 
 #include <algorithm>
 
@@ -46,7 +48,7 @@ namespace ZeroTier {
 // Used to send varying values for NAT keepalive
 static uint32_t _natKeepaliveBuf = 0;
 
-Peer::Peer(const Identity &myIdentity,const Identity &peerIdentity)
+Peer::Peer(const Identity &myIdentity,const Identity &peerIdentity,const unsigned char *savedKey,const unsigned char *savedKeyCheck)
 	throw(std::runtime_error) :
 	_lastUsed(0),
 	_lastReceive(0),
@@ -61,6 +63,7 @@ Peer::Peer(const Identity &myIdentity,const Identity &peerIdentity)
 	_vMajor(0),
 	_vMinor(0),
 	_vRevision(0),
+	_aesGcm(false),
 	_id(peerIdentity),
 	_numPaths(0),
 	_latency(0),
@@ -68,8 +71,18 @@ Peer::Peer(const Identity &myIdentity,const Identity &peerIdentity)
 	_networkComs(4),
 	_lastPushedComs(4)
 {
+	for(unsigned int f=0;f<3;++f)
+		_bestPath[f] = 0; // expired, so the first lookup takes the locked path and publishes
+	if ((savedKey)&&(savedKeyCheck)) {
+		memcpy(_key,savedKey,ZT_PEER_SECRET_KEY_LENGTH);
+		_computeKeyCheck(myIdentity);
+		if (Utils::secureEq(_keyCheck,savedKeyCheck,8))
+			return;
+		// Saved under another identity or corrupt, so agree again
+	}
 	if (!myIdentity.agree(peerIdentity,_key,ZT_PEER_SECRET_KEY_LENGTH))
 		throw std::runtime_error("new peer identity key agreement failed");
+	_computeKeyCheck(myIdentity);
 }
 
 void Peer::received(
@@ -152,7 +165,14 @@ void Peer::received(
 			unsigned int np = _numPaths;
 			for(unsigned int p=0;p<np;++p) {
 				if ((_paths[p].address() == remoteAddr)&&(_paths[p].localAddress() == localAddr)) {
-					_paths[p].received(now);
+					if (_paths[p].active(now)) {
+						_paths[p].received(now);
+					} else {
+						// Path is coming back to life, so the published best paths may change
+						_beginPathUpdate();
+						_paths[p].received(now);
+						_endPathUpdate(now);
+					}
 #ifdef ZT_ENABLE_CLUSTER
 					_paths[p].setClusterSuboptimal(suboptimalPath);
 #endif
@@ -177,6 +197,7 @@ void Peer::received(
 						}
 					}
 					if (slot) {
+						_beginPathUpdate();
 						*slot = Path(localAddr,remoteAddr);
 						slot->received(now);
 #ifdef ZT_ENABLE_CLUSTER
@@ -184,6 +205,7 @@ void Peer::received(
 #endif
 						_numPaths = np;
 						pathIsConfirmed = true;
+						_endPathUpdate(now);
 						_sortPaths(now);
 					}
 
@@ -230,6 +252,7 @@ void Peer::sendHELLO(const RuntimeEnvironment *RR,const InetAddress &localAddr,c
 	atAddress.serialize(outp);
 	outp.append((uint64_t)RR->topology->worldId());
 	outp.append((uint64_t)RR->topology->worldTimestamp());
+	outp.append((uint16_t)Packet::supportedCipherSuites());
 
 	outp.armor(_key,false); // HELLO is sent in the clear
 	RR->antiRec->logOutgoingZT(outp.data(),outp.size());
@@ -351,6 +374,7 @@ void Peer::pushDirectPaths(const RuntimeEnvironment *RR,Path *path,uint64_t now,
 bool Peer::resetWithinScope(const RuntimeEnvironment *RR,InetAddress::IpScope scope,uint64_t now)
 {
 	Mutex::Lock _l(_lock);
+	_beginPathUpdate();
 	unsigned int np = _numPaths;
 	unsigned int x = 0;
 	unsigned int y = 0;
@@ -363,6 +387,7 @@ bool Peer::resetWithinScope(const RuntimeEnvironment *RR,InetAddress::IpScope sc
 		++x;
 	}
 	_numPaths = y;
+	_endPathUpdate(now);
 	_sortPaths(now);
 	return (y < np);
 }
@@ -400,7 +425,7 @@ bool Peer::networkMembershipCertificatesAgree(uint64_t nwid,const CertificateOfM
 	return false;
 }
 
-bool Peer::validateAndSetNetworkMembershipCertificate(const RuntimeEnvironment *RR,uint64_t nwid,const CertificateOfMembership &com)
+bool Peer::validateAndSetNetworkMembershipCertificate(const RuntimeEnvironment *RR,uint64_t nwid,const CertificateOfMembership &com,bool signatureVerified)
 {
 	// Sanity checks
 	if ((!com)||(com.issuedTo() != _id.address()))
@@ -424,7 +449,7 @@ bool Peer::validateAndSetNetworkMembershipCertificate(const RuntimeEnvironment *
 
 		// We are the controller: RR->identity.address() == controller() == cert.signedBy()
 		// So, verify that we signed th cert ourself
-		if (!com.verify(RR->identity)) {
+		if ((!signatureVerified)&&(!RR->comCache->verify(com,RR->identity))) {
 			TRACE("rejected network membership certificate for %.16llx self signed by %s: signature check failed",(unsigned long long)_id,com.signedBy().toString().c_str());
 			return false; // invalid signature
 		}
@@ -440,7 +465,7 @@ bool Peer::validateAndSetNetworkMembershipCertificate(const RuntimeEnvironment *
 			return false; // signer unknown
 		}
 
-		if (!com.verify(signer->identity())) {
+		if ((!signatureVerified)&&(!RR->comCache->verify(com,signer->identity()))) {
 			TRACE("rejected network membership certificate for %.16llx signed by %s: signature check failed",(unsigned long long)_id,com.signedBy().toString().c_str());
 			return false; // invalid signature
 		}
@@ -470,6 +495,7 @@ void Peer::clean(const RuntimeEnvironment *RR,uint64_t now)
 	Mutex::Lock _l(_lock);
 
 	{
+		_beginPathUpdate();
 		unsigned int np = _numPaths;
 		unsigned int x = 0;
 		unsigned int y = 0;
@@ -479,6 +505,7 @@ void Peer::clean(const RuntimeEnvironment *RR,uint64_t now)
 			++x;
 		}
 		_numPaths = y;
+		_endPathUpdate(now);
 	}
 
 	{
@@ -519,11 +546,24 @@ struct _SortPathsByQuality
 		return (qb < qa); // invert sense to sort in descending order
 	}
 };
+void Peer::_computeKeyCheck(const Identity &myIdentity)
+{
+	unsigned char tmp[(ZT_C25519_PUBLIC_KEY_LEN * 2) + ZT_PEER_SECRET_KEY_LENGTH],h[64];
+	memcpy(tmp,myIdentity.publicKey().data,ZT_C25519_PUBLIC_KEY_LEN);
+	memcpy(tmp + ZT_C25519_PUBLIC_KEY_LEN,_id.publicKey().data,ZT_C25519_PUBLIC_KEY_LEN);
+	memcpy(tmp + (ZT_C25519_PUBLIC_KEY_LEN * 2),_key,ZT_PEER_SECRET_KEY_LENGTH);
+	SHA512::hash(h,tmp,sizeof(tmp));
+	memcpy(_keyCheck,h,8);
+	Utils::burn(tmp,sizeof(tmp));
+}
+
 void Peer::_sortPaths(const uint64_t now)
 {
 	// assumes _lock is locked
+	_beginPathUpdate();
 	_lastPathSort = now;
 	std::sort(&(_paths[0]),&(_paths[_numPaths]),_SortPathsByQuality(now));
+	_endPathUpdate(now);
 }
 
 Path *Peer::_getBestPath(const uint64_t now)
@@ -556,4 +596,32 @@ Path *Peer::_getBestPath(const uint64_t now,int inetAddressFamily)
 	return (Path *)0;
 }
 
+void Peer::_publishBestPaths(const uint64_t now)
+{
+	// assumes _lock is locked
+#ifdef ZT_PEER_LOCKLESS_PATHS
+	const uint64_t sortDue = _lastPathSort + ZT_PEER_PATH_SORT_INTERVAL;
+	const int families[3] = { 0,AF_INET,AF_INET6 };
+	for(unsigned int f=0;f<3;++f) {
+		unsigned int best = 0;
+		uint64_t expires = sortDue;
+		for(unsigned int i=0;i<_numPaths;++i) {
+			if ((_paths[i].active(now))&&((!f)||((int)_paths[i].address().ss_family == families[f]))) {
+				if ((!f)&&(i)) {
+					// _getBestPath() would re-sort here, so send readers to it
+					expires = 0;
+				} else {
+					best = i + 1;
+					const uint64_t inactiveAt = _paths[i].lastReceived() + ZT_PEER_ACTIVITY_TIMEOUT;
+					if (inactiveAt < expires)
+						expires = inactiveAt;
+				}
+				break;
+			}
+		}
+		_storeBestPath(f,(expires << 8) | (uint64_t)best);
+	}
+#endif
+}
+
 } // namespace ZeroTier
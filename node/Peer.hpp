@@ -57,6 +57,12 @@
 // 1048576 provides tons of headroom -- overflow would just cause peer not to be persisted
 #define ZT_PEER_SUGGESTED_SERIALIZATION_BUFFER_SIZE 1048576
 
+// Where GCC-style atomic builtins exist, the best path is published as an
+// atomically updated snapshot that the send path reads without taking _lock
+#ifdef __GNUC__
+#define ZT_PEER_LOCKLESS_PATHS 1
+#endif
+
 namespace ZeroTier {
 
 /**
@@ -75,11 +81,16 @@ public:
 	/**
 	 * Construct a new peer
 	 *
+	 * If a saved key is supplied and its check matches this node's identity
+	 * it is used as-is, skipping key agreement.
+	 *
 	 * @param myIdentity Identity of THIS node (for key agreement)
 	 * @param peerIdentity Identity of peer
+	 * @param savedKey Previously agreed key or NULL (ZT_PEER_SECRET_KEY_LENGTH bytes)
+	 * @param savedKeyCheck Key check saved with savedKey or NULL (8 bytes)
 	 * @throws std::runtime_error Key agreement with peer's identity failed
 	 */
-	Peer(const Identity &myIdentity,const Identity &peerIdentity)
+	Peer(const Identity &myIdentity,const Identity &peerIdentity,const unsigned char *savedKey = (const unsigned char *)0,const unsigned char *savedKeyCheck = (const unsigned char *)0)
 		throw(std::runtime_error);
 
 	/**
@@ -137,8 +148,35 @@ public:
 	 */
 	inline Path *getBestPath(uint64_t now)
 	{
+#ifdef ZT_PEER_LOCKLESS_PATHS
+		Path *p;
+		if (_readBestPath(now,0,p))
+			return p;
+#endif
 		Mutex::Lock _l(_lock);
-		return _getBestPath(now);
+		Path *const bp = _getBestPath(now);
+		_refreshBestPaths(now);
+		return bp;
+	}
+
+	/**
+	 * Get the current best direct path to this peer in one address family
+	 *
+	 * @param now Current time
+	 * @param inetAddressFamily AF_INET or AF_INET6
+	 * @return Best path or NULL if there are no active direct paths of this family
+	 */
+	inline Path *getBestPath(uint64_t now,int inetAddressFamily)
+	{
+#ifdef ZT_PEER_LOCKLESS_PATHS
+		Path *p;
+		if (_readBestPath(now,(inetAddressFamily == AF_INET) ? 1 : ((inetAddressFamily == AF_INET6) ? 2 : 3),p))
+			return p;
+#endif
+		Mutex::Lock _l(_lock);
+		Path *const bp = _getBestPath(now,inetAddressFamily);
+		_refreshBestPaths(now);
+		return bp;
 	}
 
 	/**
@@ -344,6 +382,21 @@ public:
 	inline unsigned int remoteVersionRevision() const throw() { return _vRevision; }
 	inline bool remoteVersionKnown() const throw() { return ((_vMajor > 0)||(_vMinor > 0)||(_vRevision > 0)); }
 
+	/**
+	 * Record the optional cipher suites advertised by this peer in HELLO or OK(HELLO)
+	 *
+	 * @param suites Bit mask of ZT_PROTO_CIPHER_SUITE_SUPPORTED_* values (0 if not sent)
+	 */
+	inline void setRemoteCipherSuites(unsigned int suites)
+	{
+		_aesGcm = ((suites & Packet::supportedCipherSuites() & ZT_PROTO_CIPHER_SUITE_SUPPORTED_AES256_GCM) != 0);
+	}
+
+	/**
+	 * @return True if encrypted packets to this peer should use AES-256-GCM
+	 */
+	inline bool aesGcm() const throw() { return _aesGcm; }
+
 	/**
 	 * Get most recently active path addresses for IPv4 and/or IPv6
 	 *
@@ -371,8 +424,9 @@ public:
 	 * @param RR Runtime Environment
 	 * @param nwid Network ID
 	 * @param com Externally supplied COM
+	 * @param signatureVerified If true, COM's signature has already been checked (e.g. by a batch verify)
 	 */
-	bool validateAndSetNetworkMembershipCertificate(const RuntimeEnvironment *RR,uint64_t nwid,const CertificateOfMembership &com);
+	bool validateAndSetNetworkMembershipCertificate(const RuntimeEnvironment *RR,uint64_t nwid,const CertificateOfMembership &com,bool signatureVerified = false);
 
 	/**
 	 * @param nwid Network ID
@@ -392,9 +446,10 @@ public:
 	 *
 	 * @param addr Remote address to remove
 	 */
-	inline void removePathByAddress(const InetAddress &addr)
+	inline void removePathByAddress(const InetAddress &addr,uint64_t now)
 	{
 		Mutex::Lock _l(_lock);
+		_beginPathUpdate();
 		unsigned int np = _numPaths;
 		unsigned int x = 0;
 		unsigned int y = 0;
@@ -404,6 +459,7 @@ public:
 			++x;
 		}
 		_numPaths = y;
+		_endPathUpdate(now);
 	}
 
 	/**
@@ -455,10 +511,16 @@ public:
 		const unsigned int recSizePos = b.size();
 		b.addSize(4); // space for uint32_t field length
 
-		b.append((uint16_t)0); // version of serialized Peer data
+		b.append((uint16_t)1); // version of serialized Peer data
 
 		_id.serialize(b,false);
 
+		// The agreed key is saved so restores can skip C25519 agreement. It is
+		// tagged with a digest of both public keys so that a key saved under
+		// a different local identity is never used.
+		b.append(_key,ZT_PEER_SECRET_KEY_LENGTH);
+		b.append(_keyCheck,8);
+
 		b.append((uint64_t)_lastUsed);
 		b.append((uint64_t)_lastReceive);
 		b.append((uint64_t)_lastUnicastFrame);
@@ -519,7 +581,8 @@ public:
 		const unsigned int recSize = b.template at<uint32_t>(p); p += 4;
 		if ((p + recSize) > b.size())
 			return SharedPtr<Peer>(); // size invalid
-		if (b.template at<uint16_t>(p) != 0)
+		const unsigned int version = b.template at<uint16_t>(p);
+		if (version > 1)
 			return SharedPtr<Peer>(); // version mismatch
 		p += 2;
 
@@ -528,7 +591,14 @@ public:
 		if (!npid)
 			return SharedPtr<Peer>();
 
-		SharedPtr<Peer> np(new Peer(myIdentity,npid));
+		SharedPtr<Peer> np;
+		if (version >= 1) {
+			const unsigned char *const savedKey = (const unsigned char *)b.field(p,ZT_PEER_SECRET_KEY_LENGTH); p += ZT_PEER_SECRET_KEY_LENGTH;
+			const unsigned char *const savedKeyCheck = (const unsigned char *)b.field(p,8); p += 8;
+			np = new Peer(myIdentity,npid,savedKey,savedKeyCheck);
+		} else {
+			np = new Peer(myIdentity,npid); // version 0 records have no key
+		}
 
 		np->_lastUsed = b.template at<uint64_t>(p); p += 8;
 		np->_lastReceive = b.template at<uint64_t>(p); p += 8;
@@ -575,11 +645,56 @@ public:
 	}
 
 private:
+	void _computeKeyCheck(const Identity &myIdentity);
+
 	void _sortPaths(const uint64_t now);
 	Path *_getBestPath(const uint64_t now);
 	Path *_getBestPath(const uint64_t now,int inetAddressFamily);
+	void _publishBestPaths(const uint64_t now);
+
+	// Writers hold _lock and bracket any change to _paths[] or _numPaths with these
+	inline void _beginPathUpdate()
+	{
+#ifdef ZT_PEER_LOCKLESS_PATHS
+		for(unsigned int f=0;f<3;++f)
+			_storeBestPath(f,0); // expired, so readers wait on _lock until _endPathUpdate()
+#endif
+	}
+	inline void _endPathUpdate(const uint64_t now) { _publishBestPaths(now); }
+
+	// Republish after a locked lookup so the next one can skip _lock again
+	inline void _refreshBestPaths(const uint64_t now) { _publishBestPaths(now); }
+
+#ifdef ZT_PEER_LOCKLESS_PATHS
+	/* Each snapshot entry is one 64-bit word, (expiry time << 8) | (slot + 1),
+	 * so it is read and written whole with the same __sync builtins as
+	 * AtomicCounter (which also act as full barriers) and can't be torn.
+	 * Readers never look inside _paths[]; they get back the same slot pointer
+	 * a locked getBestPath() would have returned, with the same caveat that
+	 * it may change after the call. */
+	inline void _storeBestPath(const unsigned int f,const uint64_t v)
+	{
+		uint64_t o = _bestPath[f];
+		while (!__sync_bool_compare_and_swap(&(_bestPath[f]),o,v))
+			o = _bestPath[f];
+	}
 
-	unsigned char _key[ZT_PEER_SECRET_KEY_LENGTH]; // computed with key agreement, not serialized
+	// Read snapshot entry f (0: any, 1: IPv4, 2: IPv6); false means take _lock and ask again
+	inline bool _readBestPath(const uint64_t now,const unsigned int f,Path *&p) const
+	{
+		if (f > 2)
+			return false;
+		const uint64_t s = __sync_or_and_fetch(const_cast<uint64_t *>(&(_bestPath[f])),0);
+		if (now >= (s >> 8))
+			return false;
+		const unsigned int bp = (unsigned int)(s & 0xff);
+		p = (bp) ? const_cast<Path *>(&(_paths[bp - 1])) : (Path *)0;
+		return true;
+	}
+#endif
+
+	unsigned char _key[ZT_PEER_SECRET_KEY_LENGTH]; // computed with key agreement, or restored from a saved record
+	unsigned char _keyCheck[8]; // binds _key to both identities' public keys in saved records
 
 	uint64_t _lastUsed;
 	uint64_t _lastReceive; // direct or indirect
@@ -594,9 +709,14 @@ private:
 	uint16_t _vMajor;
 	uint16_t _vMinor;
 	uint16_t _vRevision;
+	bool _aesGcm; // both sides support and have hardware for AES-256-GCM
 	Identity _id;
 	Path _paths[ZT_MAX_PEER_NETWORK_PATHS];
 	unsigned int _numPaths;
+
+	// Best path snapshot for any family, IPv4 and IPv6 (see _storeBestPath())
+	uint64_t _bestPath[3];
+
 	unsigned int _latency;
 	unsigned int _directPathPushCutoffCount;
 
@@ -132,7 +132,7 @@ namespace {
 
 typedef struct poly1305_context {
   size_t aligner;
-  unsigned char opaque[136];
+  unsigned char opaque[344];
 } poly1305_context;
 
 #if (defined(_MSC_VER) || defined(__GNUC__)) && (defined(__amd64) || defined(__amd64__) || defined(__x86_64) || defined(__x86_64__) || defined(__AMD64) || defined(__AMD64__))
@@ -140,6 +140,13 @@ typedef struct poly1305_context {
 //////////////////////////////////////////////////////////////////////////////
 // 128-bit implementation for MSC and GCC from Poly1305-donna
 
+// AVX2 kernel is built with a per-function target attribute and chosen at runtime
+#if (!defined(ZT_POLY1305_NO_AVX2)) && (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ >= 6)))
+  #define ZT_POLY1305_AVX2 1
+  #define ZT_POLY1305_AVX2_MIN_BYTES 256
+  #include <immintrin.h>
+#endif
+
 #if defined(_MSC_VER)
   #include <intrin.h>
 
@@ -173,7 +180,7 @@ typedef struct poly1305_context {
 
 #define poly1305_block_size 16
 
-/* 17 + sizeof(size_t) + 8*sizeof(unsigned long long) */
+/* 19 + sizeof(size_t) + 28*sizeof(unsigned long long) + 80 */
 typedef struct poly1305_state_internal_t {
   unsigned long long r[3];
   unsigned long long h[3];
@@ -181,6 +188,10 @@ typedef struct poly1305_state_internal_t {
   size_t leftover;
   unsigned char buffer[poly1305_block_size];
   unsigned char final;
+  unsigned char rpow_ready;
+  unsigned char lanes_active;
+  unsigned int rpow[4][5]; /* r^1 .. r^4 in radix 2^26 for the AVX2 kernel */
+  unsigned long long lanes[5][4]; /* AVX2 kernel accumulators between updates */
 } poly1305_state_internal_t;
 
 /* interpret eight 8 bit unsigned integers as a 64 bit unsigned integer in little endian */
@@ -210,6 +221,183 @@ U64TO8(unsigned char *p, unsigned long long v) {
   p[7] = (v >> 56) & 0xff;
 }
 
+#ifdef ZT_POLY1305_AVX2
+
+//////////////////////////////////////////////////////////////////////////////
+// AVX2 four-way kernel: 26-bit limbs in 64-bit lanes, lane j accumulating
+// blocks j, j+4, j+8, ... by Horner's rule in r^4. The lanes stay in the
+// state across updates so incremental callers pay no per-call setup. Before
+// any scalar blocks or the final tag they are collapsed by multiplying with
+// r^4, r^3, r^2, r and summing, which gives back the radix 2^44 h above.
+
+static int
+poly1305_detect_accel(void) {
+  __builtin_cpu_init();
+  return (__builtin_cpu_supports("avx2")) ? 1 : 0;
+}
+static const int poly1305_accel_supported = poly1305_detect_accel();
+static int poly1305_accel = poly1305_accel_supported;
+
+/* a *= b mod p, radix 2^44, partially reduced */
+static inline void
+poly1305_mul44(unsigned long long a[3], const unsigned long long b[3]) {
+  const unsigned long long s1 = b[1] * (5 << 2), s2 = b[2] * (5 << 2);
+  unsigned long long c;
+  uint128_t d0,d1,d2,d;
+  MUL(d0, a[0], b[0]); MUL(d, a[1], s2); ADD(d0, d); MUL(d, a[2], s1); ADD(d0, d);
+  MUL(d1, a[0], b[1]); MUL(d, a[1], b[0]); ADD(d1, d); MUL(d, a[2], s2); ADD(d1, d);
+  MUL(d2, a[0], b[2]); MUL(d, a[1], b[1]); ADD(d2, d); MUL(d, a[2], b[0]); ADD(d2, d);
+                c = SHR(d0, 44); a[0] = LO(d0) & 0xfffffffffff;
+  ADDLO(d1, c); c = SHR(d1, 44); a[1] = LO(d1) & 0xfffffffffff;
+  ADDLO(d2, c); c = SHR(d2, 42); a[2] = LO(d2) & 0x3ffffffffff;
+  a[0] += c * 5; c = (a[0] >> 44); a[0] &= 0xfffffffffff;
+  a[1] += c;
+}
+
+/* radix 2^44 (partially reduced) to radix 2^26 */
+static inline void
+poly1305_44to26(const unsigned long long h[3], unsigned long long l[5]) {
+  unsigned long long h0 = h[0], h1 = h[1], h2 = h[2], c;
+               c = (h1 >> 44); h1 &= 0xfffffffffff;
+  h2 += c;     c = (h2 >> 42); h2 &= 0x3ffffffffff;
+  h0 += c * 5; c = (h0 >> 44); h0 &= 0xfffffffffff;
+  h1 += c;     c = (h1 >> 44); h1 &= 0xfffffffffff;
+  h2 += c;
+  l[0] = ( h0                    ) & 0x3ffffff;
+  l[1] = ((h0 >> 26) | (h1 << 18)) & 0x3ffffff;
+  l[2] = ( h1 >>  8              ) & 0x3ffffff;
+  l[3] = ((h1 >> 34) | (h2 << 10)) & 0x3ffffff;
+  l[4] = ( h2 >> 16              );
+}
+
+/* h *= r mod p for four lanes, with s = 5 * r */
+#define POLY1305_AVX2_MUL(h, r, s) { \
+  const __m256i d0 = _mm256_add_epi64(_mm256_add_epi64(_mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[0], r[0]), _mm256_mul_epu32(h[1], s[4])), _mm256_mul_epu32(h[2], s[3])), _mm256_mul_epu32(h[3], s[2])), _mm256_mul_epu32(h[4], s[1])); \
+  __m256i d1 = _mm256_add_epi64(_mm256_add_epi64(_mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[0], r[1]), _mm256_mul_epu32(h[1], r[0])), _mm256_mul_epu32(h[2], s[4])), _mm256_mul_epu32(h[3], s[3])), _mm256_mul_epu32(h[4], s[2])); \
+  __m256i d2 = _mm256_add_epi64(_mm256_add_epi64(_mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[0], r[2]), _mm256_mul_epu32(h[1], r[1])), _mm256_mul_epu32(h[2], r[0])), _mm256_mul_epu32(h[3], s[4])), _mm256_mul_epu32(h[4], s[3])); \
+  __m256i d3 = _mm256_add_epi64(_mm256_add_epi64(_mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[0], r[3]), _mm256_mul_epu32(h[1], r[2])), _mm256_mul_epu32(h[2], r[1])), _mm256_mul_epu32(h[3], r[0])), _mm256_mul_epu32(h[4], s[4])); \
+  __m256i d4 = _mm256_add_epi64(_mm256_add_epi64(_mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[0], r[4]), _mm256_mul_epu32(h[1], r[3])), _mm256_mul_epu32(h[2], r[2])), _mm256_mul_epu32(h[3], r[1])), _mm256_mul_epu32(h[4], r[0])); \
+  __m256i c; \
+                                  c = _mm256_srli_epi64(d0, 26); h[0] = _mm256_and_si256(d0, mask26); \
+  d1 = _mm256_add_epi64(d1, c);   c = _mm256_srli_epi64(d1, 26); h[1] = _mm256_and_si256(d1, mask26); \
+  d2 = _mm256_add_epi64(d2, c);   c = _mm256_srli_epi64(d2, 26); h[2] = _mm256_and_si256(d2, mask26); \
+  d3 = _mm256_add_epi64(d3, c);   c = _mm256_srli_epi64(d3, 26); h[3] = _mm256_and_si256(d3, mask26); \
+  d4 = _mm256_add_epi64(d4, c);   c = _mm256_srli_epi64(d4, 26); h[4] = _mm256_and_si256(d4, mask26); \
+  h[0] = _mm256_add_epi64(h[0], _mm256_add_epi64(c, _mm256_slli_epi64(c, 2))); \
+  c = _mm256_srli_epi64(h[0], 26); h[0] = _mm256_and_si256(h[0], mask26); \
+  h[1] = _mm256_add_epi64(h[1], c); \
+}
+
+/* h += next four blocks, one per lane */
+#define POLY1305_AVX2_ADD_BLOCKS(h, m) { \
+  const __m256i a = _mm256_loadu_si256((const __m256i *)(m)); \
+  const __m256i b = _mm256_loadu_si256((const __m256i *)((m) + 32)); \
+  const __m256i lo = _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(a, b), 0xd8); \
+  const __m256i hi = _mm256_permute4x64_epi64(_mm256_unpackhi_epi64(a, b), 0xd8); \
+  h[0] = _mm256_add_epi64(h[0], _mm256_and_si256(lo, mask26)); \
+  h[1] = _mm256_add_epi64(h[1], _mm256_and_si256(_mm256_srli_epi64(lo, 26), mask26)); \
+  h[2] = _mm256_add_epi64(h[2], _mm256_and_si256(_mm256_or_si256(_mm256_srli_epi64(lo, 52), _mm256_slli_epi64(hi, 12)), mask26)); \
+  h[3] = _mm256_add_epi64(h[3], _mm256_and_si256(_mm256_srli_epi64(hi, 14), mask26)); \
+  h[4] = _mm256_add_epi64(h[4], _mm256_or_si256(_mm256_srli_epi64(hi, 40), hibit)); \
+}
+
+__attribute__((target("avx2")))
+static void
+poly1305_rpow_avx2(poly1305_state_internal_t *st) {
+  unsigned long long rp[3],rl[5];
+  unsigned int i,k;
+  for (i = 0; i < 3; i++)
+    rp[i] = st->r[i];
+  for (k = 0; k < 4; k++) {
+    if (k)
+      poly1305_mul44(rp, st->r);
+    poly1305_44to26(rp, rl);
+    for (i = 0; i < 5; i++)
+      st->rpow[k][i] = (unsigned int)rl[i];
+  }
+  st->rpow_ready = 1;
+}
+
+/* bytes must be a nonzero multiple of 64 and this must not be the final block */
+__attribute__((target("avx2")))
+static void
+poly1305_blocks_avx2(poly1305_state_internal_t *st, const unsigned char *m, size_t bytes) {
+  const __m256i mask26 = _mm256_set1_epi64x(0x3ffffff);
+  const __m256i hibit = _mm256_set1_epi64x(1 << 24); /* 1 << 128 */
+  __m256i h[5],r[5],s[5];
+  unsigned int i;
+
+  if (!st->rpow_ready)
+    poly1305_rpow_avx2(st);
+  for (i = 0; i < 5; i++) {
+    r[i] = _mm256_set1_epi64x((long long)st->rpow[3][i]);
+    s[i] = _mm256_set1_epi64x((long long)st->rpow[3][i] * 5);
+  }
+
+  if (st->lanes_active) {
+    for (i = 0; i < 5; i++)
+      h[i] = _mm256_loadu_si256((const __m256i *)st->lanes[i]);
+  } else {
+    /* scalar h joins the first block in lane 0 */
+    unsigned long long hl[5];
+    poly1305_44to26(st->h, hl);
+    for (i = 0; i < 5; i++)
+      h[i] = _mm256_set_epi64x(0, 0, 0, (long long)hl[i]);
+    POLY1305_AVX2_ADD_BLOCKS(h, m)
+    m += 64;
+    bytes -= 64;
+    st->lanes_active = 1;
+  }
+
+  while (bytes) {
+    POLY1305_AVX2_MUL(h, r, s)
+    POLY1305_AVX2_ADD_BLOCKS(h, m)
+    m += 64;
+    bytes -= 64;
+  }
+
+  for (i = 0; i < 5; i++)
+    _mm256_storeu_si256((__m256i *)st->lanes[i], h[i]);
+}
+
+/* h = sum of lane j * r^(4-j), back in radix 2^44 */
+__attribute__((target("avx2")))
+static void
+poly1305_collapse_avx2(poly1305_state_internal_t *st) {
+  const __m256i mask26 = _mm256_set1_epi64x(0x3ffffff);
+  unsigned long long hl[5],t[4],c;
+  __m256i h[5],r[5],s[5];
+  unsigned int i;
+
+  for (i = 0; i < 5; i++) {
+    h[i] = _mm256_loadu_si256((const __m256i *)st->lanes[i]);
+    r[i] = _mm256_set_epi64x((long long)st->rpow[0][i], (long long)st->rpow[1][i], (long long)st->rpow[2][i], (long long)st->rpow[3][i]);
+    s[i] = _mm256_set_epi64x((long long)st->rpow[0][i] * 5, (long long)st->rpow[1][i] * 5, (long long)st->rpow[2][i] * 5, (long long)st->rpow[3][i] * 5);
+  }
+  POLY1305_AVX2_MUL(h, r, s)
+
+  for (i = 0; i < 5; i++) {
+    _mm256_storeu_si256((__m256i *)t, h[i]);
+    hl[i] = t[0] + t[1] + t[2] + t[3];
+  }
+                  c = hl[0] >> 26; hl[0] &= 0x3ffffff;
+  hl[1] += c;     c = hl[1] >> 26; hl[1] &= 0x3ffffff;
+  hl[2] += c;     c = hl[2] >> 26; hl[2] &= 0x3ffffff;
+  hl[3] += c;     c = hl[3] >> 26; hl[3] &= 0x3ffffff;
+  hl[4] += c;     c = hl[4] >> 26; hl[4] &= 0x3ffffff;
+  hl[0] += c * 5; c = hl[0] >> 26; hl[0] &= 0x3ffffff;
+  hl[1] += c;
+  st->h[0] = hl[0] | ((hl[1] & 0x3ffff) << 26);
+  st->h[1] = (hl[1] >> 18) + (hl[2] << 8) + ((hl[3] & 0x3ff) << 34);
+  st->h[2] = (hl[3] >> 10) + (hl[4] << 16);
+  st->lanes_active = 0;
+}
+
+#undef POLY1305_AVX2_MUL
+#undef POLY1305_AVX2_ADD_BLOCKS
+
+#endif // ZT_POLY1305_AVX2
+
 static inline void
 poly1305_init(poly1305_context *ctx, const unsigned char key[32]) {
   poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
@@ -234,6 +422,8 @@ poly1305_init(poly1305_context *ctx, const unsigned char key[32]) {
 
   st->leftover = 0;
   st->final = 0;
+  st->rpow_ready = 0;
+  st->lanes_active = 0;
 }
 
 static inline void
@@ -245,6 +435,20 @@ poly1305_blocks(poly1305_state_internal_t *st, const unsigned char *m, size_t by
   unsigned long long c;
   uint128_t d0,d1,d2,d;
 
+#ifdef ZT_POLY1305_AVX2
+  /* once the lanes are active every further 64 bytes is nearly free to add */
+  if ((!st->final)&&(bytes >= 64)&&((st->lanes_active)||((poly1305_accel)&&(bytes >= ZT_POLY1305_AVX2_MIN_BYTES)))) {
+    const size_t want = (bytes & ~((size_t)63));
+    poly1305_blocks_avx2(st, m, want);
+    m += want;
+    bytes -= want;
+  }
+  if (bytes < poly1305_block_size)
+    return;
+  if (st->lanes_active)
+    poly1305_collapse_avx2(st);
+#endif
+
   r0 = st->r[0];
   r1 = st->r[1];
   r2 = st->r[2];
@@ -305,6 +509,11 @@ poly1305_finish(poly1305_context *ctx, unsigned char mac[16]) {
     poly1305_blocks(st, st->buffer, poly1305_block_size);
   }
 
+#ifdef ZT_POLY1305_AVX2
+  if (st->lanes_active)
+    poly1305_collapse_avx2(st);
+#endif
+
   /* fully carry h */
   h0 = st->h[0];
   h1 = st->h[1];
@@ -357,6 +566,11 @@ poly1305_finish(poly1305_context *ctx, unsigned char mac[16]) {
   st->r[2] = 0;
   st->pad[0] = 0;
   st->pad[1] = 0;
+  for (size_t i = 0; i < sizeof(st->rpow); i++)
+    ((volatile unsigned char *)st->rpow)[i] = 0;
+  st->rpow_ready = 0;
+  for (size_t i = 0; i < sizeof(st->lanes); i++)
+    ((volatile unsigned char *)st->lanes)[i] = 0;
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -616,6 +830,34 @@ poly1305_update(poly1305_context *ctx, const unsigned char *m, size_t bytes) {
 
 } // anonymous namespace
 
+Poly1305::Accel Poly1305::accelSupported()
+  throw()
+{
+#ifdef ZT_POLY1305_AVX2
+  return (Accel)poly1305_accel_supported;
+#else
+  return ACCEL_NONE;
+#endif
+}
+
+Poly1305::Accel Poly1305::accel()
+  throw()
+{
+#ifdef ZT_POLY1305_AVX2
+  return (Accel)poly1305_accel;
+#else
+  return ACCEL_NONE;
+#endif
+}
+
+void Poly1305::setAccel(Accel a)
+  throw()
+{
+#ifdef ZT_POLY1305_AVX2
+  poly1305_accel = (((int)a < poly1305_accel_supported) ? (int)a : poly1305_accel_supported);
+#endif
+}
+
 void Poly1305::compute(void *auth,const void *data,unsigned int len,const void *key)
   throw()
 {
@@ -625,4 +867,25 @@ void Poly1305::compute(void *auth,const void *data,unsigned int len,const void *
   poly1305_finish(&ctx,reinterpret_cast<unsigned char *>(auth));
 }
 
+// Incremental interface state lives in _ctx
+typedef char poly1305_context_fits_in_Poly1305[(sizeof(poly1305_context) <= sizeof(Poly1305)) ? 1 : -1];
+
+void Poly1305::init(const void *key)
+  throw()
+{
+  poly1305_init(reinterpret_cast<poly1305_context *>(_ctx),reinterpret_cast<const unsigned char *>(key));
+}
+
+void Poly1305::update(const void *data,unsigned int len)
+  throw()
+{
+  poly1305_update(reinterpret_cast<poly1305_context *>(_ctx),reinterpret_cast<const unsigned char *>(data),(size_t)len);
+}
+
+void Poly1305::finish(void *auth)
+  throw()
+{
+  poly1305_finish(reinterpret_cast<poly1305_context *>(_ctx),reinterpret_cast<unsigned char *>(auth));
+}
+
 } // namespace ZeroTier
@@ -47,6 +47,38 @@ namespace ZeroTier {
 class Poly1305
 {
 public:
+	/**
+	 * Vector kernels, in order of preference
+	 */
+	enum Accel
+	{
+		ACCEL_NONE = 0,
+		ACCEL_AVX2 = 1
+	};
+
+	/**
+	 * @return Fastest kernel supported by this CPU and build
+	 */
+	static Accel accelSupported()
+		throw();
+
+	/**
+	 * @return Kernel currently used by compute()
+	 */
+	static Accel accel()
+		throw();
+
+	/**
+	 * Limit kernel selection (mostly for testing and benchmarks)
+	 *
+	 * This is global and not thread safe, so call it before any MACs are
+	 * being computed in other threads.
+	 *
+	 * @param a Maximum kernel to use (clamped to accelSupported())
+	 */
+	static void setAccel(Accel a)
+		throw();
+
 	/**
 	 * Compute a one-time authentication code
 	 *
@@ -57,6 +89,36 @@ public:
 	 */
 	static void compute(void *auth,const void *data,unsigned int len,const void *key)
 		throw();
+
+	/**
+	 * Begin computing an authentication code incrementally
+	 *
+	 * This gives the same result as compute() over the concatenation of
+	 * everything passed to update(). It lets callers MAC data in chunks
+	 * while it is still in cache, e.g. right after encrypting each chunk.
+	 *
+	 * @param key 32-byte one-time use key to authenticate data (must not be reused)
+	 */
+	void init(const void *key)
+		throw();
+
+	/**
+	 * @param data Next chunk of data to authenticate
+	 * @param len Length of chunk in bytes (multiples of 64 are fastest)
+	 */
+	void update(const void *data,unsigned int len)
+		throw();
+
+	/**
+	 * Finish and clear key material from this object
+	 *
+	 * @param auth Buffer to receive code -- MUST be 16 bytes in length
+	 */
+	void finish(void *auth)
+		throw();
+
+private:
+	unsigned long long _ctx[44];
 };
 
 } // namespace ZeroTier
@@ -46,6 +46,8 @@ class NetworkController;
 class SelfAwareness;
 class Cluster;
 class DeferredPackets;
+class VerifiedComCache;
+class ValidatedIdentityCache;
 
 /**
  * Holds global state for an instance of ZeroTier::Node
@@ -60,6 +62,8 @@ public:
 		,sw((Switch *)0)
 		,mc((Multicaster *)0)
 		,antiRec((AntiRecursion *)0)
+		,comCache((VerifiedComCache *)0)
+		,idCache((ValidatedIdentityCache *)0)
 		,topology((Topology *)0)
 		,sa((SelfAwareness *)0)
 		,dp((DeferredPackets *)0)
@@ -91,6 +95,8 @@ public:
 	Switch *sw;
 	Multicaster *mc;
 	AntiRecursion *antiRec;
+	VerifiedComCache *comCache;
+	ValidatedIdentityCache *idCache;
 	Topology *topology;
 	SelfAwareness *sa;
 	DeferredPackets *dp;
@@ -64,8 +64,334 @@ public:
 static const _s20sseconsts _S20SSECONSTANTS;
 #endif
 
+// Multi-block AVX2 and AVX-512 kernels, selected at runtime. These are
+// compiled with per-function target attributes so the rest of the binary
+// still runs on any SSE2-capable CPU.
+#ifdef ZT_SALSA20_AVX
+
+// Standard Salsa20 word order -> reordered SSE state word order (see init())
+static const unsigned int _S20_SSE_ORDER[16] = { 0,13,10,7,4,1,14,11,8,5,2,15,12,9,6,3 };
+
+static int _s20DetectAccel()
+{
+	__builtin_cpu_init();
+#ifdef ZT_SALSA20_AVX512
+	if (__builtin_cpu_supports("avx512f"))
+		return 2;
+#endif
+	if (__builtin_cpu_supports("avx2"))
+		return 1;
+	return 0;
+}
+static const int _S20_ACCEL_SUPPORTED = _s20DetectAccel();
+static int _s20Accel = _S20_ACCEL_SUPPORTED;
+
+#define _S20_AVX2_ROTL(v,n) _mm256_or_si256(_mm256_slli_epi32((v),(n)),_mm256_srli_epi32((v),32 - (n)))
+#define _S20_AVX2_QR(a,b,c,d) \
+	b = _mm256_xor_si256(b,_S20_AVX2_ROTL(_mm256_add_epi32(a,d),7)); \
+	c = _mm256_xor_si256(c,_S20_AVX2_ROTL(_mm256_add_epi32(b,a),9)); \
+	d = _mm256_xor_si256(d,_S20_AVX2_ROTL(_mm256_add_epi32(c,b),13)); \
+	a = _mm256_xor_si256(a,_S20_AVX2_ROTL(_mm256_add_epi32(d,c),18));
+
+// Word-sliced input for the kernels below: js[(w * lanes) + l] is standard
+// Salsa20 state word w of lane l. Lanes are consecutive blocks of one stream
+// here, but can also be blocks of unrelated streams (see keystream12Multi).
+static inline void _s20Slice(const uint32_t *st,const uint64_t ctr,uint32_t *js,const unsigned int lanes)
+{
+	for(unsigned int w=0;w<16;++w) {
+		const uint32_t v = st[_S20_SSE_ORDER[w]];
+		for(unsigned int l=0;l<lanes;++l)
+			js[(w * lanes) + l] = v;
+	}
+	for(unsigned int l=0;l<lanes;++l) {
+		js[(8 * lanes) + l] = (uint32_t)(ctr + l);
+		js[(9 * lanes) + l] = (uint32_t)((ctr + l) >> 32);
+	}
+}
+
+// Encrypt 8 blocks (512 bytes) from a word-sliced state, or just output key
+// stream if m is NULL. Each vector holds one state word for all 8 blocks, so
+// the rounds need no shuffles.
+__attribute__((target("avx2")))
+static void _s20Avx2x8(const uint32_t *js,const unsigned int rounds,const uint8_t *m,uint8_t *c)
+{
+	__m256i j[16],x[16];
+	for(unsigned int w=0;w<16;++w) {
+		j[w] = _mm256_loadu_si256((const __m256i *)(js + (w * 8)));
+		x[w] = j[w];
+	}
+
+	for(unsigned int r=0;r<rounds;r+=2) {
+		_S20_AVX2_QR(x[0],x[4],x[8],x[12])
+		_S20_AVX2_QR(x[5],x[9],x[13],x[1])
+		_S20_AVX2_QR(x[10],x[14],x[2],x[6])
+		_S20_AVX2_QR(x[15],x[3],x[7],x[11])
+		_S20_AVX2_QR(x[0],x[1],x[2],x[3])
+		_S20_AVX2_QR(x[5],x[6],x[7],x[4])
+		_S20_AVX2_QR(x[10],x[11],x[8],x[9])
+		_S20_AVX2_QR(x[15],x[12],x[13],x[14])
+	}
+
+	for(unsigned int w=0;w<16;++w)
+		x[w] = _mm256_add_epi32(x[w],j[w]);
+
+	// Transpose words 0-7 and 8-15 from word-sliced to per-block order
+	for(unsigned int h=0;h<16;h+=8) {
+		const __m256i t0 = _mm256_unpacklo_epi32(x[h],x[h+1]);
+		const __m256i t1 = _mm256_unpackhi_epi32(x[h],x[h+1]);
+		const __m256i t2 = _mm256_unpacklo_epi32(x[h+2],x[h+3]);
+		const __m256i t3 = _mm256_unpackhi_epi32(x[h+2],x[h+3]);
+		const __m256i t4 = _mm256_unpacklo_epi32(x[h+4],x[h+5]);
+		const __m256i t5 = _mm256_unpackhi_epi32(x[h+4],x[h+5]);
+		const __m256i t6 = _mm256_unpacklo_epi32(x[h+6],x[h+7]);
+		const __m256i t7 = _mm256_unpackhi_epi32(x[h+6],x[h+7]);
+		const __m256i u0 = _mm256_unpacklo_epi64(t0,t2);
+		const __m256i u1 = _mm256_unpackhi_epi64(t0,t2);
+		const __m256i u2 = _mm256_unpacklo_epi64(t1,t3);
+		const __m256i u3 = _mm256_unpackhi_epi64(t1,t3);
+		const __m256i u4 = _mm256_unpacklo_epi64(t4,t6);
+		const __m256i u5 = _mm256_unpackhi_epi64(t4,t6);
+		const __m256i u6 = _mm256_unpacklo_epi64(t5,t7);
+		const __m256i u7 = _mm256_unpackhi_epi64(t5,t7);
+		x[h] = _mm256_permute2x128_si256(u0,u4,0x20);
+		x[h+1] = _mm256_permute2x128_si256(u1,u5,0x20);
+		x[h+2] = _mm256_permute2x128_si256(u2,u6,0x20);
+		x[h+3] = _mm256_permute2x128_si256(u3,u7,0x20);
+		x[h+4] = _mm256_permute2x128_si256(u0,u4,0x31);
+		x[h+5] = _mm256_permute2x128_si256(u1,u5,0x31);
+		x[h+6] = _mm256_permute2x128_si256(u2,u6,0x31);
+		x[h+7] = _mm256_permute2x128_si256(u3,u7,0x31);
+	}
+
+	if (m) {
+		for(unsigned int b=0;b<8;++b) {
+			_mm256_storeu_si256((__m256i *)(c + (b * 64)),_mm256_xor_si256(x[b],_mm256_loadu_si256((const __m256i *)(m + (b * 64)))));
+			_mm256_storeu_si256((__m256i *)(c + (b * 64) + 32),_mm256_xor_si256(x[b + 8],_mm256_loadu_si256((const __m256i *)(m + (b * 64) + 32))));
+		}
+	} else {
+		for(unsigned int b=0;b<8;++b) {
+			_mm256_storeu_si256((__m256i *)(c + (b * 64)),x[b]);
+			_mm256_storeu_si256((__m256i *)(c + (b * 64) + 32),x[b + 8]);
+		}
+	}
+}
+
+#ifdef ZT_SALSA20_AVX512
+
+// Some GCC versions warn about _mm512_undefined_epi32() inside _mm512_rol_epi32()
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+
+#define _S20_AVX512_QR(a,b,c,d) \
+	b = _mm512_xor_si512(b,_mm512_rol_epi32(_mm512_add_epi32(a,d),7)); \
+	c = _mm512_xor_si512(c,_mm512_rol_epi32(_mm512_add_epi32(b,a),9)); \
+	d = _mm512_xor_si512(d,_mm512_rol_epi32(_mm512_add_epi32(c,b),13)); \
+	a = _mm512_xor_si512(a,_mm512_rol_epi32(_mm512_add_epi32(d,c),18));
+
+// Encrypt 16 blocks (1024 bytes) from a word-sliced state, or just output
+// key stream if m is NULL
+__attribute__((target("avx512f")))
+static void _s20Avx512x16(const uint32_t *js,const unsigned int rounds,const uint8_t *m,uint8_t *c)
+{
+	__m512i j[16],x[16],u[16];
+	for(unsigned int w=0;w<16;++w) {
+		j[w] = _mm512_loadu_si512((const void *)(js + (w * 16)));
+		x[w] = j[w];
+	}
+
+	for(unsigned int r=0;r<rounds;r+=2) {
+		_S20_AVX512_QR(x[0],x[4],x[8],x[12])
+		_S20_AVX512_QR(x[5],x[9],x[13],x[1])
+		_S20_AVX512_QR(x[10],x[14],x[2],x[6])
+		_S20_AVX512_QR(x[15],x[3],x[7],x[11])
+		_S20_AVX512_QR(x[0],x[1],x[2],x[3])
+		_S20_AVX512_QR(x[5],x[6],x[7],x[4])
+		_S20_AVX512_QR(x[10],x[11],x[8],x[9])
+		_S20_AVX512_QR(x[15],x[12],x[13],x[14])
+	}
+
+	for(unsigned int w=0;w<16;++w)
+		x[w] = _mm512_add_epi32(x[w],j[w]);
+
+	// 16x16 transpose: afterwards u[4k+i] 128-bit lane L holds words 4k..4k+3
+	// of block 4L+i, which are then gathered across lanes.
+	for(unsigned int k=0;k<16;k+=4) {
+		const __m512i t0 = _mm512_unpacklo_epi32(x[k],x[k+1]);
+		const __m512i t1 = _mm512_unpackhi_epi32(x[k],x[k+1]);
+		const __m512i t2 = _mm512_unpacklo_epi32(x[k+2],x[k+3]);
+		const __m512i t3 = _mm512_unpackhi_epi32(x[k+2],x[k+3]);
+		u[k] = _mm512_unpacklo_epi64(t0,t2);
+		u[k+1] = _mm512_unpackhi_epi64(t0,t2);
+		u[k+2] = _mm512_unpacklo_epi64(t1,t3);
+		u[k+3] = _mm512_unpackhi_epi64(t1,t3);
+	}
+	for(unsigned int i=0;i<4;++i) {
+		const __m512i v0 = _mm512_shuffle_i32x4(u[i],u[i+4],0x44);
+		const __m512i v1 = _mm512_shuffle_i32x4(u[i],u[i+4],0xee);
+		const __m512i w0 = _mm512_shuffle_i32x4(u[i+8],u[i+12],0x44);
+		const __m512i w1 = _mm512_shuffle_i32x4(u[i+8],u[i+12],0xee);
+		x[i] = _mm512_shuffle_i32x4(v0,w0,0x88);
+		x[i+4] = _mm512_shuffle_i32x4(v0,w0,0xdd);
+		x[i+8] = _mm512_shuffle_i32x4(v1,w1,0x88);
+		x[i+12] = _mm512_shuffle_i32x4(v1,w1,0xdd);
+	}
+
+	if (m) {
+		for(unsigned int b=0;b<16;++b)
+			_mm512_storeu_si512((void *)(c + (b * 64)),_mm512_xor_si512(x[b],_mm512_loadu_si512((const void *)(m + (b * 64)))));
+	} else {
+		for(unsigned int b=0;b<16;++b)
+			_mm512_storeu_si512((void *)(c + (b * 64)),x[b]);
+	}
+}
+
+#pragma GCC diagnostic pop
+
+#endif // ZT_SALSA20_AVX512
+
+// Encrypt as much of in[] as the vector kernels can handle efficiently and
+// advance the block counter; returns bytes done, the rest is left to SSE.
+static unsigned int _s20AvxEncrypt(uint32_t *st,const unsigned int rounds,const uint8_t *m,uint8_t *c,const unsigned int bytes)
+{
+	uint64_t ctr = (uint64_t)st[8] | ((uint64_t)st[5] << 32);
+	unsigned int done = 0;
+	uint32_t js[16 * 16];
+
+#ifdef ZT_SALSA20_AVX512
+	if (_s20Accel >= 2) {
+		while ((bytes - done) >= 1024) {
+			_s20Slice(st,ctr,js,16);
+			_s20Avx512x16(js,rounds,m + done,c + done);
+			done += 1024;
+			ctr += 16;
+		}
+	}
+#endif
+	while ((bytes - done) >= 512) {
+		_s20Slice(st,ctr,js,8);
+		_s20Avx2x8(js,rounds,m + done,c + done);
+		done += 512;
+		ctr += 8;
+	}
+
+	// A tail of more than three blocks is still cheaper as one 8-block pass
+	const unsigned int rem = bytes - done;
+	if (rem > 192) {
+		uint8_t tmp[512];
+		memcpy(tmp,m + done,rem);
+		_s20Slice(st,ctr,js,8);
+		_s20Avx2x8(js,rounds,tmp,tmp);
+		memcpy(c + done,tmp,rem);
+		ZeroTier::Utils::burn(tmp,sizeof(tmp));
+		done = bytes;
+		ctr += (rem + 63) / 64;
+	}
+
+	st[8] = (uint32_t)ctr;
+	st[5] = (uint32_t)(ctr >> 32); // state reordered for SSE
+	ZeroTier::Utils::burn(js,sizeof(js));
+	return done;
+}
+
+#endif // ZT_SALSA20_AVX
+
 namespace ZeroTier {
 
+Salsa20::Accel Salsa20::accelSupported()
+	throw()
+{
+#ifdef ZT_SALSA20_AVX
+	return (Accel)_S20_ACCEL_SUPPORTED;
+#else
+	return ACCEL_NONE;
+#endif
+}
+
+Salsa20::Accel Salsa20::accel()
+	throw()
+{
+#ifdef ZT_SALSA20_AVX
+	return (Accel)_s20Accel;
+#else
+	return ACCEL_NONE;
+#endif
+}
+
+void Salsa20::setAccel(Accel a)
+	throw()
+{
+#ifdef ZT_SALSA20_AVX
+	_s20Accel = (((int)a < _S20_ACCEL_SUPPORTED) ? (int)a : _S20_ACCEL_SUPPORTED);
+#endif
+}
+
+void Salsa20::keystream12Multi(Salsa20 *const *ciphers,void *const *out,const unsigned int *blocks,unsigned int count)
+	throw()
+{
+#ifdef ZT_SALSA20_AVX
+	if (_s20Accel) {
+		uint32_t js[16 * 16];
+		uint8_t ks[16 * 64];
+		while (count) {
+#ifdef ZT_SALSA20_AVX512
+			const unsigned int width = ((_s20Accel >= 2)&&(count > 8)) ? 16 : 8;
+#else
+			const unsigned int width = 8;
+#endif
+			const unsigned int lanes = (count < width) ? count : width;
+
+			unsigned int maxBlocks = 0;
+			for(unsigned int l=0;l<lanes;++l) {
+				if (blocks[l] > maxBlocks)
+					maxBlocks = blocks[l];
+			}
+
+			// Lane l computes block b of stream l; unused lanes just repeat lane 0
+			for(unsigned int b=0;b<maxBlocks;++b) {
+				for(unsigned int l=0;l<width;++l) {
+					const uint32_t *const st = ciphers[(l < lanes) ? l : 0]->_state.i;
+					const uint64_t ctr = ((uint64_t)st[8] | ((uint64_t)st[5] << 32)) + b;
+					for(unsigned int w=0;w<16;++w)
+						js[(w * width) + l] = st[_S20_SSE_ORDER[w]];
+					js[(8 * width) + l] = (uint32_t)ctr;
+					js[(9 * width) + l] = (uint32_t)(ctr >> 32);
+				}
+#ifdef ZT_SALSA20_AVX512
+				if (width == 16)
+					_s20Avx512x16(js,12,(const uint8_t *)0,ks);
+				else _s20Avx2x8(js,12,(const uint8_t *)0,ks);
+#else
+				_s20Avx2x8(js,12,(const uint8_t *)0,ks);
+#endif
+				for(unsigned int l=0;l<lanes;++l) {
+					if (b < blocks[l])
+						memcpy(reinterpret_cast<uint8_t *>(out[l]) + (b * 64),ks + (l * 64),64);
+				}
+			}
+
+			for(unsigned int l=0;l<lanes;++l) {
+				uint32_t *const st = ciphers[l]->_state.i;
+				const uint64_t ctr = ((uint64_t)st[8] | ((uint64_t)st[5] << 32)) + blocks[l];
+				st[8] = (uint32_t)ctr;
+				st[5] = (uint32_t)(ctr >> 32); // state reordered for SSE
+			}
+
+			ciphers += lanes;
+			out += lanes;
+			blocks += lanes;
+			count -= lanes;
+		}
+		Utils::burn(js,sizeof(js));
+		Utils::burn(ks,sizeof(ks));
+		return;
+	}
+#endif
+	for(unsigned int i=0;i<count;++i) {
+		memset(out[i],0,blocks[i] * 64);
+		ciphers[i]->encrypt12(out[i],out[i],blocks[i] * 64);
+	}
+}
+
 void Salsa20::init(const void *key,unsigned int kbits,const void *iv)
 	throw()
 {
@@ -140,6 +466,17 @@ void Salsa20::encrypt12(const void *in,void *out,unsigned int bytes)
 	if (!bytes)
 		return;
 
+#ifdef ZT_SALSA20_AVX
+	if ((_s20Accel)&&(bytes >= ZT_SALSA20_AVX_MIN_BYTES)) {
+		const unsigned int done = _s20AvxEncrypt(_state.i,12,m,c,bytes);
+		if (done == bytes)
+			return;
+		bytes -= done;
+		c += done;
+		m += done;
+	}
+#endif
+
 #ifndef ZT_SALSA20_SSE
 	j0 = _state.i[0];
 	j1 = _state.i[1];
@@ -640,6 +977,17 @@ void Salsa20::encrypt20(const void *in,void *out,unsigned int bytes)
 	if (!bytes)
 		return;
 
+#ifdef ZT_SALSA20_AVX
+	if ((_s20Accel)&&(bytes >= ZT_SALSA20_AVX_MIN_BYTES)) {
+		const unsigned int done = _s20AvxEncrypt(_state.i,20,m,c,bytes);
+		if (done == bytes)
+			return;
+		bytes -= done;
+		c += done;
+		m += done;
+	}
+#endif
+
 #ifndef ZT_SALSA20_SSE
 	j0 = _state.i[0];
 	j1 = _state.i[1];
@@ -22,6 +22,19 @@
 #include <emmintrin.h>
 #endif // ZT_SALSA20_SSE
 
+// Multi-block AVX2/AVX-512 kernels are built with per-function target
+// attributes and chosen at runtime, so they need GCC 6+ or clang on x86.
+#if defined(ZT_SALSA20_SSE) && (!defined(ZT_SALSA20_NO_AVX)) && (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ >= 6)))
+#define ZT_SALSA20_AVX 1
+#define ZT_SALSA20_AVX512 1
+#include <immintrin.h>
+#endif
+
+/**
+ * Minimum length of a single encrypt call to use the AVX kernels
+ */
+#define ZT_SALSA20_AVX_MIN_BYTES 256
+
 namespace ZeroTier {
 
 /**
@@ -30,6 +43,16 @@ namespace ZeroTier {
 class Salsa20
 {
 public:
+	/**
+	 * Multi-block vector kernels, in order of preference
+	 */
+	enum Accel
+	{
+		ACCEL_NONE = 0,
+		ACCEL_AVX2 = 1,
+		ACCEL_AVX512 = 2
+	};
+
 	Salsa20() throw() {}
 
 	~Salsa20() { Utils::burn(&_state,sizeof(_state)); }
@@ -45,6 +68,29 @@ public:
 		init(key,kbits,iv);
 	}
 
+	/**
+	 * @return Fastest multi-block kernel supported by this CPU and build
+	 */
+	static Accel accelSupported()
+		throw();
+
+	/**
+	 * @return Multi-block kernel currently used by encrypt12/encrypt20
+	 */
+	static Accel accel()
+		throw();
+
+	/**
+	 * Limit multi-block kernel selection (mostly for testing and benchmarks)
+	 *
+	 * This is global and not thread safe, so call it before any encryption
+	 * is happening in other threads.
+	 *
+	 * @param a Maximum kernel to use (clamped to accelSupported())
+	 */
+	static void setAccel(Accel a)
+		throw();
+
 	/**
 	 * Initialize cipher
 	 *
@@ -65,6 +111,22 @@ public:
 	void encrypt12(const void *in,void *out,unsigned int bytes)
 		throw();
 
+	/**
+	 * Generate Salsa20/12 key stream for several independent ciphers at once
+	 *
+	 * This runs each cipher in its own vector lane, so a batch of short
+	 * messages under different keys costs about as much as one long one.
+	 * The result is the same as calling encrypt12() on zeroes for each
+	 * cipher, and each cipher's position advances by blocks[i] blocks.
+	 *
+	 * @param ciphers Initialized ciphers
+	 * @param out Output buffers, each at least blocks[i] * 64 bytes
+	 * @param blocks Number of 64-byte key stream blocks to generate for each cipher
+	 * @param count Number of ciphers
+	 */
+	static void keystream12Multi(Salsa20 *const *ciphers,void *const *out,const unsigned int *blocks,unsigned int count)
+		throw();
+
 	/**
 	 * Encrypt data using Salsa20/20
 	 *
@@ -27,6 +27,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <algorithm>
 #include <utility>
@@ -66,11 +67,27 @@ static const char *etherTypeName(const unsigned int etherType)
 }
 #endif // ZT_TRACE
 
+// Remove a queue entry from the index of entries waiting on an address
+template<typename I>
+static inline void _unindexQueueEntry(Hashtable< Address,std::vector<I> > &idx,const Address &a,const I &entry)
+{
+	std::vector<I> *const v = idx.get(a);
+	if (v) {
+		typename std::vector<I>::iterator i(std::find(v->begin(),v->end(),entry));
+		if (i != v->end())
+			v->erase(i);
+		if (v->empty())
+			idx.erase(a);
+	}
+}
+
 Switch::Switch(const RuntimeEnvironment *renv) :
 	RR(renv),
 	_lastBeaconResponse(0),
 	_outstandingWhoisRequests(32),
-	_defragQueue(32),
+	_rxQueueWaiting(32),
+	_rxStagingEnabled(false),
+	_txQueueByDest(32),
 	_lastUniteAttempt(8) // only really used on root servers and upstreams, and it'll grow there just fine
 {
 }
@@ -79,7 +96,7 @@ Switch::~Switch()
 {
 }
 
-void Switch::onRemotePacket(const InetAddress &localAddr,const InetAddress &fromAddr,const void *data,unsigned int len)
+void Switch::onRemotePacket(const InetAddress &localAddr,const InetAddress &fromAddr,void *data,unsigned int len)
 {
 	try {
 		if (len == 13) {
@@ -114,6 +131,44 @@ void Switch::onRemotePacket(const InetAddress &localAddr,const InetAddress &from
 	}
 }
 
+void Switch::setRxStaging(bool enabled)
+{
+	_rxStagingEnabled = enabled;
+	if (!enabled)
+		flushStagedPackets();
+}
+
+void Switch::flushStagedPackets()
+{
+	std::vector< SharedPtr<IncomingPacket> > staged;
+	{
+		Mutex::Lock _l(_rxStaged_m);
+		if (_rxStaged.empty())
+			return;
+		staged.swap(_rxStaged);
+	}
+
+	IncomingPacket *pkts[ZT_PACKET_DEARMOR_BATCH_MAX];
+	for(unsigned int i=0;i<(unsigned int)staged.size();i+=ZT_PACKET_DEARMOR_BATCH_MAX) {
+		const unsigned int n = (((unsigned int)staged.size() - i) < ZT_PACKET_DEARMOR_BATCH_MAX) ? ((unsigned int)staged.size() - i) : ZT_PACKET_DEARMOR_BATCH_MAX;
+		for(unsigned int k=0;k<n;++k)
+			pkts[k] = staged[i + k].ptr();
+
+		try {
+			IncomingPacket::dearmorBatch(RR,pkts,n);
+		} catch ( ... ) {} // anything not dearmored here is dearmored by tryDecode()
+
+		for(unsigned int k=0;k<n;++k) {
+			try {
+				if (!pkts[k]->tryDecode(RR,false))
+					_enqueueRx(staged[i + k]);
+			} catch ( ... ) {
+				TRACE("dropped staged packet: unexpected exception");
+			}
+		}
+	}
+}
+
 void Switch::onLocalEthernet(const SharedPtr<Network> &network,const MAC &from,const MAC &to,unsigned int etherType,unsigned int vlanId,const void *data,unsigned int len)
 {
 	SharedPtr<NetworkConfig> nconf(network->config2());
@@ -278,14 +333,14 @@ void Switch::onLocalEthernet(const SharedPtr<Network> &network,const MAC &from,c
 			outp.append((uint16_t)etherType);
 			outp.append(data,len);
 			outp.compress();
-			send(outp,true,network->id());
+			sendInPlace(outp,true,network->id());
 		} else {
 			Packet outp(toZT,RR->identity.address(),Packet::VERB_FRAME);
 			outp.append(network->id());
 			outp.append((uint16_t)etherType);
 			outp.append(data,len);
 			outp.compress();
-			send(outp,true,network->id());
+			sendInPlace(outp,true,network->id());
 		}
 
 		//TRACE("%.16llx: UNICAST: %s -> %s etherType==%s(%.4x) vlanId==%u len==%u fromBridged==%d includeCom==%d",network->id(),from.toString().c_str(),to.toString().c_str(),etherTypeName(etherType),etherType,vlanId,len,(int)fromBridged,(int)includeCom);
@@ -342,7 +397,7 @@ void Switch::onLocalEthernet(const SharedPtr<Network> &network,const MAC &from,c
 			outp.append((uint16_t)etherType);
 			outp.append(data,len);
 			outp.compress();
-			send(outp,true,network->id());
+			sendInPlace(outp,true,network->id());
 		}
 	}
 }
@@ -356,9 +411,26 @@ void Switch::send(const Packet &packet,bool encrypt,uint64_t nwid)
 
 	//TRACE(">> %s to %s (%u bytes, encrypt==%d, nwid==%.16llx)",Packet::verbString(packet.verb()),packet.destination().toString().c_str(),packet.size(),(int)encrypt,nwid);
 
-	if (!_trySend(packet,encrypt,nwid)) {
-		Mutex::Lock _l(_txQueue_m);
-		_txQueue.push_back(TXQueueEntry(packet.destination(),RR->node->now(),packet,encrypt,nwid));
+	if (!_trySend(packet,encrypt,nwid))
+		_enqueueTx(packet,encrypt,nwid);
+}
+
+void Switch::sendInPlace(Packet &packet,bool encrypt,uint64_t nwid)
+{
+	if (packet.destination() == RR->identity.address()) {
+		TRACE("BUG: caught attempt to send() to self, ignored");
+		return;
+	}
+
+	const uint64_t now = RR->node->now();
+	SharedPtr<Peer> peer;
+	Path *const viaPath = _sendPath(packet,nwid,now,peer);
+	if (viaPath) {
+		// Once armored the packet can't go back into the TX queue, so a
+		// failed send is dropped here as if it were lost on the wire.
+		_armorAndSend(packet,peer,viaPath,encrypt,now);
+	} else {
+		_enqueueTx(packet,encrypt,nwid);
 	}
 }
 
@@ -473,22 +545,34 @@ void Switch::doAnythingWaitingForPeer(const SharedPtr<Peer> &peer)
 	}
 
 	{	// finish processing any packets waiting on peer's public key / identity
-		Mutex::Lock _l(_rxQueue_m);
-		for(std::list< SharedPtr<IncomingPacket> >::iterator rxi(_rxQueue.begin());rxi!=_rxQueue.end();) {
-			if ((*rxi)->tryDecode(RR,false))
-				_rxQueue.erase(rxi++);
-			else ++rxi;
+		std::vector< SharedPtr<IncomingPacket> > waiting;
+		{
+			Mutex::Lock _l(_rxQueue_m);
+			std::vector<_RXQueue::iterator> *const w = _rxQueueWaiting.get(peer->address());
+			if (w) {
+				waiting.reserve(w->size());
+				for(std::vector<_RXQueue::iterator>::const_iterator rxi(w->begin());rxi!=w->end();++rxi) {
+					waiting.push_back((*rxi)->second);
+					_rxQueue.erase(*rxi);
+				}
+				_rxQueueWaiting.erase(peer->address());
+			}
+		}
+
+		// Decoding can teach us about other peers and land back here, so do it unlocked
+		for(std::vector< SharedPtr<IncomingPacket> >::const_iterator p(waiting.begin());p!=waiting.end();++p) {
+			if (!(*p)->tryDecode(RR,false))
+				_enqueueRx(*p); // now waiting on someone else
 		}
 	}
 
 	{	// finish sending any packets waiting on peer's public key / identity
 		Mutex::Lock _l(_txQueue_m);
-		for(std::list< TXQueueEntry >::iterator txi(_txQueue.begin());txi!=_txQueue.end();) {
-			if (txi->dest == peer->address()) {
-				if (_trySend(txi->packet,txi->encrypt,txi->nwid))
-					_txQueue.erase(txi++);
-				else ++txi;
-			} else ++txi;
+		std::vector<_TXQueue::iterator> *const w = _txQueueByDest.get(peer->address());
+		if (w) {
+			_retryTx(*w);
+			if (w->empty())
+				_txQueueByDest.erase(peer->address());
 		}
 	}
 }
@@ -497,6 +581,9 @@ unsigned long Switch::doTimerTasks(uint64_t now)
 {
 	unsigned long nextDelay = 0xffffffff; // ceiling delay, caller will cap to minimum
 
+	// Nothing should be left staged across timer runs, but make sure
+	flushStagedPackets();
+
 	{	// Iterate through NAT traversal strategies for entries in contact queue
 		Mutex::Lock _l(_contactQueue_m);
 		for(std::list<ContactQueueEntry>::iterator qi(_contactQueue.begin());qi!=_contactQueue.end();) {
@@ -557,39 +644,43 @@ unsigned long Switch::doTimerTasks(uint64_t now)
 		}
 	}
 
-	{	// Time out TX queue packets that never got WHOIS lookups or other info.
+	{	// Retry TX queue packets to known peers (e.g. ones that had no path) and time out the oldest
 		Mutex::Lock _l(_txQueue_m);
-		for(std::list< TXQueueEntry >::iterator txi(_txQueue.begin());txi!=_txQueue.end();) {
-			if (_trySend(txi->packet,txi->encrypt,txi->nwid))
-				_txQueue.erase(txi++);
-			else if ((now - txi->creationTime) > ZT_TRANSMIT_QUEUE_TIMEOUT) {
-				TRACE("TX %s -> %s timed out",txi->packet.source().toString().c_str(),txi->packet.destination().toString().c_str());
-				_txQueue.erase(txi++);
-			} else ++txi;
+		Hashtable< Address,std::vector<_TXQueue::iterator> >::Iterator i(_txQueueByDest);
+		Address *dest = (Address *)0;
+		std::vector<_TXQueue::iterator> *w = (std::vector<_TXQueue::iterator> *)0;
+		while (i.next(dest,w)) {
+			if (RR->topology->getPeer(*dest)) { // packets to unknown peers wait for doAnythingWaitingForPeer()
+				_retryTx(*w);
+				if (w->empty())
+					_txQueueByDest.erase(*dest);
+			}
 		}
+
+		while ((!_txQueue.empty())&&((now - _txQueue.begin()->first) > ZT_TRANSMIT_QUEUE_TIMEOUT)) {
+			const _TXQueue::iterator txi(_txQueue.begin());
+			TRACE("TX %s -> %s timed out",txi->second.packet.source().toString().c_str(),txi->second.dest.toString().c_str());
+			_unindexQueueEntry(_txQueueByDest,txi->second.dest,txi);
+			_txQueue.erase(txi);
+		}
+		if (!_txQueue.empty())
+			nextDelay = std::min(nextDelay,(unsigned long)(ZT_TRANSMIT_QUEUE_TIMEOUT - (now - _txQueue.begin()->first)) + 1);
 	}
 
 	{	// Time out RX queue packets that never got WHOIS lookups or other info.
 		Mutex::Lock _l(_rxQueue_m);
-		for(std::list< SharedPtr<IncomingPacket> >::iterator i(_rxQueue.begin());i!=_rxQueue.end();) {
-			if ((now - (*i)->receiveTime()) > ZT_RECEIVE_QUEUE_TIMEOUT) {
-				TRACE("RX %s -> %s timed out",(*i)->source().toString().c_str(),(*i)->destination().toString().c_str());
-				_rxQueue.erase(i++);
-			} else ++i;
+		while ((!_rxQueue.empty())&&((now - _rxQueue.begin()->first) > ZT_RECEIVE_QUEUE_TIMEOUT)) {
+			const _RXQueue::iterator rxi(_rxQueue.begin());
+			TRACE("RX %s -> %s timed out",rxi->second->source().toString().c_str(),rxi->second->destination().toString().c_str());
+			_unindexQueueEntry(_rxQueueWaiting,rxi->second->waitingFor(),rxi);
+			_rxQueue.erase(rxi);
 		}
 	}
 
-	{	// Time out packets that didn't get all their fragments.
-		Mutex::Lock _l(_defragQueue_m);
-		Hashtable< uint64_t,DefragQueueEntry >::Iterator i(_defragQueue);
-		uint64_t *packetId = (uint64_t *)0;
-		DefragQueueEntry *qe = (DefragQueueEntry *)0;
-		while (i.next(packetId,qe)) {
-			if ((now - qe->creationTime) > ZT_FRAGMENTED_PACKET_RECEIVE_TIMEOUT) {
-				TRACE("incomplete fragmented packet %.16llx timed out, fragments discarded",*packetId);
-				_defragQueue.erase(*packetId);
-			}
-		}
+	// Time out packets that didn't get all their fragments.
+	for(unsigned int s=0;s<ZT_DEFRAG_QUEUE_SHARDS;++s) {
+		Mutex::Lock _l(_defragShards[s].lock);
+		nextDelay = std::min(nextDelay,_expireDefragEntries(_defragShards[s],now));
 	}
 
 	{	// Remove really old last unite attempt entries to keep table size controlled
@@ -606,23 +697,43 @@ unsigned long Switch::doTimerTasks(uint64_t now)
 	return nextDelay;
 }
 
-void Switch::_handleRemotePacketFragment(const InetAddress &localAddr,const InetAddress &fromAddr,const void *data,unsigned int len)
+void Switch::queueStats(uint64_t now,unsigned long &txPackets,unsigned long &txPeers,uint64_t &txOldest,unsigned long &rxPackets,unsigned long &rxPeers,uint64_t &rxOldest)
+{
+	{
+		Mutex::Lock _l(_txQueue_m);
+		txPackets = (unsigned long)_txQueue.size();
+		txPeers = _txQueueByDest.size();
+		txOldest = (_txQueue.empty()) ? 0 : (now - _txQueue.begin()->first);
+	}
+	{
+		Mutex::Lock _l(_rxQueue_m);
+		rxPackets = (unsigned long)_rxQueue.size();
+		rxPeers = _rxQueueWaiting.size();
+		rxOldest = (_rxQueue.empty()) ? 0 : (now - _rxQueue.begin()->first);
+	}
+}
+
+void Switch::_handleRemotePacketFragment(const InetAddress &localAddr,const InetAddress &fromAddr,void *data,unsigned int len)
 {
-	Packet::Fragment fragment(data,len);
-	Address destination(fragment.destination());
+	unsigned char *const b = reinterpret_cast<unsigned char *>(data);
+	const Address destination(b + ZT_PACKET_FRAGMENT_IDX_DEST,ZT_ADDRESS_LENGTH);
 
 	if (destination != RR->identity.address()) {
-		// Fragment is not for us, so try to relay it
-		if (fragment.hops() < ZT_RELAY_MAX_HOPS) {
-			fragment.incrementHops();
+		// Fragment is not for us, so try to relay it straight from the receive buffer
+		if ((len <= ZT_PROTO_MIN_FRAGMENT_LENGTH)||(len > ZT_PROTO_MAX_PACKET_LENGTH)) {
+			TRACE("dropped relay [fragment](%s) -> %s, invalid length %u",fromAddr.toString().c_str(),destination.toString().c_str(),len);
+			return;
+		}
+		if (b[ZT_PACKET_FRAGMENT_IDX_HOPS] < ZT_RELAY_MAX_HOPS) {
+			b[ZT_PACKET_FRAGMENT_IDX_HOPS] = (b[ZT_PACKET_FRAGMENT_IDX_HOPS] + 1) & ZT_PROTO_MAX_HOPS;
 
 			// Note: we don't bother initiating NAT-t for fragments, since heads will set that off.
 			// It wouldn't hurt anything, just redundant and unnecessary.
 			SharedPtr<Peer> relayTo = RR->topology->getPeer(destination);
-			if ((!relayTo)||(!relayTo->send(RR,fragment.data(),fragment.size(),RR->node->now()))) {
+			if ((!relayTo)||(!relayTo->send(RR,data,len,RR->node->now()))) {
 #ifdef ZT_ENABLE_CLUSTER
 				if (RR->cluster) {
-					RR->cluster->sendViaCluster(Address(),destination,fragment.data(),fragment.size(),false);
+					RR->cluster->sendViaCluster(Address(),destination,data,len,false);
 					return;
 				}
 #endif
@@ -630,67 +741,88 @@ void Switch::_handleRemotePacketFragment(const InetAddress &localAddr,const Inet
 				// Don't know peer or no direct path -- so relay via root server
 				relayTo = RR->topology->getBestRoot();
 				if (relayTo)
-					relayTo->send(RR,fragment.data(),fragment.size(),RR->node->now());
+					relayTo->send(RR,data,len,RR->node->now());
 			}
 		} else {
 			TRACE("dropped relay [fragment](%s) -> %s, max hops exceeded",fromAddr.toString().c_str(),destination.toString().c_str());
 		}
 	} else {
 		// Fragment looks like ours
-		uint64_t pid = fragment.packetId();
-		unsigned int fno = fragment.fragmentNumber();
-		unsigned int tf = fragment.totalFragments();
+		const unsigned int fno = (unsigned int)b[ZT_PACKET_FRAGMENT_IDX_FRAGMENT_NO] & 0xf;
+		const unsigned int tf = ((unsigned int)b[ZT_PACKET_FRAGMENT_IDX_FRAGMENT_NO] >> 4) & 0xf;
+		const unsigned int plen = len - ZT_PACKET_FRAGMENT_IDX_PAYLOAD;
 
-		if ((tf <= ZT_MAX_PACKET_FRAGMENTS)&&(fno < ZT_MAX_PACKET_FRAGMENTS)&&(fno > 0)&&(tf > 1)) {
+		if ((tf <= ZT_MAX_PACKET_FRAGMENTS)&&(fno < tf)&&(fno > 0)&&(tf > 1)&&(plen <= ZT_PROTO_MAX_PACKET_LENGTH)) {
 			// Fragment appears basically sane. Its fragment number must be
 			// 1 or more, since a Packet with fragmented bit set is fragment 0.
 			// Total fragments must be more than 1, otherwise why are we
 			// seeing a Packet::Fragment?
 
-			Mutex::Lock _l(_defragQueue_m);
-			DefragQueueEntry &dq = _defragQueue[pid];
+			uint64_t pid = 0;
+			for(unsigned int i=0;i<8;++i)
+				pid = (pid << 8) | (uint64_t)b[ZT_PACKET_FRAGMENT_IDX_PACKET_ID + i];
+
+			_DefragShard &ds = _defragShard(pid);
+			Mutex::Lock _l(ds.lock);
+			DefragQueueEntry *dq = ds.queue.get(pid);
 
-			if (!dq.creationTime) {
+			if (!dq) {
 				// We received a Packet::Fragment without its head, so queue it and wait
 
-				dq.creationTime = RR->node->now();
-				dq.frags[fno - 1] = fragment;
-				dq.totalFragments = tf; // total fragment count is known
-				dq.haveFragments = 1 << fno; // we have only this fragment
+				const uint64_t now = RR->node->now();
+				_expireDefragEntries(ds,now);
+				const uint32_t fb = ds.arena.store(b + ZT_PACKET_FRAGMENT_IDX_PAYLOAD,plen);
+				if (fb == 0xffffffff) {
+					TRACE("dropped fragment (%u/%u) of %.16llx from %s: reassembly queue full",fno + 1,tf,pid,fromAddr.toString().c_str());
+					return;
+				}
+				dq = &(ds.queue[pid]);
+				dq->creationTime = now;
+				dq->fragBlock[fno - 1] = fb;
+				dq->fragLength[fno - 1] = plen;
+				dq->totalFragments = tf; // total fragment count is known
+				dq->haveFragments = 1 << fno; // we have only this fragment
+				ds.expiry.push_back(std::pair<uint64_t,uint64_t>(now,pid));
 				//TRACE("fragment (%u/%u) of %.16llx from %s",fno + 1,tf,pid,fromAddr.toString().c_str());
-			} else if (!(dq.haveFragments & (1 << fno))) {
+			} else if (!(dq->haveFragments & (1 << fno))) {
 				// We have other fragments and maybe the head, so add this one and check
 
-				dq.frags[fno - 1] = fragment;
-				dq.totalFragments = tf;
+				const uint32_t fb = ds.arena.store(b + ZT_PACKET_FRAGMENT_IDX_PAYLOAD,plen);
+				if (fb == 0xffffffff) {
+					TRACE("dropped fragment (%u/%u) of %.16llx from %s: reassembly queue full",fno + 1,tf,pid,fromAddr.toString().c_str());
+					return;
+				}
+				dq->fragBlock[fno - 1] = fb;
+				dq->fragLength[fno - 1] = plen;
+				dq->totalFragments = tf;
 				//TRACE("fragment (%u/%u) of %.16llx from %s",fno + 1,tf,pid,fromAddr.toString().c_str());
 
-				if (Utils::countBits(dq.haveFragments |= (1 << fno)) == tf) {
+				dq->haveFragments |= 1 << fno;
+				if (dq->complete()) {
 					// We have all fragments -- assemble and process full Packet
 					//TRACE("packet %.16llx is complete, assembling and processing...",pid);
 
-					SharedPtr<IncomingPacket> packet(dq.frag0);
-					for(unsigned int f=1;f<tf;++f)
-						packet->append(dq.frags[f - 1].payload(),dq.frags[f - 1].payloadLength());
-					_defragQueue.erase(pid); // dq no longer valid after this
+					SharedPtr<IncomingPacket> packet(dq->frag0);
+					bool ok = true;
+					for(unsigned int f=1;((ok)&&(f<tf));++f)
+						ok = ds.arena.appendTo(*packet,dq->fragBlock[f - 1],dq->fragLength[f - 1]);
+					_eraseDefragEntry(ds,pid,*dq); // dq no longer valid after this
 
-					if (!packet->tryDecode(RR,false)) {
-						Mutex::Lock _l(_rxQueue_m);
-						_rxQueue.push_back(packet);
-					}
+					if ((ok)&&(!packet->tryDecode(RR,false)))
+						_enqueueRx(packet);
 				}
 			} // else this is a duplicate fragment, ignore
 		}
 	}
 }
 
-void Switch::_handleRemotePacketHead(const InetAddress &localAddr,const InetAddress &fromAddr,const void *data,unsigned int len)
+void Switch::_handleRemotePacketHead(const InetAddress &localAddr,const InetAddress &fromAddr,void *data,unsigned int len)
 {
 	const uint64_t now = RR->node->now();
-	SharedPtr<IncomingPacket> packet(new IncomingPacket(data,len,localAddr,fromAddr,now));
+	unsigned char *const b = reinterpret_cast<unsigned char *>(data);
 
-	Address source(packet->source());
-	Address destination(packet->destination());
+	const Address source(b + ZT_PACKET_IDX_SOURCE,ZT_ADDRESS_LENGTH);
+	const Address destination(b + ZT_PACKET_IDX_DEST,ZT_ADDRESS_LENGTH);
 
 	// Catch this and toss it -- it would never work, but it could happen if we somehow
 	// mistakenly guessed an address we're bound to as a destination for another peer.
@@ -700,12 +832,17 @@ void Switch::_handleRemotePacketHead(const InetAddress &localAddr,const InetAddr
 	//TRACE("<< %.16llx %s -> %s (size: %u)",(unsigned long long)packet->packetId(),source.toString().c_str(),destination.toString().c_str(),packet->size());
 
 	if (destination != RR->identity.address()) {
-		// Packet is not for us, so try to relay it
-		if (packet->hops() < ZT_RELAY_MAX_HOPS) {
-			packet->incrementHops();
+		// Packet is not for us, so try to relay it. Everything we need is in
+		// the header, so it's forwarded straight from the receive buffer.
+		if ((len < ZT_PROTO_MIN_PACKET_LENGTH)||(len > ZT_PROTO_MAX_PACKET_LENGTH)) {
+			TRACE("dropped relay %s(%s) -> %s, invalid length %u",source.toString().c_str(),fromAddr.toString().c_str(),destination.toString().c_str(),len);
+			return;
+		}
+		if ((b[ZT_PACKET_IDX_FLAGS] & 0x07) < ZT_RELAY_MAX_HOPS) {
+			b[ZT_PACKET_IDX_FLAGS] = (b[ZT_PACKET_IDX_FLAGS] & 0xf8) | ((b[ZT_PACKET_IDX_FLAGS] + 1) & 0x07);
 
 			SharedPtr<Peer> relayTo = RR->topology->getPeer(destination);
-			if ((relayTo)&&((relayTo->send(RR,packet->data(),packet->size(),now)))) {
+			if ((relayTo)&&((relayTo->send(RR,data,len,now)))) {
 				Mutex::Lock _l(_lastUniteAttempt_m);
 				uint64_t &luts = _lastUniteAttempt[_LastUniteKey(source,destination)];
 				if ((now - luts) >= ZT_MIN_UNITE_INTERVAL) {
@@ -723,61 +860,196 @@ void Switch::_handleRemotePacketHead(const InetAddress &localAddr,const InetAddr
 						if (shouldUnite)
 							luts = now;
 					}
-					RR->cluster->sendViaCluster(source,destination,packet->data(),packet->size(),shouldUnite);
+					RR->cluster->sendViaCluster(source,destination,data,len,shouldUnite);
 					return;
 				}
 #endif
 
 				relayTo = RR->topology->getBestRoot(&source,1,true);
 				if (relayTo)
-					relayTo->send(RR,packet->data(),packet->size(),now);
+					relayTo->send(RR,data,len,now);
 			}
 		} else {
-			TRACE("dropped relay %s(%s) -> %s, max hops exceeded",packet->source().toString().c_str(),fromAddr.toString().c_str(),destination.toString().c_str());
+			TRACE("dropped relay %s(%s) -> %s, max hops exceeded",source.toString().c_str(),fromAddr.toString().c_str(),destination.toString().c_str());
 		}
-	} else if (packet->fragmented()) {
+		return;
+	}
+
+	SharedPtr<IncomingPacket> packet(new IncomingPacket(data,len,localAddr,fromAddr,now));
+
+	if (packet->fragmented()) {
 		// Packet is the head of a fragmented packet series
 
-		uint64_t pid = packet->packetId();
-		Mutex::Lock _l(_defragQueue_m);
-		DefragQueueEntry &dq = _defragQueue[pid];
+		const uint64_t pid = packet->packetId();
+		_DefragShard &ds = _defragShard(pid);
+		Mutex::Lock _l(ds.lock);
+		DefragQueueEntry *dq = ds.queue.get(pid);
 
-		if (!dq.creationTime) {
+		if (!dq) {
 			// If we have no other fragments yet, create an entry and save the head
 
-			dq.creationTime = now;
-			dq.frag0 = packet;
-			dq.totalFragments = 0; // 0 == unknown, waiting for Packet::Fragment
-			dq.haveFragments = 1; // head is first bit (left to right)
+			_expireDefragEntries(ds,now);
+			dq = &(ds.queue[pid]);
+			dq->creationTime = now;
+			dq->frag0 = packet;
+			dq->totalFragments = 0; // 0 == unknown, waiting for Packet::Fragment
+			dq->haveFragments = 1; // head is first bit (left to right)
+			ds.expiry.push_back(std::pair<uint64_t,uint64_t>(now,pid));
 			//TRACE("fragment (0/?) of %.16llx from %s",pid,fromAddr.toString().c_str());
-		} else if (!(dq.haveFragments & 1)) {
+		} else if (!(dq->haveFragments & 1)) {
 			// If we have other fragments but no head, see if we are complete with the head
 
-			if ((dq.totalFragments)&&(Utils::countBits(dq.haveFragments |= 1) == dq.totalFragments)) {
+			dq->haveFragments |= 1;
+			if (dq->complete()) {
 				// We have all fragments -- assemble and process full Packet
 
 				//TRACE("packet %.16llx is complete, assembling and processing...",pid);
 				// packet already contains head, so append fragments
-				for(unsigned int f=1;f<dq.totalFragments;++f)
-					packet->append(dq.frags[f - 1].payload(),dq.frags[f - 1].payloadLength());
-				_defragQueue.erase(pid); // dq no longer valid after this
+				bool ok = true;
+				for(unsigned int f=1;((ok)&&(f<dq->totalFragments));++f)
+					ok = ds.arena.appendTo(*packet,dq->fragBlock[f - 1],dq->fragLength[f - 1]);
+				_eraseDefragEntry(ds,pid,*dq); // dq no longer valid after this
 
-				if (!packet->tryDecode(RR,false)) {
-					Mutex::Lock _l(_rxQueue_m);
-					_rxQueue.push_back(packet);
-				}
+				if ((ok)&&(!packet->tryDecode(RR,false)))
+					_enqueueRx(packet);
 			} else {
 				// Still waiting on more fragments, so queue the head
-				dq.frag0 = packet;
+				dq->frag0 = packet;
 			}
 		} // else this is a duplicate head, ignore
+	} else if (_rxStagingEnabled) {
+		// Packet is unfragmented, so hold it for a batch dearmor
+		bool full;
+		{
+			Mutex::Lock _l(_rxStaged_m);
+			_rxStaged.push_back(packet);
+			full = (_rxStaged.size() >= ZT_PACKET_DEARMOR_BATCH_MAX);
+		}
+		if (full)
+			flushStagedPackets();
 	} else {
 		// Packet is unfragmented, so just process it
-		if (!packet->tryDecode(RR,false)) {
-			Mutex::Lock _l(_rxQueue_m);
-			_rxQueue.push_back(packet);
+		if (!packet->tryDecode(RR,false))
+			_enqueueRx(packet);
+	}
+}
+
+void Switch::_eraseDefragEntry(_DefragShard &ds,uint64_t packetId,DefragQueueEntry &dq)
+{
+	for(unsigned int f=1;f<ZT_MAX_PACKET_FRAGMENTS;++f) {
+		if (((dq.haveFragments & (1 << f)) != 0)&&(dq.fragBlock[f - 1] != 0xffffffff))
+			ds.arena.release(dq.fragBlock[f - 1]);
+	}
+	ds.queue.erase(packetId);
+}
+
+unsigned long Switch::_expireDefragEntries(_DefragShard &ds,uint64_t now)
+{
+	while (!ds.expiry.empty()) {
+		const std::pair<uint64_t,uint64_t> &e = ds.expiry.front();
+		const unsigned long age = (unsigned long)(now - e.first);
+		if (age <= ZT_FRAGMENTED_PACKET_RECEIVE_TIMEOUT)
+			return ((unsigned long)ZT_FRAGMENTED_PACKET_RECEIVE_TIMEOUT - age) + 1;
+
+		// Entries that completed are already gone, and a packet ID seen again
+		// later gets a new record further back, so check the creation time
+		DefragQueueEntry *const dq = ds.queue.get(e.second);
+		if ((dq)&&(dq->creationTime == e.first)) {
+			TRACE("incomplete fragmented packet %.16llx timed out, fragments discarded",e.second);
+			_eraseDefragEntry(ds,e.second,*dq);
+		}
+		ds.expiry.pop_front();
+	}
+	return 0xffffffff;
+}
+
+uint32_t Switch::_DefragArena::store(const void *d,unsigned int len)
+{
+	const unsigned long blocks = (len + (ZT_DEFRAG_ARENA_BLOCK_SIZE - 1)) / ZT_DEFRAG_ARENA_BLOCK_SIZE;
+	if (!blocks)
+		return 0xffffffff;
+
+	if (blocksFree < blocks) {
+		const unsigned long have = (unsigned long)next.size();
+		unsigned long grow = std::max(blocks - blocksFree,std::max(have,(unsigned long)16));
+		if ((have + grow) > (ZT_DEFRAG_ARENA_MAX_BYTES / ZT_DEFRAG_ARENA_BLOCK_SIZE))
+			grow = (ZT_DEFRAG_ARENA_MAX_BYTES / ZT_DEFRAG_ARENA_BLOCK_SIZE) - have;
+		if ((blocksFree + grow) < blocks)
+			return 0xffffffff;
+		data.resize((have + grow) * ZT_DEFRAG_ARENA_BLOCK_SIZE);
+		next.resize(have + grow);
+		for(unsigned long i=have+grow;i>have;--i) {
+			next[i - 1] = freeHead;
+			freeHead = (uint32_t)(i - 1);
 		}
+		blocksFree += grow;
+	}
+
+	// Take blocks off the free list, filling each as we go
+	const uint32_t first = freeHead;
+	const unsigned char *p = reinterpret_cast<const unsigned char *>(d);
+	uint32_t blk = first;
+	for(unsigned long i=0;i<blocks;++i) {
+		const unsigned int n = std::min(len,(unsigned int)ZT_DEFRAG_ARENA_BLOCK_SIZE);
+		memcpy(&(data[(unsigned long)blk * ZT_DEFRAG_ARENA_BLOCK_SIZE]),p,n);
+		p += n;
+		len -= n;
+		if ((i + 1) == blocks) {
+			freeHead = next[blk];
+			next[blk] = 0xffffffff;
+		} else blk = next[blk];
+	}
+	blocksFree -= blocks;
+
+	return first;
+}
+
+bool Switch::_DefragArena::appendTo(IncomingPacket &packet,uint32_t first,unsigned int len) const
+{
+	if (first == 0xffffffff)
+		return false;
+	for(uint32_t blk=first;((blk != 0xffffffff)&&(len));blk=next[blk]) {
+		const unsigned int n = std::min(len,(unsigned int)ZT_DEFRAG_ARENA_BLOCK_SIZE);
+		packet.append(&(data[(unsigned long)blk * ZT_DEFRAG_ARENA_BLOCK_SIZE]),n);
+		len -= n;
+	}
+	return true;
+}
+
+void Switch::_DefragArena::release(uint32_t first)
+{
+	uint32_t blk = first;
+	for(;;) {
+		++blocksFree;
+		if (next[blk] == 0xffffffff)
+			break;
+		blk = next[blk];
+	}
+	next[blk] = freeHead;
+	freeHead = first;
+}
+
+void Switch::_enqueueRx(const SharedPtr<IncomingPacket> &packet)
+{
+	Mutex::Lock _l(_rxQueue_m);
+	_rxQueueWaiting[packet->waitingFor()].push_back(_rxQueue.insert(_RXQueue::value_type(packet->receiveTime(),packet)));
+}
+
+void Switch::_enqueueTx(const Packet &packet,bool encrypt,uint64_t nwid)
+{
+	Mutex::Lock _l(_txQueue_m);
+	_txQueueByDest[packet.destination()].push_back(_txQueue.insert(_TXQueue::value_type(RR->node->now(),TXQueueEntry(packet.destination(),packet,encrypt,nwid))));
+}
+
+void Switch::_retryTx(std::vector<_TXQueue::iterator> &entries)
+{
+	std::vector<_TXQueue::iterator>::iterator keep(entries.begin());
+	for(std::vector<_TXQueue::iterator>::iterator txi(entries.begin());txi!=entries.end();++txi) {
+		if (_trySend((*txi)->second.packet,(*txi)->second.encrypt,(*txi)->second.nwid))
+			_txQueue.erase(*txi);
+		else *(keep++) = *txi;
 	}
+	entries.erase(keep,entries.end());
 }
 
 Address Switch::_sendWhoisRequest(const Address &addr,const Address *peersAlreadyConsulted,unsigned int numPeersAlreadyConsulted)
@@ -795,83 +1067,94 @@ Address Switch::_sendWhoisRequest(const Address &addr,const Address *peersAlread
 
 bool Switch::_trySend(const Packet &packet,bool encrypt,uint64_t nwid)
 {
-	SharedPtr<Peer> peer(RR->topology->getPeer(packet.destination()));
-
-	if (peer) {
-		const uint64_t now = RR->node->now();
-
-		SharedPtr<Network> network;
-		SharedPtr<NetworkConfig> nconf;
-		if (nwid) {
-			network = RR->node->network(nwid);
-			if (!network)
-				return false; // we probably just left this network, let its packets die
-			nconf = network->config2();
-			if (!nconf)
-				return false; // sanity check: unconfigured network? why are we trying to talk to it?
-		}
+	const uint64_t now = RR->node->now();
+	SharedPtr<Peer> peer;
+	Path *const viaPath = _sendPath(packet,nwid,now,peer);
+	if (!viaPath)
+		return false;
+	Packet tmp(packet);
+	return _armorAndSend(tmp,peer,viaPath,encrypt,now);
+}
 
-		Path *viaPath = peer->getBestPath(now);
-		SharedPtr<Peer> relay;
-		if (!viaPath) {
-			// See if this network has a preferred relay (if packet has an associated network)
-			if (nconf) {
-				unsigned int bestq = ~((unsigned int)0);
-				for(std::vector< std::pair<Address,InetAddress> >::const_iterator r(nconf->relays().begin());r!=nconf->relays().end();++r) {
-					if (r->first != peer->address()) {
-						SharedPtr<Peer> rp(RR->topology->getPeer(r->first));
-						const unsigned int q = rp->relayQuality(now);
-						if ((rp)&&(q < bestq)) { // SUBTILE: < == don't use these if they are nil quality (unsigned int max), instead use a root
-							bestq = q;
-							rp.swap(relay);
-						}
+Path *Switch::_sendPath(const Packet &packet,uint64_t nwid,uint64_t now,SharedPtr<Peer> &peer)
+{
+	peer = RR->topology->getPeer(packet.destination());
+	if (!peer) {
+		requestWhois(packet.destination());
+		return (Path *)0;
+	}
+
+	SharedPtr<Network> network;
+	SharedPtr<NetworkConfig> nconf;
+	if (nwid) {
+		network = RR->node->network(nwid);
+		if (!network)
+			return (Path *)0; // we probably just left this network, let its packets die
+		nconf = network->config2();
+		if (!nconf)
+			return (Path *)0; // sanity check: unconfigured network? why are we trying to talk to it?
+	}
+
+	Path *viaPath = peer->getBestPath(now);
+	SharedPtr<Peer> relay;
+	if (!viaPath) {
+		// See if this network has a preferred relay (if packet has an associated network)
+		if (nconf) {
+			unsigned int bestq = ~((unsigned int)0);
+			for(std::vector< std::pair<Address,InetAddress> >::const_iterator r(nconf->relays().begin());r!=nconf->relays().end();++r) {
+				if (r->first != peer->address()) {
+					SharedPtr<Peer> rp(RR->topology->getPeer(r->first));
+					const unsigned int q = rp->relayQuality(now);
+					if ((rp)&&(q < bestq)) { // SUBTILE: < == don't use these if they are nil quality (unsigned int max), instead use a root
+						bestq = q;
+						rp.swap(relay);
 					}
 				}
 			}
+		}
 
-			// Otherwise relay off a root server
-			if (!relay)
-				relay = RR->topology->getBestRoot();
+		// Otherwise relay off a root server
+		if (!relay)
+			relay = RR->topology->getBestRoot();
 
-			if (!(relay)||(!(viaPath = relay->getBestPath(now))))
-				return false; // no paths, no root servers?
-		}
+		if (!(relay)||(!(viaPath = relay->getBestPath(now))))
+			return (Path *)0; // no paths, no root servers?
+	}
 
-		if ((network)&&(relay)&&(network->isAllowed(peer))) {
-			// Push hints for direct connectivity to this peer if we are relaying
-			peer->pushDirectPaths(RR,viaPath,now,false);
-		}
+	if ((network)&&(relay)&&(network->isAllowed(peer))) {
+		// Push hints for direct connectivity to this peer if we are relaying
+		peer->pushDirectPaths(RR,viaPath,now,false);
+	}
+	return viaPath;
+}
 
-		Packet tmp(packet);
-
-		unsigned int chunkSize = std::min(tmp.size(),(unsigned int)ZT_UDP_DEFAULT_PAYLOAD_MTU);
-		tmp.setFragmented(chunkSize < tmp.size());
-
-		tmp.armor(peer->key(),encrypt);
-
-		if (viaPath->send(RR,tmp.data(),chunkSize,now)) {
-			if (chunkSize < tmp.size()) {
-				// Too big for one packet, fragment the rest
-				unsigned int fragStart = chunkSize;
-				unsigned int remaining = tmp.size() - chunkSize;
-				unsigned int fragsRemaining = (remaining / (ZT_UDP_DEFAULT_PAYLOAD_MTU - ZT_PROTO_MIN_FRAGMENT_LENGTH));
-				if ((fragsRemaining * (ZT_UDP_DEFAULT_PAYLOAD_MTU - ZT_PROTO_MIN_FRAGMENT_LENGTH)) < remaining)
-					++fragsRemaining;
-				unsigned int totalFragments = fragsRemaining + 1;
-
-				for(unsigned int fno=1;fno<totalFragments;++fno) {
-					chunkSize = std::min(remaining,(unsigned int)(ZT_UDP_DEFAULT_PAYLOAD_MTU - ZT_PROTO_MIN_FRAGMENT_LENGTH));
-					Packet::Fragment frag(tmp,fragStart,chunkSize,fno,totalFragments);
-					viaPath->send(RR,frag.data(),frag.size(),now);
-					fragStart += chunkSize;
-					remaining -= chunkSize;
-				}
+bool Switch::_armorAndSend(Packet &packet,const SharedPtr<Peer> &peer,Path *viaPath,bool encrypt,uint64_t now)
+{
+	unsigned int chunkSize = std::min(packet.size(),(unsigned int)ZT_UDP_DEFAULT_PAYLOAD_MTU);
+	packet.setFragmented(chunkSize < packet.size());
+
+	packet.armor(peer->key(),encrypt,peer->aesGcm());
+
+	if (viaPath->send(RR,packet.data(),chunkSize,now)) {
+		if (chunkSize < packet.size()) {
+			// Too big for one packet, fragment the rest
+			unsigned int fragStart = chunkSize;
+			unsigned int remaining = packet.size() - chunkSize;
+			unsigned int fragsRemaining = (remaining / (ZT_UDP_DEFAULT_PAYLOAD_MTU - ZT_PROTO_MIN_FRAGMENT_LENGTH));
+			if ((fragsRemaining * (ZT_UDP_DEFAULT_PAYLOAD_MTU - ZT_PROTO_MIN_FRAGMENT_LENGTH)) < remaining)
+				++fragsRemaining;
+			unsigned int totalFragments = fragsRemaining + 1;
+
+			for(unsigned int fno=1;fno<totalFragments;++fno) {
+				chunkSize = std::min(remaining,(unsigned int)(ZT_UDP_DEFAULT_PAYLOAD_MTU - ZT_PROTO_MIN_FRAGMENT_LENGTH));
+				Packet::Fragment frag(packet,fragStart,chunkSize,fno,totalFragments);
+				viaPath->send(RR,frag.data(),frag.size(),now);
+				fragStart += chunkSize;
+				remaining -= chunkSize;
 			}
-
-			return true;
 		}
-	} else {
-		requestWhois(packet.destination());
+
+		return true;
 	}
 	return false;
 }
@@ -32,6 +32,7 @@
 #include <set>
 #include <vector>
 #include <list>
+#include <deque>
 
 #include "Constants.hpp"
 #include "Mutex.hpp"
@@ -79,12 +80,33 @@ public:
 	/**
 	 * Called when a packet is received from the real network
 	 *
+	 * Packets addressed to other nodes are relayed straight from the receive
+	 * buffer, so data may be modified in place (hop count).
+	 *
 	 * @param localAddr Local interface address
 	 * @param fromAddr Internet IP address of origin
-	 * @param data Packet data
+	 * @param data Packet data (may be modified)
 	 * @param len Packet length
 	 */
-	void onRemotePacket(const InetAddress &localAddr,const InetAddress &fromAddr,const void *data,unsigned int len);
+	void onRemotePacket(const InetAddress &localAddr,const InetAddress &fromAddr,void *data,unsigned int len);
+
+	/**
+	 * Enable or disable staging of received packets
+	 *
+	 * While staging is enabled, unfragmented packets from onRemotePacket()
+	 * are held until flushStagedPackets() (or until a full batch is waiting)
+	 * so they can be authenticated and decrypted together. The caller should
+	 * then flush after each batch of received datagrams, e.g. after each
+	 * poll cycle. Disabling staging flushes anything still waiting.
+	 *
+	 * @param enabled If true, stage packets instead of decoding immediately
+	 */
+	void setRxStaging(bool enabled);
+
+	/**
+	 * Dearmor and decode all staged received packets
+	 */
+	void flushStagedPackets();
 
 	/**
 	 * Called when a packet comes from a local Ethernet tap
@@ -121,6 +143,22 @@ public:
 	 */
 	void send(const Packet &packet,bool encrypt,uint64_t nwid);
 
+	/**
+	 * Send a packet that the caller is done with, without copying it
+	 *
+	 * This is like send() but once a path is found the packet is armored
+	 * (and fragmented from) in place, so its contents are undefined after
+	 * this returns. It is only copied if it has to wait in the TX queue.
+	 * A send that fails after armoring is dropped rather than queued, so
+	 * this is for frames from the local tap, whose loss the protocols
+	 * above recover from like any other lost datagram.
+	 *
+	 * @param packet Packet to send (contents undefined after call)
+	 * @param encrypt Encrypt packet payload? (always true except for HELLO)
+	 * @param nwid Related network ID or 0 if message is not in-network traffic
+	 */
+	void sendInPlace(Packet &packet,bool encrypt,uint64_t nwid);
+
 	/**
 	 * Send RENDEZVOUS to two peers to permit them to directly connect
 	 *
@@ -175,11 +213,28 @@ public:
 	 */
 	unsigned long doTimerTasks(uint64_t now);
 
+	/**
+	 * Get the depth and age of the queues of packets waiting on peers
+	 *
+	 * @param now Current time
+	 * @param txPackets Result parameter: outgoing packets waiting to be sent
+	 * @param txPeers Result parameter: distinct destinations they're waiting on
+	 * @param txOldest Result parameter: age of oldest outgoing packet in ms (0 if none)
+	 * @param rxPackets Result parameter: incoming packets waiting to be decoded
+	 * @param rxPeers Result parameter: distinct identities they're waiting on
+	 * @param rxOldest Result parameter: age of oldest incoming packet in ms (0 if none)
+	 */
+	void queueStats(uint64_t now,unsigned long &txPackets,unsigned long &txPeers,uint64_t &txOldest,unsigned long &rxPackets,unsigned long &rxPeers,uint64_t &rxOldest);
+
 private:
-	void _handleRemotePacketFragment(const InetAddress &localAddr,const InetAddress &fromAddr,const void *data,unsigned int len);
-	void _handleRemotePacketHead(const InetAddress &localAddr,const InetAddress &fromAddr,const void *data,unsigned int len);
+	void _handleRemotePacketFragment(const InetAddress &localAddr,const InetAddress &fromAddr,void *data,unsigned int len);
+	void _handleRemotePacketHead(const InetAddress &localAddr,const InetAddress &fromAddr,void *data,unsigned int len);
 	Address _sendWhoisRequest(const Address &addr,const Address *peersAlreadyConsulted,unsigned int numPeersAlreadyConsulted);
 	bool _trySend(const Packet &packet,bool encrypt,uint64_t nwid);
+	Path *_sendPath(const Packet &packet,uint64_t nwid,uint64_t now,SharedPtr<Peer> &peer); // NULL if packet can't be sent yet
+	bool _armorAndSend(Packet &packet,const SharedPtr<Peer> &peer,Path *viaPath,bool encrypt,uint64_t now); // armors in place
+	void _enqueueRx(const SharedPtr<IncomingPacket> &packet); // queue a packet tryDecode() returned false for
+	void _enqueueTx(const Packet &packet,bool encrypt,uint64_t nwid);
 
 	const RuntimeEnvironment *const RR;
 	uint64_t _lastBeaconResponse;
@@ -195,43 +250,104 @@ private:
 	Hashtable< Address,WhoisRequest > _outstandingWhoisRequests;
 	Mutex _outstandingWhoisRequests_m;
 
+	/* Fragment payloads awaiting reassembly are stored in fixed-size blocks
+	 * chained together by index, so an entry only takes up about as much
+	 * memory as the fragments it has actually received. Blocks are reused
+	 * through a free list and the arena never shrinks. */
+	struct _DefragArena
+	{
+		_DefragArena() : freeHead(0xffffffff),blocksFree(0) {}
+
+		// Returns first block of stored data, or 0xffffffff if arena is full
+		uint32_t store(const void *data,unsigned int len);
+		bool appendTo(IncomingPacket &packet,uint32_t first,unsigned int len) const; // false if first is 0xffffffff
+		void release(uint32_t first);
+
+		std::vector<unsigned char> data; // ZT_DEFRAG_ARENA_BLOCK_SIZE bytes per block
+		std::vector<uint32_t> next; // next block in chain (or in free list), 0xffffffff for none
+		uint32_t freeHead;
+		unsigned long blocksFree;
+	};
+
 	// Packet defragmentation queue -- comes before RX queue in path
 	struct DefragQueueEntry
 	{
-		DefragQueueEntry() : creationTime(0),totalFragments(0),haveFragments(0) {}
+		DefragQueueEntry() : creationTime(0),totalFragments(0),haveFragments(0)
+		{
+			for(unsigned int i=0;i<(ZT_MAX_PACKET_FRAGMENTS - 1);++i) {
+				fragBlock[i] = 0xffffffff;
+				fragLength[i] = 0;
+			}
+		}
 		uint64_t creationTime;
 		SharedPtr<IncomingPacket> frag0;
-		Packet::Fragment frags[ZT_MAX_PACKET_FRAGMENTS - 1];
+		uint32_t fragBlock[ZT_MAX_PACKET_FRAGMENTS - 1]; // first arena block of each fragment's payload
+		unsigned int fragLength[ZT_MAX_PACKET_FRAGMENTS - 1];
 		unsigned int totalFragments; // 0 if only frag0 received, waiting for frags
 		uint32_t haveFragments; // bit mask, LSB to MSB
+
+		// All of fragments 0..totalFragments-1 and nothing else (a mere bit count could be fooled by fragment numbers past the end)
+		inline bool complete() const throw() { return ((totalFragments)&&(haveFragments == ((1U << totalFragments) - 1))); }
 	};
-	Hashtable< uint64_t,DefragQueueEntry > _defragQueue;
-	Mutex _defragQueue_m;
 
-	// ZeroTier-layer RX queue of incoming packets in the process of being decoded
-	std::list< SharedPtr<IncomingPacket> > _rxQueue;
+	/* The reassembly queue is split into shards by packet ID, each with its
+	 * own lock and arena. Entries are also recorded in creation order so
+	 * expired ones can be found from the front without scanning the table. */
+	struct _DefragShard
+	{
+		_DefragShard() : queue(8) {}
+		Hashtable< uint64_t,DefragQueueEntry > queue;
+		std::deque< std::pair<uint64_t,uint64_t> > expiry; // creation time, packet ID
+		_DefragArena arena;
+		Mutex lock;
+	};
+
+	inline _DefragShard &_defragShard(const uint64_t packetId)
+	{
+		return _defragShards[(unsigned int)((packetId * 0x9e3779b97f4a7c15ULL) >> 56) & (ZT_DEFRAG_QUEUE_SHARDS - 1)];
+	}
+
+	void _eraseDefragEntry(_DefragShard &ds,uint64_t packetId,DefragQueueEntry &dq); // lock must be held, dq invalid after
+	unsigned long _expireDefragEntries(_DefragShard &ds,uint64_t now); // lock must be held, returns ms until next expiry
+
+	_DefragShard _defragShards[ZT_DEFRAG_QUEUE_SHARDS];
+
+	/* ZeroTier-layer RX queue of incoming packets waiting on a peer's identity.
+	 * Packets are kept in order of receipt so timeouts can be taken from the
+	 * front, and indexed by the address they're waiting for so a peer's
+	 * arrival only touches its own packets. */
+	typedef std::multimap< uint64_t,SharedPtr<IncomingPacket> > _RXQueue; // by receive time
+	_RXQueue _rxQueue;
+	Hashtable< Address,std::vector<_RXQueue::iterator> > _rxQueueWaiting;
 	Mutex _rxQueue_m;
 
+	// Received packets waiting for a batch dearmor, see setRxStaging()
+	std::vector< SharedPtr<IncomingPacket> > _rxStaged;
+	Mutex _rxStaged_m;
+	volatile bool _rxStagingEnabled;
+
 	// ZeroTier-layer TX queue entry
 	struct TXQueueEntry
 	{
 		TXQueueEntry() {}
-		TXQueueEntry(Address d,uint64_t ct,const Packet &p,bool enc,uint64_t nw) :
+		TXQueueEntry(Address d,const Packet &p,bool enc,uint64_t nw) :
 			dest(d),
-			creationTime(ct),
 			nwid(nw),
 			packet(p),
 			encrypt(enc) {}
 
 		Address dest;
-		uint64_t creationTime;
 		uint64_t nwid;
 		Packet packet; // unencrypted/unMAC'd packet -- this is done at send time
 		bool encrypt;
 	};
-	std::list< TXQueueEntry > _txQueue;
+	typedef std::multimap< uint64_t,TXQueueEntry > _TXQueue; // by creation time, indexed by destination like the RX queue
+	_TXQueue _txQueue;
+	Hashtable< Address,std::vector<_TXQueue::iterator> > _txQueueByDest;
 	Mutex _txQueue_m;
 
+	void _retryTx(std::vector<_TXQueue::iterator> &entries); // _txQueue_m must be held, entries that get sent are removed
+
 	// Tracks sending of VERB_RENDEZVOUS to relaying peers
 	struct _LastUniteKey
 	{
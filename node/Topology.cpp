@@ -63,7 +63,7 @@ Topology::Topology(const RuntimeEnvironment *renv) :
 			if (!p)
 				break; // stop if invalid records
 			if (p->address() != RR->identity.address())
-				_peers.set(p->address(),p);
+				_shard(p->address()).peers.set(p->address(),p);
 		} catch ( ... ) {
 			break; // stop if invalid records
 		}
@@ -101,20 +101,22 @@ Topology::~Topology()
 		pbuf = new Buffer<ZT_PEER_SUGGESTED_SERIALIZATION_BUFFER_SIZE>();
 		std::string all;
 
-		Address *a = (Address *)0;
-		SharedPtr<Peer> *p = (SharedPtr<Peer> *)0;
-		Hashtable< Address,SharedPtr<Peer> >::Iterator i(_peers);
-		while (i.next(a,p)) {
-			if (std::find(_rootAddresses.begin(),_rootAddresses.end(),*a) == _rootAddresses.end()) {
-				pbuf->clear();
-				try {
-					(*p)->serialize(*pbuf);
+		for(unsigned int s=0;s<ZT_TOPOLOGY_PEER_SHARDS;++s) {
+			Address *a = (Address *)0;
+			SharedPtr<Peer> *p = (SharedPtr<Peer> *)0;
+			Hashtable< Address,SharedPtr<Peer> >::Iterator i(_peerShards[s].peers);
+			while (i.next(a,p)) {
+				if (std::find(_rootAddresses.begin(),_rootAddresses.end(),*a) == _rootAddresses.end()) {
+					pbuf->clear();
 					try {
-						all.append((const char *)pbuf->data(),pbuf->size());
-					} catch ( ... ) {
-						return; // out of memory? just skip
-					}
-				} catch ( ... ) {} // peer too big? shouldn't happen, but it so skip
+						(*p)->serialize(*pbuf);
+						try {
+							all.append((const char *)pbuf->data(),pbuf->size());
+						} catch ( ... ) {
+							return; // out of memory? just skip
+						}
+					} catch ( ... ) {} // peer too big? shouldn't happen, but it so skip
+				}
 			}
 		}
 
@@ -139,8 +141,9 @@ SharedPtr<Peer> Topology::addPeer(const SharedPtr<Peer> &peer)
 
 	SharedPtr<Peer> np;
 	{
-		Mutex::Lock _l(_lock);
-		SharedPtr<Peer> &hp = _peers[peer->address()];
+		_PeerShard &s = _shard(peer->address());
+		Mutex::Lock _l(s.lock);
+		SharedPtr<Peer> &hp = s.peers[peer->address()];
 		if (!hp)
 			hp = peer;
 		np = hp;
@@ -159,9 +162,10 @@ SharedPtr<Peer> Topology::getPeer(const Address &zta)
 		return SharedPtr<Peer>();
 	}
 
+	_PeerShard &s = _shard(zta);
 	{
-		Mutex::Lock _l(_lock);
-		const SharedPtr<Peer> *const ap = _peers.get(zta);
+		Mutex::Lock _l(s.lock);
+		const SharedPtr<Peer> *const ap = s.peers.get(zta);
 		if (ap) {
 			(*ap)->use(RR->node->now());
 			return *ap;
@@ -173,8 +177,8 @@ SharedPtr<Peer> Topology::getPeer(const Address &zta)
 		if (id) {
 			SharedPtr<Peer> np(new Peer(RR->identity,id));
 			{
-				Mutex::Lock _l(_lock);
-				SharedPtr<Peer> &ap = _peers[zta];
+				Mutex::Lock _l(s.lock);
+				SharedPtr<Peer> &ap = s.peers[zta];
 				if (!ap)
 					ap.swap(np);
 				ap->use(RR->node->now());
@@ -192,8 +196,9 @@ SharedPtr<Peer> Topology::getPeer(const Address &zta)
 Identity Topology::getIdentity(const Address &zta)
 {
 	{
-		Mutex::Lock _l(_lock);
-		const SharedPtr<Peer> *const ap = _peers.get(zta);
+		_PeerShard &s = _shard(zta);
+		Mutex::Lock _l(s.lock);
+		const SharedPtr<Peer> *const ap = s.peers.get(zta);
 		if (ap)
 			return (*ap)->identity();
 	}
@@ -223,7 +228,10 @@ SharedPtr<Peer> Topology::getBestRoot(const Address *avoid,unsigned int avoidCou
 		for(unsigned long p=0;p<_rootAddresses.size();++p) {
 			if (_rootAddresses[p] == RR->identity.address()) {
 				for(unsigned long q=1;q<_rootAddresses.size();++q) {
-					const SharedPtr<Peer> *const nextsn = _peers.get(_rootAddresses[(p + q) % _rootAddresses.size()]);
+					const Address &nextAddr = _rootAddresses[(p + q) % _rootAddresses.size()];
+					_PeerShard &s = _shard(nextAddr);
+					Mutex::Lock _l2(s.lock);
+					const SharedPtr<Peer> *const nextsn = s.peers.get(nextAddr);
 					if ((nextsn)&&((*nextsn)->hasActiveDirectPath(now))) {
 						(*nextsn)->use(now);
 						return *nextsn;
@@ -310,15 +318,24 @@ bool Topology::worldUpdateIfValid(const World &newWorld)
 
 void Topology::clean(uint64_t now)
 {
-	Mutex::Lock _l(_lock);
-	Hashtable< Address,SharedPtr<Peer> >::Iterator i(_peers);
-	Address *a = (Address *)0;
-	SharedPtr<Peer> *p = (SharedPtr<Peer> *)0;
-	while (i.next(a,p)) {
-		if (((now - (*p)->lastUsed()) >= ZT_PEER_IN_MEMORY_EXPIRATION)&&(std::find(_rootAddresses.begin(),_rootAddresses.end(),*a) == _rootAddresses.end())) {
-			_peers.erase(*a);
-		} else {
-			(*p)->clean(RR,now);
+	std::vector<Address> rootAddresses;
+	{
+		Mutex::Lock _l(_lock);
+		rootAddresses = _rootAddresses;
+	}
+
+	// One shard at a time, so lookups in other shards proceed during the sweep
+	for(unsigned int s=0;s<ZT_TOPOLOGY_PEER_SHARDS;++s) {
+		Mutex::Lock _l(_peerShards[s].lock);
+		Hashtable< Address,SharedPtr<Peer> >::Iterator i(_peerShards[s].peers);
+		Address *a = (Address *)0;
+		SharedPtr<Peer> *p = (SharedPtr<Peer> *)0;
+		while (i.next(a,p)) {
+			if (((now - (*p)->lastUsed()) >= ZT_PEER_IN_MEMORY_EXPIRATION)&&(std::find(rootAddresses.begin(),rootAddresses.end(),*a) == rootAddresses.end())) {
+				_peerShards[s].peers.erase(*a);
+			} else {
+				(*p)->clean(RR,now);
+			}
 		}
 	}
 }
@@ -348,12 +365,14 @@ void Topology::_setWorld(const World &newWorld)
 		if (r->identity.address() == RR->identity.address()) {
 			_amRoot = true;
 		} else {
-			SharedPtr<Peer> *rp = _peers.get(r->identity.address());
+			_PeerShard &s = _shard(r->identity.address());
+			Mutex::Lock _l(s.lock);
+			SharedPtr<Peer> *rp = s.peers.get(r->identity.address());
 			if (rp) {
 				_rootPeers.push_back(*rp);
 			} else {
 				SharedPtr<Peer> newrp(new Peer(RR->identity,r->identity));
-				_peers.set(r->identity.address(),newrp);
+				s.peers.set(r->identity.address(),newrp);
 				_rootPeers.push_back(newrp);
 			}
 		}
@@ -90,8 +90,9 @@ public:
 	 */
 	inline SharedPtr<Peer> getPeerNoCache(const Address &zta)
 	{
-		Mutex::Lock _l(_lock);
-		const SharedPtr<Peer> *const ap = _peers.get(zta);
+		_PeerShard &s = _shard(zta);
+		Mutex::Lock _l(s.lock);
+		const SharedPtr<Peer> *const ap = s.peers.get(zta);
 		if (ap)
 			return *ap;
 		return SharedPtr<Peer>();
@@ -206,12 +207,28 @@ public:
 	inline unsigned long countActive(uint64_t now) const
 	{
 		unsigned long cnt = 0;
-		Mutex::Lock _l(_lock);
-		Hashtable< Address,SharedPtr<Peer> >::Iterator i(const_cast<Topology *>(this)->_peers);
-		Address *a = (Address *)0;
-		SharedPtr<Peer> *p = (SharedPtr<Peer> *)0;
-		while (i.next(a,p)) {
-			cnt += (unsigned long)((*p)->hasActiveDirectPath(now));
+		for(unsigned int s=0;s<ZT_TOPOLOGY_PEER_SHARDS;++s) {
+			_PeerShard &ps = const_cast<Topology *>(this)->_peerShards[s];
+			Mutex::Lock _l(ps.lock);
+			Hashtable< Address,SharedPtr<Peer> >::Iterator i(ps.peers);
+			Address *a = (Address *)0;
+			SharedPtr<Peer> *p = (SharedPtr<Peer> *)0;
+			while (i.next(a,p)) {
+				cnt += (unsigned long)((*p)->hasActiveDirectPath(now));
+			}
+		}
+		return cnt;
+	}
+
+	/**
+	 * @return Number of peers in memory
+	 */
+	inline unsigned long countPeers() const
+	{
+		unsigned long cnt = 0;
+		for(unsigned int s=0;s<ZT_TOPOLOGY_PEER_SHARDS;++s) {
+			Mutex::Lock _l(_peerShards[s].lock);
+			cnt += _peerShards[s].peers.size();
 		}
 		return cnt;
 	}
@@ -223,8 +240,9 @@ public:
 	 * passed by reference instead of copied.
 	 *
 	 * Warning: be careful not to use features in these that call any other
-	 * methods of Topology that may lock _lock, otherwise a recursive lock
-	 * and deadlock or lock corruption may occur.
+	 * methods of Topology, otherwise a recursive lock and deadlock or lock
+	 * corruption may occur. Peers are visited one shard at a time with that
+	 * shard's lock held.
 	 *
 	 * @param f Function to apply
 	 * @tparam F Function or function object type
@@ -232,18 +250,20 @@ public:
 	template<typename F>
 	inline void eachPeer(F f)
 	{
-		Mutex::Lock _l(_lock);
-		Hashtable< Address,SharedPtr<Peer> >::Iterator i(_peers);
-		Address *a = (Address *)0;
-		SharedPtr<Peer> *p = (SharedPtr<Peer> *)0;
-		while (i.next(a,p)) {
+		for(unsigned int s=0;s<ZT_TOPOLOGY_PEER_SHARDS;++s) {
+			Mutex::Lock _l(_peerShards[s].lock);
+			Hashtable< Address,SharedPtr<Peer> >::Iterator i(_peerShards[s].peers);
+			Address *a = (Address *)0;
+			SharedPtr<Peer> *p = (SharedPtr<Peer> *)0;
+			while (i.next(a,p)) {
 #ifdef ZT_TRACE
-			if (!(*p)) {
-				fprintf(stderr,"FATAL BUG: eachPeer() caught NULL peer for %s -- peer pointers in Topology should NEVER be NULL" ZT_EOL_S,a->toString().c_str());
-				abort();
-			}
+				if (!(*p)) {
+					fprintf(stderr,"FATAL BUG: eachPeer() caught NULL peer for %s -- peer pointers in Topology should NEVER be NULL" ZT_EOL_S,a->toString().c_str());
+					abort();
+				}
 #endif
-			f(*this,*((const SharedPtr<Peer> *)p));
+				f(*this,*((const SharedPtr<Peer> *)p));
+			}
 		}
 	}
 
@@ -252,8 +272,13 @@ public:
 	 */
 	inline std::vector< std::pair< Address,SharedPtr<Peer> > > allPeers() const
 	{
-		Mutex::Lock _l(_lock);
-		return _peers.entries();
+		std::vector< std::pair< Address,SharedPtr<Peer> > > all;
+		for(unsigned int s=0;s<ZT_TOPOLOGY_PEER_SHARDS;++s) {
+			Mutex::Lock _l(_peerShards[s].lock);
+			const std::vector< std::pair< Address,SharedPtr<Peer> > > se(_peerShards[s].peers.entries());
+			all.insert(all.end(),se.begin(),se.end());
+		}
+		return all;
 	}
 
 	/**
@@ -262,13 +287,31 @@ public:
 	inline bool amRoot() const throw() { return _amRoot; }
 
 private:
+	/* The peer table is split into shards by address, each with its own
+	 * lock, so lookups from different threads rarely contend. _lock guards
+	 * the world and root lists. A shard lock may be taken while holding
+	 * _lock but never the other way around, and no two shard locks are
+	 * ever held at once. */
+	struct _PeerShard
+	{
+		_PeerShard() : peers(64) {}
+		Hashtable< Address,SharedPtr<Peer> > peers;
+		Mutex lock;
+	};
+
+	inline _PeerShard &_shard(const Address &zta)
+	{
+		// Top bits of a multiplicative hash, since Hashtable buckets on the low bits
+		return _peerShards[(unsigned int)((zta.toInt() * 0x9e3779b97f4a7c15ULL) >> 56) & (ZT_TOPOLOGY_PEER_SHARDS - 1)];
+	}
+
 	Identity _getIdentity(const Address &zta);
 	void _setWorld(const World &newWorld);
 
 	const RuntimeEnvironment *const RR;
 
 	World _world;
-	Hashtable< Address,SharedPtr<Peer> > _peers;
+	_PeerShard _peerShards[ZT_TOPOLOGY_PEER_SHARDS];
 	std::vector< Address > _rootAddresses;
 	std::vector< SharedPtr<Peer> > _rootPeers;
 	bool _amRoot;
@@ -0,0 +1,231 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2015  ZeroTier, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * ZeroTier may be used and distributed under the terms of the GPLv3, which
+ * are available at: http://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * If you would like to embed ZeroTier into a commercial application or
+ * redistribute it in a modified binary form, please contact ZeroTier Networks
+ * LLC. Start here: http://www.zerotier.com/
+ */
+
+#include <string.h>
+
+#include <vector>
+
+#include "ValidatedIdentityCache.hpp"
+#include "SHA512.hpp"
+#include "Utils.hpp"
+
+// version[1], count[4], count * (address[5], digest[16], lastUsed[8]), mac[16]
+#define ZT_VALIDATEDIDENTITYCACHE_ENTRY_SIZE (ZT_ADDRESS_LENGTH + 16 + 8)
+
+namespace ZeroTier {
+
+static inline void _appendUInt(std::string &s,uint64_t v,unsigned int bytes)
+{
+	while (bytes) {
+		--bytes;
+		s.push_back((char)((v >> (bytes * 8)) & 0xff));
+	}
+}
+
+static inline uint64_t _readUInt(const unsigned char *p,unsigned int bytes)
+{
+	uint64_t v = 0;
+	for(unsigned int i=0;i<bytes;++i)
+		v = (v << 8) | (uint64_t)p[i];
+	return v;
+}
+
+ValidatedIdentityCache::ValidatedIdentityCache(const Identity &self) :
+	_entries(1024),
+	_hits(0),
+	_misses(0),
+	_lastSaved(0),
+	_dirty(false)
+{
+	std::string k(self.toString(true));
+	k.append("validatedIdentityCache");
+	SHA512::hash(_key,k.data(),(unsigned int)k.length());
+	Utils::burn(&(k[0]),(unsigned int)k.length());
+}
+
+bool ValidatedIdentityCache::validate(const Identity &id,uint64_t now)
+{
+	if (!id)
+		return false;
+
+	_Entry e;
+	_digest(id,e.digest);
+	{
+		Mutex::Lock _l(_lock);
+		_Entry *const ce = _entries.get(id.address());
+		if ((ce)&&(ce->digest[0] == e.digest[0])&&(ce->digest[1] == e.digest[1])) {
+			++_hits;
+			if ((now - ce->lastUsed) >= ZT_VALIDATEDIDENTITYCACHE_SAVE_INTERVAL) {
+				ce->lastUsed = now;
+				_dirty = true;
+			}
+			return true;
+		}
+		++_misses;
+	}
+
+	if (!id.locallyValidate())
+		return false;
+
+	e.lastUsed = now;
+	Mutex::Lock _l(_lock);
+	if ((_entries.size() >= ZT_VALIDATEDIDENTITYCACHE_MAX_ENTRIES)&&(!_entries.contains(id.address()))) {
+		Address *oldestAddr = (Address *)0;
+		uint64_t oldest = 0xffffffffffffffffULL;
+		Address *a = (Address *)0;
+		_Entry *ce = (_Entry *)0;
+		Hashtable< Address,_Entry >::Iterator i(_entries);
+		while (i.next(a,ce)) {
+			if (ce->lastUsed < oldest) {
+				oldest = ce->lastUsed;
+				oldestAddr = a;
+			}
+		}
+		if (oldestAddr)
+			_entries.erase(*oldestAddr);
+	}
+	_entries.set(id.address(),e);
+	_dirty = true;
+	return true;
+}
+
+bool ValidatedIdentityCache::has(const Identity &id) const
+{
+	if (!id)
+		return false;
+	uint64_t d[2];
+	_digest(id,d);
+	Mutex::Lock _l(_lock);
+	const _Entry *const ce = _entries.get(id.address());
+	return ((ce)&&(ce->digest[0] == d[0])&&(ce->digest[1] == d[1]));
+}
+
+unsigned long ValidatedIdentityCache::deserialize(const std::string &data,uint64_t now)
+{
+	Mutex::Lock _l(_lock);
+	_entries.clear();
+	_dirty = false;
+
+	if (data.length() < (1 + 4 + 16))
+		return 0;
+	const unsigned char *p = reinterpret_cast<const unsigned char *>(data.data());
+	if (p[0] != ZT_VALIDATEDIDENTITYCACHE_FORMAT_VERSION)
+		return 0;
+	const unsigned long count = (unsigned long)_readUInt(p + 1,4);
+	if ((count > ZT_VALIDATEDIDENTITYCACHE_MAX_ENTRIES)||(data.length() != (1 + 4 + (count * ZT_VALIDATEDIDENTITYCACHE_ENTRY_SIZE) + 16)))
+		return 0;
+
+	unsigned char mac[16];
+	_mac(data.substr(0,data.length() - 16),mac);
+	if (!Utils::secureEq(mac,p + (data.length() - 16),16))
+		return 0; // modified, or written under a different identity
+
+	p += 5;
+	for(unsigned long i=0;i<count;++i,p += ZT_VALIDATEDIDENTITYCACHE_ENTRY_SIZE) {
+		_Entry e;
+		e.digest[0] = _readUInt(p + ZT_ADDRESS_LENGTH,8);
+		e.digest[1] = _readUInt(p + ZT_ADDRESS_LENGTH + 8,8);
+		e.lastUsed = _readUInt(p + ZT_ADDRESS_LENGTH + 16,8);
+		if (e.lastUsed > now)
+			e.lastUsed = now; // clock went backwards
+		if ((now - e.lastUsed) < ZT_VALIDATEDIDENTITYCACHE_EXPIRATION)
+			_entries.set(Address(p,ZT_ADDRESS_LENGTH),e);
+	}
+	_lastSaved = now;
+
+	return _entries.size();
+}
+
+std::string ValidatedIdentityCache::serialize(uint64_t now)
+{
+	Mutex::Lock _l(_lock);
+
+	std::vector<Address> expired;
+	std::string s;
+	s.reserve(1 + 4 + (_entries.size() * ZT_VALIDATEDIDENTITYCACHE_ENTRY_SIZE) + 16);
+	s.push_back((char)ZT_VALIDATEDIDENTITYCACHE_FORMAT_VERSION);
+	_appendUInt(s,0,4); // count, filled in below
+
+	uint64_t count = 0;
+	Address *a = (Address *)0;
+	_Entry *e = (_Entry *)0;
+	Hashtable< Address,_Entry >::Iterator i(_entries);
+	while (i.next(a,e)) {
+		if ((e->lastUsed <= now)&&((now - e->lastUsed) >= ZT_VALIDATEDIDENTITYCACHE_EXPIRATION)) {
+			expired.push_back(*a);
+			continue;
+		}
+		_appendUInt(s,a->toInt(),ZT_ADDRESS_LENGTH);
+		_appendUInt(s,e->digest[0],8);
+		_appendUInt(s,e->digest[1],8);
+		_appendUInt(s,e->lastUsed,8);
+		++count;
+	}
+	for(std::vector<Address>::iterator ex(expired.begin());ex!=expired.end();++ex)
+		_entries.erase(*ex);
+
+	for(unsigned int k=0;k<4;++k)
+		s[1 + k] = (char)((count >> ((3 - k) * 8)) & 0xff);
+	unsigned char mac[16];
+	_mac(s,mac);
+	s.append((const char *)mac,16);
+
+	_dirty = false;
+	_lastSaved = now;
+
+	return s;
+}
+
+void ValidatedIdentityCache::stats(uint64_t &hits,uint64_t &misses,unsigned long &entries) const
+{
+	Mutex::Lock _l(_lock);
+	hits = _hits;
+	misses = _misses;
+	entries = _entries.size();
+}
+
+void ValidatedIdentityCache::_digest(const Identity &id,uint64_t d[2])
+{
+	unsigned char h[64];
+	SHA512::hash(h,id.publicKey().data,ZT_C25519_PUBLIC_KEY_LEN);
+	d[0] = _readUInt(h,8);
+	d[1] = _readUInt(h + 8,8);
+}
+
+void ValidatedIdentityCache::_mac(const std::string &data,unsigned char mac[16]) const
+{
+	// SHA512(key | SHA512(data | key)), truncated to 128 bits
+	unsigned char tmp[128],h[64];
+	std::string d(data);
+	d.append((const char *)_key,64);
+	memcpy(tmp,_key,64);
+	SHA512::hash(tmp + 64,d.data(),(unsigned int)d.length());
+	SHA512::hash(h,tmp,128);
+	memcpy(mac,h,16);
+}
+
+} // namespace ZeroTier
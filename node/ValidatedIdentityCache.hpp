@@ -0,0 +1,169 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2015  ZeroTier, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * ZeroTier may be used and distributed under the terms of the GPLv3, which
+ * are available at: http://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * If you would like to embed ZeroTier into a commercial application or
+ * redistribute it in a modified binary form, please contact ZeroTier Networks
+ * LLC. Start here: http://www.zerotier.com/
+ */
+
+#ifndef ZT_VALIDATEDIDENTITYCACHE_HPP
+#define ZT_VALIDATEDIDENTITYCACHE_HPP
+
+#include <stdint.h>
+
+#include <string>
+
+#include "Constants.hpp"
+#include "Address.hpp"
+#include "Identity.hpp"
+#include "Hashtable.hpp"
+#include "Mutex.hpp"
+#include "NonCopyable.hpp"
+
+/**
+ * Maximum number of identities remembered as locally validated
+ */
+#define ZT_VALIDATEDIDENTITYCACHE_MAX_ENTRIES 131072
+
+/**
+ * Entries not used for this long are forgotten (ms)
+ */
+#define ZT_VALIDATEDIDENTITYCACHE_EXPIRATION 2592000000ULL
+
+/**
+ * Minimum interval between writes of a changed cache to the data store (ms)
+ */
+#define ZT_VALIDATEDIDENTITYCACHE_SAVE_INTERVAL 3600000
+
+/**
+ * Serialized format version
+ */
+#define ZT_VALIDATEDIDENTITYCACHE_FORMAT_VERSION 1
+
+namespace ZeroTier {
+
+/**
+ * Persistent cache of identities that have passed locallyValidate()
+ *
+ * Identity::locallyValidate() fills a 2MB memory-hard hash, so remembering
+ * which identities have already passed it avoids recomputing that after
+ * every restart for peers we have seen before. Each entry is an address
+ * and a 128-bit digest of the identity's public key, so an identity with
+ * the same address but a different key is never trusted from the cache.
+ *
+ * The serialized table carries a MAC keyed from this node's secret
+ * identity. A table that was modified, or that was written under another
+ * identity or format version, is discarded as a whole. Entries unused for
+ * ZT_VALIDATEDIDENTITYCACHE_EXPIRATION are dropped, and when the cache is
+ * full the least recently used entry is evicted.
+ */
+class ValidatedIdentityCache : NonCopyable
+{
+public:
+	/**
+	 * @param self This node's identity (must have its private key)
+	 */
+	ValidatedIdentityCache(const Identity &self);
+
+	/**
+	 * Validate an identity, consulting and updating the cache
+	 *
+	 * @param id Identity to check
+	 * @param now Current time
+	 * @return Same as id.locallyValidate()
+	 */
+	bool validate(const Identity &id,uint64_t now);
+
+	/**
+	 * @param id Identity to check
+	 * @return True if this exact identity is cached as valid
+	 */
+	bool has(const Identity &id) const;
+
+	/**
+	 * Replace the contents of this cache with a serialized table
+	 *
+	 * @param data Serialized table as written by serialize()
+	 * @param now Current time
+	 * @return Number of entries loaded (0 if data was empty or invalid)
+	 */
+	unsigned long deserialize(const std::string &data,uint64_t now);
+
+	/**
+	 * Serialize this cache and mark it clean
+	 *
+	 * @param now Current time (expired entries are omitted)
+	 * @return Serialized table
+	 */
+	std::string serialize(uint64_t now);
+
+	/**
+	 * @param now Current time
+	 * @return True if the cache has changed and should be written now
+	 */
+	inline bool shouldSave(uint64_t now) const
+	{
+		Mutex::Lock _l(_lock);
+		return ((_dirty)&&((now - _lastSaved) >= ZT_VALIDATEDIDENTITYCACHE_SAVE_INTERVAL));
+	}
+
+	/**
+	 * @return True if the cache has changed since it was last serialized
+	 */
+	inline bool dirty() const
+	{
+		Mutex::Lock _l(_lock);
+		return _dirty;
+	}
+
+	/**
+	 * Get cache statistics
+	 *
+	 * @param hits Result parameter: validations avoided
+	 * @param misses Result parameter: validations that were computed
+	 * @param entries Result parameter: cached identities
+	 */
+	void stats(uint64_t &hits,uint64_t &misses,unsigned long &entries) const;
+
+private:
+	struct _Entry
+	{
+		_Entry() : lastUsed(0) { digest[0] = 0; digest[1] = 0; }
+		uint64_t digest[2];
+		uint64_t lastUsed;
+	};
+
+	static void _digest(const Identity &id,uint64_t d[2]);
+	void _mac(const std::string &data,unsigned char mac[16]) const;
+
+	unsigned char _key[64];
+	Hashtable< Address,_Entry > _entries;
+	uint64_t _hits;
+	uint64_t _misses;
+	uint64_t _lastSaved;
+	bool _dirty;
+	Mutex _lock;
+};
+
+} // namespace ZeroTier
+
+#endif
@@ -0,0 +1,189 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2015  ZeroTier, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * ZeroTier may be used and distributed under the terms of the GPLv3, which
+ * are available at: http://www.gnu.org/licenses/gpl-3.0.html
+ *
+ * If you would like to embed ZeroTier into a commercial application or
+ * redistribute it in a modified binary form, please contact ZeroTier Networks
+ * LLC. Start here: http://www.zerotier.com/
+ */
+
+#ifndef ZT_VERIFIEDCOMCACHE_HPP
+#define ZT_VERIFIEDCOMCACHE_HPP
+
+#include <stdint.h>
+#include <string.h>
+
+#include "Constants.hpp"
+#include "Buffer.hpp"
+#include "SHA512.hpp"
+#include "Mutex.hpp"
+#include "Identity.hpp"
+#include "CertificateOfMembership.hpp"
+#include "NonCopyable.hpp"
+
+/**
+ * Number of slots in the verified COM cache (must be a power of two)
+ */
+#define ZT_VERIFIEDCOMCACHE_SIZE 4096
+
+namespace ZeroTier {
+
+/**
+ * Node-wide cache of certificates of membership with verified signatures
+ *
+ * Peers only remember the last COM they were sent, so the same controller
+ * signed COM arriving via another peer or after the peer was forgotten
+ * would otherwise be checked with Ed25519 again. Entries are a 128-bit
+ * digest of the serialized COM (qualifiers, signer, and signature) and
+ * the signer's public key, in a direct-mapped table where a new entry
+ * simply replaces whatever was in its slot.
+ */
+class VerifiedComCache : NonCopyable
+{
+public:
+	VerifiedComCache() :
+		_hits(0),
+		_misses(0),
+		_entries(0)
+	{
+		memset(_slots,0,sizeof(_slots));
+	}
+
+	/**
+	 * Check whether a COM's signature is already known to be valid
+	 *
+	 * @param com Certificate of membership
+	 * @param signer Identity it is signed by
+	 * @return True if this exact COM has been verified against this signer
+	 */
+	inline bool has(const CertificateOfMembership &com,const Identity &signer)
+	{
+		_Key k;
+		if (!_key(com,signer,k))
+			return false;
+		Mutex::Lock _l(_lock);
+		if (_slots[k.w[0] & (ZT_VERIFIEDCOMCACHE_SIZE - 1)] == k) {
+			++_hits;
+			return true;
+		}
+		++_misses;
+		return false;
+	}
+
+	/**
+	 * Record a COM whose signature has been verified against signer
+	 *
+	 * @param com Certificate of membership
+	 * @param signer Identity it is signed by
+	 */
+	inline void add(const CertificateOfMembership &com,const Identity &signer)
+	{
+		_Key k;
+		if (_key(com,signer,k))
+			_add(k);
+	}
+
+	/**
+	 * Verify a COM using the cache
+	 *
+	 * @param com Certificate of membership
+	 * @param signer Identity to verify against
+	 * @return Same as com.verify(signer)
+	 */
+	inline bool verify(const CertificateOfMembership &com,const Identity &signer)
+	{
+		_Key k;
+		if (!_key(com,signer,k))
+			return com.verify(signer);
+		{
+			Mutex::Lock _l(_lock);
+			if (_slots[k.w[0] & (ZT_VERIFIEDCOMCACHE_SIZE - 1)] == k) {
+				++_hits;
+				return true;
+			}
+			++_misses;
+		}
+		if (com.verify(signer)) {
+			_add(k);
+			return true;
+		}
+		return false;
+	}
+
+	/**
+	 * Get cache statistics
+	 *
+	 * @param hits Result parameter: lookups that found a verified entry
+	 * @param misses Result parameter: lookups that required a signature check
+	 * @param entries Result parameter: occupied slots
+	 */
+	inline void stats(uint64_t &hits,uint64_t &misses,unsigned long &entries) const
+	{
+		Mutex::Lock _l(_lock);
+		hits = _hits;
+		misses = _misses;
+		entries = _entries;
+	}
+
+private:
+	struct _Key
+	{
+		uint64_t w[2];
+		inline bool operator==(const _Key &k) const throw() { return ((w[0] == k.w[0])&&(w[1] == k.w[1])); }
+		inline bool empty() const throw() { return ((w[0] | w[1]) == 0); }
+	};
+
+	static inline bool _key(const CertificateOfMembership &com,const Identity &signer,_Key &k)
+	{
+		if ((!com.isSigned())||(com.signedBy() != signer.address()))
+			return false;
+		try {
+			Buffer<4096> tmp;
+			com.serialize(tmp);
+			tmp.append(signer.publicKey().data,ZT_C25519_PUBLIC_KEY_LEN);
+			unsigned char digest[64];
+			SHA512::hash(digest,tmp.data(),tmp.size());
+			memcpy(k.w,digest,16);
+			return (!k.empty()); // all-zero marks an empty slot
+		} catch ( ... ) {
+			return false; // too big to cache
+		}
+	}
+
+	inline void _add(const _Key &k)
+	{
+		Mutex::Lock _l(_lock);
+		_Key &s = _slots[k.w[0] & (ZT_VERIFIEDCOMCACHE_SIZE - 1)];
+		if (s.empty())
+			++_entries;
+		s = k;
+	}
+
+	_Key _slots[ZT_VERIFIEDCOMCACHE_SIZE];
+	uint64_t _hits;
+	uint64_t _misses;
+	unsigned long _entries;
+	Mutex _lock;
+};
+
+} // namespace ZeroTier
+
+#endif
@@ -2,6 +2,7 @@ OBJS=\
 	ext/lz4/lz4.o \
 	ext/json-parser/json.o \
 	ext/http-parser/http_parser.o \
+	node/AES.o \
 	node/C25519.o \
 	node/CertificateOfMembership.o \
 	node/Cluster.o \
@@ -25,6 +26,7 @@ OBJS=\
 	node/Switch.o \
 	node/Topology.o \
 	node/Utils.o \
+	node/ValidatedIdentityCache.o \
 	osdep/BackgroundResolver.o \
 	osdep/Http.o \
 	osdep/OSUtils.o \
@@ -56,6 +56,7 @@
 #endif
 
 #include <string>
+#include <vector>
 #include <stdexcept>
 
 #include "version.h"
@@ -67,9 +68,11 @@
 #include "node/CertificateOfMembership.hpp"
 #include "node/Utils.hpp"
 #include "node/NetworkController.hpp"
+#include "node/Mutex.hpp"
 
 #include "osdep/OSUtils.hpp"
 #include "osdep/Http.hpp"
+#include "osdep/Thread.hpp"
 
 #include "service/OneService.hpp"
 
@@ -562,7 +565,7 @@ static void idtoolPrintHelp(FILE *out,const char *pn)
 	fprintf(out,"ZeroTier One version %d.%d.%d"ZT_EOL_S"(c)2011-2015 ZeroTier, Inc."ZT_EOL_S,ZEROTIER_ONE_VERSION_MAJOR,ZEROTIER_ONE_VERSION_MINOR,ZEROTIER_ONE_VERSION_REVISION);
 	fprintf(out,"Licensed under the GNU General Public License v3"ZT_EOL_S""ZT_EOL_S);
 	fprintf(out,"Usage: %s <command> [<args>]"ZT_EOL_S""ZT_EOL_S"Commands:"ZT_EOL_S,pn);
-	fprintf(out,"  generate [<identity.secret>] [<identity.public>]"ZT_EOL_S);
+	fprintf(out,"  generate [-t<threads>] [-p<hex address prefix>] [<identity.secret>] [<identity.public>]"ZT_EOL_S);
 	fprintf(out,"  validate <identity.secret/public>"ZT_EOL_S);
 	fprintf(out,"  getpublic <identity.secret>"ZT_EOL_S);
 	fprintf(out,"  sign <identity.secret> <file>"ZT_EOL_S);
@@ -570,6 +573,51 @@ static void idtoolPrintHelp(FILE *out,const char *pn)
 	fprintf(out,"  mkcom <identity.secret> [<id,value,maxDelta> ...] (hexadecimal integers)"ZT_EOL_S);
 }
 
+// One of several threads searching for an identity, first one found wins
+class IdtoolGenerateWorker
+{
+public:
+	IdtoolGenerateWorker(uint64_t p,unsigned int pb,volatile bool *d,Mutex *l,Identity *r) :
+		prefix(p),
+		prefixBits(pb),
+		done(d),
+		lock(l),
+		result(r)
+	{
+	}
+
+	void threadMain()
+		throw()
+	{
+		Identity id;
+		if (id.generate(prefix,prefixBits,done)) {
+			Mutex::Lock _l(*lock);
+			if (!*done) {
+				*result = id;
+				*done = true;
+			}
+		}
+	}
+
+	uint64_t prefix;
+	unsigned int prefixBits;
+	volatile bool *done;
+	Mutex *lock;
+	Identity *result;
+};
+
+static unsigned int idtoolCpuCount()
+{
+#ifdef __WINDOWS__
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	return ((si.dwNumberOfProcessors > 0) ? (unsigned int)si.dwNumberOfProcessors : 1);
+#else
+	const long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return ((n > 0) ? (unsigned int)n : 1);
+#endif
+}
+
 static Identity getIdFromArg(char *arg)
 {
 	Identity id;
@@ -598,20 +646,69 @@ static int idtool(int argc,char **argv)
 	}
 
 	if (!strcmp(argv[1],"generate")) {
+		unsigned int threads = idtoolCpuCount();
+		uint64_t prefix = 0;
+		unsigned int prefixBits = 0;
+		int ai = 2;
+		for(;(ai < argc)&&(argv[ai][0] == '-');++ai) {
+			switch(argv[ai][1]) {
+				case 't':
+					threads = (unsigned int)Utils::strToUInt(argv[ai] + 2);
+					if ((threads < 1)||(threads > 1024)) {
+						fprintf(stderr,"Invalid thread count: %s"ZT_EOL_S,argv[ai] + 2);
+						return 1;
+					}
+					break;
+				case 'p': {
+					const char *const p = argv[ai] + 2;
+					const unsigned int plen = (unsigned int)strlen(p);
+					if ((plen < 1)||(plen > (ZT_ADDRESS_LENGTH * 2))||(strspn(p,"0123456789abcdefABCDEF") != plen)) {
+						fprintf(stderr,"Invalid address prefix (must be 1 to 10 hex digits): %s"ZT_EOL_S,p);
+						return 1;
+					}
+					prefixBits = plen * 4;
+					prefix = Utils::hexStrToU64(p) << ((ZT_ADDRESS_LENGTH * 8) - prefixBits);
+					if ((prefixBits >= 8)&&((prefix >> 32) == ZT_ADDRESS_RESERVED_PREFIX)) {
+						fprintf(stderr,"Address prefix %s is reserved"ZT_EOL_S,p);
+						return 1;
+					}
+				}	break;
+				default:
+					idtoolPrintHelp(stdout,argv[0]);
+					return 1;
+			}
+		}
+
 		Identity id;
-		id.generate();
+		if (threads <= 1) {
+			id.generate(prefix,prefixBits,(const volatile bool *)0);
+		} else {
+			volatile bool done = false;
+			Mutex lock;
+			std::vector<IdtoolGenerateWorker *> workers;
+			std::vector<Thread> workerThreads;
+			for(unsigned int i=0;i<threads;++i) {
+				workers.push_back(new IdtoolGenerateWorker(prefix,prefixBits,&done,&lock,&id));
+				workerThreads.push_back(Thread::start(workers.back()));
+			}
+			for(unsigned int i=0;i<threads;++i) {
+				Thread::join(workerThreads[i]);
+				delete workers[i];
+			}
+		}
+
 		std::string idser = id.toString(true);
-		if (argc >= 3) {
-			if (!OSUtils::writeFile(argv[2],idser)) {
-				fprintf(stderr,"Error writing to %s"ZT_EOL_S,argv[2]);
+		if (ai < argc) {
+			if (!OSUtils::writeFile(argv[ai],idser)) {
+				fprintf(stderr,"Error writing to %s"ZT_EOL_S,argv[ai]);
 				return 1;
-			} else printf("%s written"ZT_EOL_S,argv[2]);
-			if (argc >= 4) {
+			} else printf("%s written"ZT_EOL_S,argv[ai]);
+			if ((ai + 1) < argc) {
 				idser = id.toString(false);
-				if (!OSUtils::writeFile(argv[3],idser)) {
-					fprintf(stderr,"Error writing to %s"ZT_EOL_S,argv[3]);
+				if (!OSUtils::writeFile(argv[ai + 1],idser)) {
+					fprintf(stderr,"Error writing to %s"ZT_EOL_S,argv[ai + 1]);
 					return 1;
-				} else printf("%s written"ZT_EOL_S,argv[3]);
+				} else printf("%s written"ZT_EOL_S,argv[ai + 1]);
 			}
 		} else printf("%s",idser.c_str());
 	} else if (!strcmp(argv[1],"validate")) {
@@ -911,6 +1008,11 @@ static void printHelp(const char *cn,FILE *out)
 	fprintf(out,"  -v                - Show version"ZT_EOL_S);
 	fprintf(out,"  -U                - Run as unprivileged user (skip privilege check)"ZT_EOL_S);
 	fprintf(out,"  -p<port>          - Port for UDP and TCP/HTTP (default: 9993, 0 for random)"ZT_EOL_S);
+#ifdef __LINUX__
+	fprintf(out,"  -t<threads>       - Number of threads receiving UDP on port (default: 1)"ZT_EOL_S);
+	fprintf(out,"  -Q<queues>        - Number of queues per tap device (default: 1)"ZT_EOL_S);
+	fprintf(out,"  -O                - Enable tap checksum and TCP segmentation offload"ZT_EOL_S);
+#endif // __LINUX__
 
 #ifdef __UNIX_LIKE__
 	fprintf(out,"  -d                - Fork and run as daemon (Unix-ish OSes)"ZT_EOL_S);
@@ -977,6 +1079,9 @@ int main(int argc,char **argv)
 
 	std::string homeDir;
 	unsigned int port = ZT_DEFAULT_PORT;
+	unsigned int udpReceiveThreads = 1;
+	unsigned int tapQueues = 1;
+	bool tapOffload = false;
 	bool skipRootCheck = false;
 
 	for(int i=1;i<argc;++i) {
@@ -997,6 +1102,28 @@ int main(int argc,char **argv)
 					break;
 #endif // __UNIX_LIKE__
 
+#ifdef __LINUX__
+				case 't': // number of UDP receive threads
+					udpReceiveThreads = Utils::strToUInt(argv[i] + 2);
+					if ((udpReceiveThreads < 1)||(udpReceiveThreads > 64)) {
+						printHelp(argv[0],stdout);
+						return 1;
+					}
+					break;
+
+				case 'Q': // number of multi-queue tap queues
+					tapQueues = Utils::strToUInt(argv[i] + 2);
+					if ((tapQueues < 1)||(tapQueues > 16)) {
+						printHelp(argv[0],stdout);
+						return 1;
+					}
+					break;
+
+				case 'O': // IFF_VNET_HDR tap offload mode
+					tapOffload = true;
+					break;
+#endif // __LINUX__
+
 				case 'U':
 					skipRootCheck = true;
 					break;
@@ -1156,7 +1283,7 @@ int main(int argc,char **argv)
 	unsigned int returnValue = 0;
 
 	for(;;) {
-		zt1Service = OneService::newInstance(homeDir.c_str(),port);
+		zt1Service = OneService::newInstance(homeDir.c_str(),port,udpReceiveThreads,tapQueues,tapOffload);
 		switch(zt1Service->run()) {
 			case OneService::ONE_STILL_RUNNING: // shouldn't happen, run() won't return until done
 			case OneService::ONE_NORMAL_TERMINATION:
@@ -38,6 +38,7 @@
 #include <sys/ioctl.h>
 #include <sys/wait.h>
 #include <sys/select.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <net/if_arp.h>
 #include <arpa/inet.h>
@@ -60,6 +61,23 @@
 // ff:ff:ff:ff:ff:ff with no ADI
 static const ZeroTier::MulticastGroup _blindWildcardMulticastGroup(ZeroTier::MAC(0xff),0);
 
+// Layout of struct virtio_net_hdr prepended to frames in IFF_VNET_HDR mode.
+// linux/virtio_net.h cannot be included from C++, so it is mirrored here.
+struct _VnetHdr
+{
+	uint8_t flags;
+	uint8_t gso_type;
+	uint16_t hdr_len;
+	uint16_t gso_size;
+	uint16_t csum_start;
+	uint16_t csum_offset;
+};
+#define ZT_VNET_HDR_F_NEEDS_CSUM 1
+#define ZT_VNET_HDR_GSO_NONE 0
+#define ZT_VNET_HDR_GSO_TCPV4 1
+#define ZT_VNET_HDR_GSO_TCPV6 4
+#define ZT_VNET_HDR_GSO_ECN 0x80
+
 namespace ZeroTier {
 
 static Mutex __tapCreateLock;
@@ -72,13 +90,17 @@ LinuxEthernetTap::LinuxEthernetTap(
 	uint64_t nwid,
 	const char *friendlyName,
 	void (*handler)(void *,uint64_t,const MAC &,const MAC &,unsigned int,unsigned int,const void *,unsigned int),
-	void *arg) :
+	void *arg,
+	unsigned int queues,
+	bool offload) :
 	_handler(handler),
 	_arg(arg),
 	_nwid(nwid),
 	_homePath(homePath),
 	_mtu(mtu),
-	_fd(0),
+	_offload(offload),
+	_batchBuf((unsigned char *)0),
+	_batchCount(0),
 	_enabled(true)
 {
 	char procpath[128],nwids[32];
@@ -91,8 +113,16 @@ LinuxEthernetTap::LinuxEthernetTap(
 	if (mtu > 2800)
 		throw std::runtime_error("max tap MTU is 2800");
 
-	_fd = ::open("/dev/net/tun",O_RDWR);
-	if (_fd <= 0)
+#ifndef IFF_MULTI_QUEUE
+	queues = 1; // kernel headers too old for multi-queue taps
+#endif
+	if (queues < 1)
+		queues = 1;
+	else if (queues > ZT_LINUX_TAP_MAX_QUEUES)
+		queues = ZT_LINUX_TAP_MAX_QUEUES;
+
+	int fd = ::open("/dev/net/tun",O_RDWR);
+	if (fd <= 0)
 		throw std::runtime_error(std::string("could not open TUN/TAP device: ") + strerror(errno));
 
 	struct ifreq ifr;
@@ -120,20 +150,41 @@ LinuxEthernetTap::LinuxEthernetTap(
 		} while (stat(procpath,&sbuf) == 0); // try zt#++ until we find one that does not exist
 	}
 
-	ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
-	if (ioctl(_fd,TUNSETIFF,(void *)&ifr) < 0) {
-		::close(_fd);
+	const short tapFlags = IFF_TAP | IFF_NO_PI | ((_offload) ? IFF_VNET_HDR : 0);
+	ifr.ifr_flags = tapFlags;
+#ifdef IFF_MULTI_QUEUE
+	if (queues > 1) {
+		ifr.ifr_flags |= IFF_MULTI_QUEUE;
+		if (ioctl(fd,TUNSETIFF,(void *)&ifr) < 0) {
+			// Kernel lacks multi-queue support, so fall back to one queue
+			queues = 1;
+			ifr.ifr_flags = tapFlags;
+		}
+	}
+	if (queues == 1)
+#endif
+	if (ioctl(fd,TUNSETIFF,(void *)&ifr) < 0) {
+		::close(fd);
 		throw std::runtime_error("unable to configure TUN/TAP device for TAP operation");
 	}
 
 	_dev = ifr.ifr_name;
 
-	::ioctl(_fd,TUNSETPERSIST,0); // valgrind may generate a false alarm here
+	if (_offload) {
+		// Every read and write now carries a virtio_net_hdr. Tell the kernel
+		// we can take partially checksummed frames and TCP super-frames, which
+		// makes it advertise checksum offload and TSO on the device.
+		int vnetHdrSize = (int)sizeof(_VnetHdr);
+		::ioctl(fd,TUNSETVNETHDRSZ,&vnetHdrSize);
+		::ioctl(fd,TUNSETOFFLOAD,(unsigned long)(TUN_F_CSUM | TUN_F_TSO4 | TUN_F_TSO6));
+	}
+
+	::ioctl(fd,TUNSETPERSIST,0); // valgrind may generate a false alarm here
 
 	// Open an arbitrary socket to talk to netlink
 	int sock = socket(AF_INET,SOCK_DGRAM,0);
 	if (sock <= 0) {
-		::close(_fd);
+		::close(fd);
 		throw std::runtime_error("unable to open netlink socket");
 	}
 
@@ -141,7 +192,7 @@ LinuxEthernetTap::LinuxEthernetTap(
 	ifr.ifr_ifru.ifru_hwaddr.sa_family = ARPHRD_ETHER;
 	mac.copyTo(ifr.ifr_ifru.ifru_hwaddr.sa_data,6);
 	if (ioctl(sock,SIOCSIFHWADDR,(void *)&ifr) < 0) {
-		::close(_fd);
+		::close(fd);
 		::close(sock);
 		throw std::runtime_error("unable to configure TAP hardware (MAC) address");
 		return;
@@ -150,25 +201,20 @@ LinuxEthernetTap::LinuxEthernetTap(
 	// Set MTU
 	ifr.ifr_ifru.ifru_mtu = (int)mtu;
 	if (ioctl(sock,SIOCSIFMTU,(void *)&ifr) < 0) {
-		::close(_fd);
+		::close(fd);
 		::close(sock);
 		throw std::runtime_error("unable to configure TAP MTU");
 	}
 
-	if (fcntl(_fd,F_SETFL,fcntl(_fd,F_GETFL) & ~O_NONBLOCK) == -1) {
-		::close(_fd);
-		throw std::runtime_error("unable to set flags on file descriptor for TAP device");
-	}
-
 	/* Bring interface up */
 	if (ioctl(sock,SIOCGIFFLAGS,(void *)&ifr) < 0) {
-		::close(_fd);
+		::close(fd);
 		::close(sock);
 		throw std::runtime_error("unable to get TAP interface flags");
 	}
 	ifr.ifr_flags |= IFF_UP;
 	if (ioctl(sock,SIOCSIFFLAGS,(void *)&ifr) < 0) {
-		::close(_fd);
+		::close(fd);
 		::close(sock);
 		throw std::runtime_error("unable to set TAP interface flags");
 	}
@@ -176,21 +222,63 @@ LinuxEthernetTap::LinuxEthernetTap(
 	::close(sock);
 
 	// Set close-on-exec so that devices cannot persist if we fork/exec for update
-	::fcntl(_fd,F_SETFD,fcntl(_fd,F_GETFD) | FD_CLOEXEC);
+	::fcntl(fd,F_SETFD,fcntl(fd,F_GETFD) | FD_CLOEXEC);
+	_fds.push_back(fd);
+
+#ifdef IFF_MULTI_QUEUE
+	// Attach additional queues to the device we just created. If the kernel
+	// refuses (e.g. queue limit reached) we just run with what we have.
+	while (_fds.size() < queues) {
+		fd = ::open("/dev/net/tun",O_RDWR);
+		if (fd <= 0)
+			break;
+		memset(&ifr,0,sizeof(ifr));
+		Utils::scopy(ifr.ifr_name,sizeof(ifr.ifr_name),_dev.c_str());
+		ifr.ifr_flags = tapFlags | IFF_MULTI_QUEUE;
+		if (ioctl(fd,TUNSETIFF,(void *)&ifr) < 0) {
+			::close(fd);
+			break;
+		}
+		::fcntl(fd,F_SETFD,fcntl(fd,F_GETFD) | FD_CLOEXEC);
+		_fds.push_back(fd);
+	}
+#endif
+
+	// Reader threads drain each queue until it would block before going
+	// back to select(), so queue descriptors are non-blocking.
+	for(std::vector<int>::iterator f(_fds.begin());f!=_fds.end();++f) {
+		if (::fcntl(*f,F_SETFL,fcntl(*f,F_GETFL) | O_NONBLOCK) == -1) {
+			for(std::vector<int>::iterator f2(_fds.begin());f2!=_fds.end();++f2)
+				::close(*f2);
+			throw std::runtime_error("unable to set flags on file descriptor for TAP device");
+		}
+	}
 
 	::pipe(_shutdownSignalPipe);
 
 	devmap[nwids] = _dev;
 	OSUtils::writeFile((_homePath + ZT_PATH_SEPARATOR_S + "devicemap").c_str(),devmap.toString());
 
-	_thread = Thread::start(this);
+	if (_offload)
+		_batchBuf = new unsigned char[ZT_LINUX_TAP_PUT_BATCH_SIZE * (_mtu + 14)];
+
+	for(std::vector<int>::iterator f(_fds.begin());f!=_fds.end();++f) {
+		_QueueReader *qr = new _QueueReader(this,*f);
+		qr->thread = Thread::start(qr);
+		_readers.push_back(qr);
+	}
 }
 
 LinuxEthernetTap::~LinuxEthernetTap()
 {
-	::write(_shutdownSignalPipe[1],"\0",1); // causes thread to exit
-	Thread::join(_thread);
-	::close(_fd);
+	::write(_shutdownSignalPipe[1],"\0",1); // causes all reader threads to exit
+	for(std::vector<_QueueReader *>::iterator qr(_readers.begin());qr!=_readers.end();++qr) {
+		Thread::join((*qr)->thread);
+		delete *qr;
+	}
+	for(std::vector<int>::iterator f(_fds.begin());f!=_fds.end();++f)
+		::close(*f);
+	delete [] _batchBuf;
 	::close(_shutdownSignalPipe[0]);
 	::close(_shutdownSignalPipe[1]);
 }
@@ -307,14 +395,53 @@ std::vector<InetAddress> LinuxEthernetTap::ips() const
 
 void LinuxEthernetTap::put(const MAC &from,const MAC &to,unsigned int etherType,const void *data,unsigned int len)
 {
-	char putBuf[8194];
-	if ((_fd > 0)&&(len <= _mtu)&&(_enabled)) {
-		to.copyTo(putBuf,6);
-		from.copyTo(putBuf + 6,6);
-		*((uint16_t *)(putBuf + 12)) = htons((uint16_t)etherType);
-		memcpy(putBuf + 14,data,len);
-		len += 14;
-		::write(_fd,putBuf,len);
+	if ((len <= _mtu)&&(_enabled)) {
+		// Write header and payload in place, no need to assemble the frame
+		unsigned char hdr[sizeof(_VnetHdr) + 14];
+		unsigned int vnetHdrLen = 0;
+		if (_offload) {
+			// Frames from the network are complete and already checksummed
+			vnetHdrLen = sizeof(_VnetHdr);
+			memset(hdr,0,vnetHdrLen);
+		}
+		to.copyTo(hdr + vnetHdrLen,6);
+		from.copyTo(hdr + vnetHdrLen + 6,6);
+		hdr[vnetHdrLen + 12] = (unsigned char)(etherType >> 8);
+		hdr[vnetHdrLen + 13] = (unsigned char)etherType;
+		struct iovec iov[2];
+		iov[0].iov_base = hdr;
+		iov[0].iov_len = vnetHdrLen + 14;
+		iov[1].iov_base = const_cast<void *>(data);
+		iov[1].iov_len = len;
+		::writev(_queueFd(etherType,data,len,from,to),iov,2);
+	}
+}
+
+void LinuxEthernetTap::putQueued(const MAC &from,const MAC &to,unsigned int etherType,const void *data,unsigned int len)
+{
+	if (!_batchBuf) {
+		put(from,to,etherType,data,len);
+		return;
+	}
+	if ((len <= _mtu)&&(_enabled)) {
+		Mutex::Lock _l(_batch_m);
+		if (_batchCount >= ZT_LINUX_TAP_PUT_BATCH_SIZE)
+			_flushBatch();
+		unsigned char *const f = _batchBuf + (_batchCount * (_mtu + 14));
+		to.copyTo(f,6);
+		from.copyTo(f + 6,6);
+		f[12] = (unsigned char)(etherType >> 8);
+		f[13] = (unsigned char)etherType;
+		memcpy(f + 14,data,len);
+		_batchLen[_batchCount++] = len + 14;
+	}
+}
+
+void LinuxEthernetTap::flushQueued()
+{
+	if (_batchBuf) {
+		Mutex::Lock _l(_batch_m);
+		_flushBatch();
 	}
 }
 
@@ -376,53 +503,352 @@ void LinuxEthernetTap::scanMulticastGroups(std::vector<MulticastGroup> &added,st
 	_multicastGroups.swap(newGroups);
 }
 
-void LinuxEthernetTap::threadMain()
+unsigned int LinuxEthernetTap::_flowHash(unsigned int etherType,const void *data,unsigned int len,const MAC &from,const MAC &to)
+	throw()
+{
+	const unsigned char *p = (const unsigned char *)data;
+	unsigned int h = 0;
+	unsigned int l4 = 0; // offset of TCP/UDP ports or 0 if none
+
+	// Hash the IP addresses and (for unfragmented TCP/UDP/SCTP) the ports.
+	// The hash is symmetric so both directions of a flow share a queue.
+	if ((etherType == 0x0800)&&(len >= 20)) {
+		for(unsigned int i=12;i<20;i+=4)
+			h += ((unsigned int)p[i] << 24) | ((unsigned int)p[i + 1] << 16) | ((unsigned int)p[i + 2] << 8) | (unsigned int)p[i + 3];
+		if ((((p[6] & 0x3f) | p[7]) == 0)&&((p[9] == 6)||(p[9] == 17)||(p[9] == 132))) {
+			l4 = (unsigned int)(p[0] & 0xf) * 4;
+			h ^= (unsigned int)p[9];
+		}
+	} else if ((etherType == 0x86dd)&&(len >= 40)) {
+		for(unsigned int i=8;i<40;i+=4)
+			h += ((unsigned int)p[i] << 24) | ((unsigned int)p[i + 1] << 16) | ((unsigned int)p[i + 2] << 8) | (unsigned int)p[i + 3];
+		if ((p[6] == 6)||(p[6] == 17)||(p[6] == 132)) {
+			l4 = 40;
+			h ^= (unsigned int)p[6];
+		}
+	} else {
+		const uint64_t m = from.toInt() ^ to.toInt();
+		h = (unsigned int)(m >> 24) ^ (unsigned int)m ^ etherType;
+	}
+	if ((l4)&&((l4 + 4) <= len))
+		h += (((unsigned int)p[l4] << 8) | (unsigned int)p[l4 + 1]) + (((unsigned int)p[l4 + 2] << 8) | (unsigned int)p[l4 + 3]);
+
+	// Final avalanche so that the low bits used for queue selection are well mixed
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+// Internet checksum helpers for offload mode, operating on big-endian data
+static inline uint64_t _csumAdd(const unsigned char *p,unsigned int len,uint64_t sum)
+{
+	while (len >= 4) {
+		sum += ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+		p += 4;
+		len -= 4;
+	}
+	if (len >= 2) {
+		sum += ((uint32_t)p[0] << 8) | (uint32_t)p[1];
+		p += 2;
+		len -= 2;
+	}
+	if (len)
+		sum += (uint32_t)p[0] << 8;
+	return sum;
+}
+static inline void _csumStore(unsigned char *p,uint64_t sum)
+{
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	sum = ~sum;
+	p[0] = (unsigned char)(sum >> 8);
+	p[1] = (unsigned char)sum;
+}
+
+void LinuxEthernetTap::_deliverOffloaded(unsigned char *buf,unsigned int len)
+	throw()
+{
+	const _VnetHdr *const vh = (const _VnetHdr *)buf;
+	unsigned char *const f = buf + sizeof(_VnetHdr);
+	len -= sizeof(_VnetHdr);
+
+	const MAC to(f,6),from(f + 6,6);
+	const unsigned int etherType = ((unsigned int)f[12] << 8) | (unsigned int)f[13];
+	const unsigned int csumStart = vh->csum_start;
+
+	if ((vh->gso_type & ~ZT_VNET_HDR_GSO_ECN) == ZT_VNET_HDR_GSO_NONE) {
+		// Ordinary frame, but the kernel may have left its L4 checksum for us
+		// to finish. In that case the field holds the pseudo-header sum.
+		if (vh->flags & ZT_VNET_HDR_F_NEEDS_CSUM) {
+			const unsigned int csumAt = csumStart + vh->csum_offset;
+			if ((csumStart >= len)||((csumAt + 2) > len))
+				return;
+			uint64_t sum = _csumAdd(f + csumStart,len - csumStart,0);
+			_csumStore(f + csumAt,sum);
+		}
+		if ((len - 14) <= _mtu)
+			_handler(_arg,_nwid,from,to,etherType,0,(const void *)(f + 14),len - 14);
+		return;
+	}
+
+	// TCP segmentation offload: the kernel handed us one large TCP segment
+	// with a template header. Cut it into MSS-sized frames that each fit the
+	// network MTU and fix up lengths, IDs, sequence numbers and checksums.
+	const bool v4 = ((vh->gso_type & ~ZT_VNET_HDR_GSO_ECN) == ZT_VNET_HDR_GSO_TCPV4);
+	if ((!v4)&&((vh->gso_type & ~ZT_VNET_HDR_GSO_ECN) != ZT_VNET_HDR_GSO_TCPV6))
+		return; // we do not advertise UFO
+	if ((etherType != ((v4) ? 0x0800 : 0x86dd))||(csumStart < ((v4) ? 34 : 54))||((csumStart + 20) > len))
+		return;
+	const unsigned int hdrLen = csumStart + ((unsigned int)(f[csumStart + 12] >> 4) * 4);
+	if ((hdrLen < (csumStart + 20))||(hdrLen >= len)||((hdrLen - 14) >= _mtu))
+		return;
+	unsigned int mss = vh->gso_size;
+	if ((!mss)||((hdrLen - 14 + mss) > _mtu))
+		mss = _mtu - (hdrLen - 14);
+
+	const uint32_t seq0 = ((uint32_t)f[csumStart + 4] << 24) | ((uint32_t)f[csumStart + 5] << 16) | ((uint32_t)f[csumStart + 6] << 8) | (uint32_t)f[csumStart + 7];
+	const unsigned int ipId0 = ((unsigned int)f[18] << 8) | (unsigned int)f[19];
+	const unsigned char tcpFlags0 = f[csumStart + 13];
+
+	unsigned char seg[8194];
+	memcpy(seg,f,hdrLen);
+	for(unsigned int off=hdrLen,segno=0;off<len;++segno) {
+		const unsigned int plen = std::min(mss,len - off);
+		const bool last = ((off + plen) >= len);
+		memcpy(seg + hdrLen,f + off,plen);
+		const unsigned int segLen = hdrLen + plen;
+		const unsigned int tcpLen = segLen - csumStart;
+
+		uint64_t sum;
+		if (v4) {
+			seg[16] = (unsigned char)((segLen - 14) >> 8);
+			seg[17] = (unsigned char)(segLen - 14);
+			seg[18] = (unsigned char)((ipId0 + segno) >> 8);
+			seg[19] = (unsigned char)(ipId0 + segno);
+			seg[24] = 0;
+			seg[25] = 0;
+			_csumStore(seg + 24,_csumAdd(seg + 14,csumStart - 14,0));
+			sum = _csumAdd(seg + 26,8,0);
+		} else {
+			seg[18] = (unsigned char)((segLen - 54) >> 8);
+			seg[19] = (unsigned char)(segLen - 54);
+			sum = _csumAdd(seg + 22,32,0);
+		}
+		sum += 6 + tcpLen; // rest of pseudo-header: protocol and TCP length
+
+		const uint32_t seq = seq0 + (off - hdrLen);
+		seg[csumStart + 4] = (unsigned char)(seq >> 24);
+		seg[csumStart + 5] = (unsigned char)(seq >> 16);
+		seg[csumStart + 6] = (unsigned char)(seq >> 8);
+		seg[csumStart + 7] = (unsigned char)seq;
+		unsigned char tcpFlags = tcpFlags0;
+		if (!last)
+			tcpFlags &= ~(0x01 | 0x08); // FIN and PSH only on the last segment
+		if (segno)
+			tcpFlags &= ~0x80; // CWR only on the first
+		seg[csumStart + 13] = tcpFlags;
+		seg[csumStart + 16] = 0;
+		seg[csumStart + 17] = 0;
+		_csumStore(seg + csumStart + 16,_csumAdd(seg + csumStart,tcpLen,sum));
+
+		_handler(_arg,_nwid,from,to,etherType,0,(const void *)(seg + 14),segLen - 14);
+
+		off += plen;
+	}
+}
+
+// Get L4 offset and payload length of a TCP segment that can be merged with
+// its neighbors: plain ACK (optionally PSH), no IP options or fragmentation.
+static inline bool _mergeableTcpSegment(const unsigned char *f,unsigned int len,unsigned int &l4,unsigned int &payloadLen)
+{
+	if ((f[12] == 0x08)&&(f[13] == 0x00)) {
+		if ((len < 54)||(f[14] != 0x45)||(f[23] != 6)||((f[20] & 0x3f) != 0)||(f[21] != 0))
+			return false;
+		if ((((unsigned int)f[16] << 8) | (unsigned int)f[17]) != (len - 14))
+			return false;
+		l4 = 34;
+	} else if ((f[12] == 0x86)&&(f[13] == 0xdd)) {
+		if ((len < 74)||((f[14] >> 4) != 6)||(f[20] != 6))
+			return false;
+		if ((((unsigned int)f[18] << 8) | (unsigned int)f[19]) != (len - 54))
+			return false;
+		l4 = 54;
+	} else return false;
+	const unsigned int thl = (unsigned int)(f[l4 + 12] >> 4) * 4;
+	if ((thl < 20)||((l4 + thl) >= len)||((f[l4 + 13] & ~0x08) != 0x10))
+		return false;
+	payloadLen = len - (l4 + thl);
+	return true;
+}
+
+void LinuxEthernetTap::_flushBatch()
+{
+	const unsigned int slotSize = _mtu + 14;
+	unsigned char hdr[sizeof(_VnetHdr) + 128];
+	struct iovec iov[ZT_LINUX_TAP_PUT_BATCH_SIZE + 1];
+
+	for(unsigned int i=0;i<_batchCount;) {
+		unsigned char *const f = _batchBuf + (i * slotSize);
+		const unsigned int flen = _batchLen[i];
+		const MAC to(f,6),from(f + 6,6);
+		const unsigned int etherType = ((unsigned int)f[12] << 8) | (unsigned int)f[13];
+		const int fd = _queueFd(etherType,f + 14,flen - 14,from,to);
+
+		// Find the longest run of in-order segments that the kernel can take
+		// as one GSO frame: same flow, ACK, window and options, all full-sized
+		// except possibly the last, and PSH only on the last.
+		unsigned int l4 = 0,mss = 0,n = 1;
+		if ((_mergeableTcpSegment(f,flen,l4,mss))&&(!(f[l4 + 13] & 0x08))) {
+			const unsigned int hdrLen = flen - mss;
+			uint32_t nextSeq = (((uint32_t)f[l4 + 4] << 24) | ((uint32_t)f[l4 + 5] << 16) | ((uint32_t)f[l4 + 6] << 8) | (uint32_t)f[l4 + 7]) + mss;
+			unsigned int total = mss;
+			while ((i + n) < _batchCount) {
+				const unsigned char *const g = _batchBuf + ((i + n) * slotSize);
+				const unsigned int glen = _batchLen[i + n];
+				unsigned int gl4 = 0,gpl = 0;
+				if ((!_mergeableTcpSegment(g,glen,gl4,gpl))||(gl4 != l4)||(gpl > mss)||((glen - gpl) != hdrLen)||((hdrLen + total + gpl) > 65535))
+					break;
+				if (memcmp(f,g,14) != 0)
+					break;
+				if ((l4 == 34) ? ((f[15] != g[15])||(f[22] != g[22])||(memcmp(f + 26,g + 26,8) != 0)) : ((memcmp(f + 14,g + 14,4) != 0)||(f[21] != g[21])||(memcmp(f + 22,g + 22,32) != 0)))
+					break; // different IP addresses, TOS/traffic class or TTL
+				const uint32_t gseq = ((uint32_t)g[l4 + 4] << 24) | ((uint32_t)g[l4 + 5] << 16) | ((uint32_t)g[l4 + 6] << 8) | (uint32_t)g[l4 + 7];
+				if ((gseq != nextSeq)||(memcmp(f + l4,g + l4,4) != 0)||(memcmp(f + l4 + 8,g + l4 + 8,4) != 0)||(memcmp(f + l4 + 14,g + l4 + 14,2) != 0)||(memcmp(f + l4 + 20,g + l4 + 20,hdrLen - (l4 + 20)) != 0))
+					break; // not the next segment, or ports, ACK, window or options differ
+				++n;
+				total += gpl;
+				nextSeq += gpl;
+				if ((gpl < mss)||(g[l4 + 13] & 0x08))
+					break; // short or PSH segment ends the run
+			}
+
+			if (n > 1) {
+				_VnetHdr *const vh = (_VnetHdr *)hdr;
+				unsigned char *const h = hdr + sizeof(_VnetHdr);
+				memcpy(h,f,hdrLen);
+				const unsigned int tcpLen = (hdrLen - l4) + total;
+				uint64_t sum;
+				if (l4 == 34) {
+					h[16] = (unsigned char)((hdrLen + total - 14) >> 8);
+					h[17] = (unsigned char)(hdrLen + total - 14);
+					h[24] = 0;
+					h[25] = 0;
+					_csumStore(h + 24,_csumAdd(h + 14,20,0));
+					sum = _csumAdd(h + 26,8,0);
+				} else {
+					h[18] = (unsigned char)((hdrLen + total - 54) >> 8);
+					h[19] = (unsigned char)(hdrLen + total - 54);
+					sum = _csumAdd(h + 22,32,0);
+				}
+				h[l4 + 13] = (_batchBuf + ((i + n - 1) * slotSize))[l4 + 13]; // PSH from last segment
+
+				// Leave the pseudo-header sum in the checksum field and let
+				// the kernel finish it (or skip it for local delivery).
+				sum += 6 + tcpLen;
+				while (sum >> 16)
+					sum = (sum & 0xffff) + (sum >> 16);
+				h[l4 + 16] = (unsigned char)(sum >> 8);
+				h[l4 + 17] = (unsigned char)sum;
+
+				vh->flags = ZT_VNET_HDR_F_NEEDS_CSUM;
+				vh->gso_type = (l4 == 34) ? ZT_VNET_HDR_GSO_TCPV4 : ZT_VNET_HDR_GSO_TCPV6;
+				vh->hdr_len = (uint16_t)hdrLen;
+				vh->gso_size = (uint16_t)mss;
+				vh->csum_start = (uint16_t)l4;
+				vh->csum_offset = 16;
+
+				iov[0].iov_base = hdr;
+				iov[0].iov_len = sizeof(_VnetHdr) + hdrLen;
+				for(unsigned int k=0;k<n;++k) {
+					iov[k + 1].iov_base = _batchBuf + ((i + k) * slotSize) + hdrLen;
+					iov[k + 1].iov_len = _batchLen[i + k] - hdrLen;
+				}
+				::writev(fd,iov,(int)(n + 1));
+				i += n;
+				continue;
+			}
+		}
+
+		memset(hdr,0,sizeof(_VnetHdr));
+		iov[0].iov_base = hdr;
+		iov[0].iov_len = sizeof(_VnetHdr);
+		iov[1].iov_base = f;
+		iov[1].iov_len = flen;
+		::writev(fd,iov,2);
+		++i;
+	}
+	_batchCount = 0;
+}
+
+void LinuxEthernetTap::_readQueue(int fd)
 	throw()
 {
 	fd_set readfds,nullfds;
 	MAC to,from;
 	int n,nfds,r;
 	char getBuf[8194];
+	unsigned char offloadBuf[sizeof(_VnetHdr) + ZT_LINUX_TAP_OFFLOAD_MAX_FRAME];
 
 	Thread::sleep(500);
 
 	FD_ZERO(&readfds);
 	FD_ZERO(&nullfds);
-	nfds = (int)std::max(_shutdownSignalPipe[0],_fd) + 1;
+	nfds = (int)std::max(_shutdownSignalPipe[0],fd) + 1;
 
 	r = 0;
 	for(;;) {
 		FD_SET(_shutdownSignalPipe[0],&readfds);
-		FD_SET(_fd,&readfds);
+		FD_SET(fd,&readfds);
 		select(nfds,&readfds,&nullfds,&nullfds,(struct timeval *)0);
 
 		if (FD_ISSET(_shutdownSignalPipe[0],&readfds)) // writes to shutdown pipe terminate thread
 			break;
 
-		if (FD_ISSET(_fd,&readfds)) {
-			n = (int)::read(_fd,getBuf + r,sizeof(getBuf) - r);
-			if (n < 0) {
-				if ((errno != EINTR)&&(errno != ETIMEDOUT))
-					break;
-			} else {
-				// Some tap drivers like to send the ethernet frame and the
-				// payload in two chunks, so handle that by accumulating
-				// data until we have at least a frame.
-				r += n;
-				if (r > 14) {
-					if (r > ((int)_mtu + 14)) // sanity check for weird TAP behavior on some platforms
-						r = _mtu + 14;
-
-					if (_enabled) {
-						to.setTo(getBuf,6);
-						from.setTo(getBuf + 6,6);
-						unsigned int etherType = ntohs(((const uint16_t *)getBuf)[6]);
-						// TODO: VLAN support
-						_handler(_arg,_nwid,from,to,etherType,0,(const void *)(getBuf + 14),r - 14);
+		if (FD_ISSET(fd,&readfds)) {
+			// Drain everything that is queued before going back to select()
+			for(;;) {
+				if (_offload) {
+					// With a vnet header every read returns exactly one (super-)frame
+					n = (int)::read(fd,offloadBuf,sizeof(offloadBuf));
+					if (n > 0) {
+						if ((n > (int)(sizeof(_VnetHdr) + 14))&&(_enabled))
+							_deliverOffloaded(offloadBuf,(unsigned int)n);
+						continue;
 					}
-
-					r = 0;
+				} else {
+					n = (int)::read(fd,getBuf + r,sizeof(getBuf) - r);
+					if (n > 0) {
+						// Some tap drivers like to send the ethernet frame and the
+						// payload in two chunks, so handle that by accumulating
+						// data until we have at least a frame.
+						r += n;
+						if (r > 14) {
+							if (r > ((int)_mtu + 14)) // sanity check for weird TAP behavior on some platforms
+								r = _mtu + 14;
+
+							if (_enabled) {
+								to.setTo(getBuf,6);
+								from.setTo(getBuf + 6,6);
+								unsigned int etherType = ntohs(((const uint16_t *)getBuf)[6]);
+								// TODO: VLAN support
+								_handler(_arg,_nwid,from,to,etherType,0,(const void *)(getBuf + 14),r - 14);
+							}
+
+							r = 0;
+						}
+						continue;
+					}
+				}
+				if (n < 0) {
+					if (errno == EINTR)
+						continue;
+					if ((errno != ETIMEDOUT)&&(errno != EAGAIN)&&(errno != EWOULDBLOCK))
+						return;
 				}
+				break;
 			}
 		}
 	}
@@ -36,12 +36,40 @@
 #include <stdexcept>
 
 #include "../node/MulticastGroup.hpp"
+#include "../node/Mutex.hpp"
 #include "Thread.hpp"
 
+/**
+ * Maximum number of IFF_MULTI_QUEUE queues per tap device
+ */
+#define ZT_LINUX_TAP_MAX_QUEUES 16
+
+/**
+ * Largest (super-)frame read from the tap in offload mode
+ */
+#define ZT_LINUX_TAP_OFFLOAD_MAX_FRAME 65550
+
+/**
+ * Maximum number of frames held by putQueued() before a flush is forced
+ */
+#define ZT_LINUX_TAP_PUT_BATCH_SIZE 64
+
 namespace ZeroTier {
 
 /**
  * Linux Ethernet tap using kernel tun/tap driver
+ *
+ * If more than one queue is requested and the kernel supports it, the
+ * device is opened with IFF_MULTI_QUEUE and each queue gets its own file
+ * descriptor and reader thread. Outgoing frames are spread across queues
+ * by flow hash so that frames belonging to one flow stay in order.
+ *
+ * In offload mode the device is opened with IFF_VNET_HDR and advertises
+ * checksum offload and TSO to the kernel. Reads then return TCP
+ * super-frames of up to 64KB, which are cut into MTU-sized frames (with
+ * checksums completed) before they are handed to the core. In the other
+ * direction, putQueued() and flushQueued() merge consecutive segments of
+ * one TCP flow back into a single GSO super-frame per write.
  */
 class LinuxEthernetTap
 {
@@ -54,7 +82,9 @@ public:
 		uint64_t nwid,
 		const char *friendlyName,
 		void (*handler)(void *,uint64_t,const MAC &,const MAC &,unsigned int,unsigned int,const void *,unsigned int),
-		void *arg);
+		void *arg,
+		unsigned int queues = 1,
+		bool offload = false);
 
 	~LinuxEthernetTap();
 
@@ -64,24 +94,83 @@ public:
 	bool removeIp(const InetAddress &ip);
 	std::vector<InetAddress> ips() const;
 	void put(const MAC &from,const MAC &to,unsigned int etherType,const void *data,unsigned int len);
+
+	/**
+	 * Queue a frame to be written on the next flushQueued()
+	 *
+	 * In offload mode, runs of in-order TCP segments of one flow are then
+	 * written to the kernel as one super-frame. Without offload there is
+	 * nothing to gain by holding frames, so this is the same as put().
+	 * Callers must call flushQueued() when done with a batch, e.g. at the
+	 * end of each I/O poll cycle.
+	 */
+	void putQueued(const MAC &from,const MAC &to,unsigned int etherType,const void *data,unsigned int len);
+
+	/**
+	 * Write all frames queued by putQueued()
+	 */
+	void flushQueued();
 	std::string deviceName() const;
 	void setFriendlyName(const char *friendlyName);
 	void scanMulticastGroups(std::vector<MulticastGroup> &added,std::vector<MulticastGroup> &removed);
 
-	void threadMain()
-		throw();
+	/**
+	 * @return Number of kernel queues actually in use (may be fewer than requested)
+	 */
+	inline unsigned int queues() const throw() { return (unsigned int)_fds.size(); }
+
+	/**
+	 * @return True if this tap uses IFF_VNET_HDR checksum/TSO offload
+	 */
+	inline bool offload() const throw() { return _offload; }
 
 private:
+	// Per-queue reader thread context
+	class _QueueReader
+	{
+	public:
+		_QueueReader(LinuxEthernetTap *p,int f) : parent(p),fd(f) {}
+		inline void threadMain() throw() { parent->_readQueue(fd); }
+		LinuxEthernetTap *parent;
+		int fd;
+		Thread thread;
+	};
+
+	void _readQueue(int fd)
+		throw();
+
+	void _deliverOffloaded(unsigned char *buf,unsigned int len)
+		throw();
+
+	void _flushBatch(); // _batch_m must be locked
+
+	inline int _queueFd(unsigned int etherType,const void *data,unsigned int len,const MAC &from,const MAC &to) const throw()
+	{
+		const unsigned int nq = (unsigned int)_fds.size();
+		return (nq > 1) ? _fds[_flowHash(etherType,data,len,from,to) % nq] : _fds[0];
+	}
+
+	static unsigned int _flowHash(unsigned int etherType,const void *data,unsigned int len,const MAC &from,const MAC &to)
+		throw();
+
 	void (*_handler)(void *,uint64_t,const MAC &,const MAC &,unsigned int,unsigned int,const void *,unsigned int);
 	void *_arg;
 	uint64_t _nwid;
-	Thread _thread;
 	std::string _homePath;
 	std::string _dev;
 	std::vector<MulticastGroup> _multicastGroups;
 	unsigned int _mtu;
-	int _fd;
+	bool _offload;
+	std::vector<int> _fds;
+	std::vector<_QueueReader *> _readers;
 	int _shutdownSignalPipe[2];
+
+	// Frames held by putQueued(), each stored with its Ethernet header
+	unsigned char *_batchBuf;
+	unsigned int _batchLen[ZT_LINUX_TAP_PUT_BATCH_SIZE];
+	unsigned int _batchCount;
+	Mutex _batch_m;
+
 	volatile bool _enabled;
 };
 
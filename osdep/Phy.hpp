@@ -31,8 +31,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
 #include <list>
+#include <vector>
+#include <algorithm>
 #include <stdexcept>
 
 #if defined(_WIN32) || defined(_WIN64)
@@ -68,18 +71,51 @@
 #ifndef IPV6_DONTFRAG
 #define IPV6_DONTFRAG 62
 #endif
+// Use epoll() instead of select() on Linux unless told not to
+#ifndef ZT_PHY_NO_EPOLL
+#define ZT_PHY_USE_EPOLL 1
+#endif
+// Use recvmmsg() and sendmmsg() for batched UDP I/O (sendmmsg() needs glibc 2.14+)
+#if !defined(ZT_PHY_NO_MMSG) && defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+#if __GLIBC_PREREQ(2,14)
+#define ZT_PHY_USE_MMSG 1
+#endif
+#endif
+#endif
+
+#ifdef ZT_PHY_USE_EPOLL
+#include <sys/epoll.h>
+#endif
+#ifdef ZT_PHY_USE_MMSG
+#include <pthread.h>
 #endif
 
 #define ZT_PHY_SOCKFD_TYPE int
 #define ZT_PHY_SOCKFD_NULL (-1)
 #define ZT_PHY_SOCKFD_VALID(s) ((s) > -1)
 #define ZT_PHY_CLOSE_SOCKET(s) ::close(s)
+#ifdef ZT_PHY_USE_EPOLL
+// epoll has no descriptor set size limit; the OS file descriptor limit applies
+#define ZT_PHY_MAX_SOCKETS 0x7fffffff
+// Maximum number of events to retrieve and handle per poll() call
+#define ZT_PHY_EPOLL_MAX_EVENTS 256
+#else
 #define ZT_PHY_MAX_SOCKETS (FD_SETSIZE)
+#endif
 #define ZT_PHY_MAX_INTERCEPTS ZT_PHY_MAX_SOCKETS
 #define ZT_PHY_SOCKADDR_STORAGE_TYPE struct sockaddr_storage
 
 #endif // Windows or not
 
+// Maximum number of datagrams received or sent per recvmmsg()/sendmmsg() call
+#define ZT_PHY_UDP_BATCH_SIZE 32
+
+// Maximum size of a datagram received via recvmmsg() (larger ones are dropped)
+#define ZT_PHY_UDP_BATCH_MAX_RX_DATAGRAM 16384
+
+// Maximum size of a datagram that can be queued with udpSendQueued() (larger ones are sent at once)
+#define ZT_PHY_UDP_BATCH_MAX_TX_DATAGRAM 2048
+
 namespace ZeroTier {
 
 /**
@@ -131,12 +167,38 @@ typedef void PhySocket;
  * handler, and in that case close() can be told not to call handlers to
  * prevent recursion.
  *
+ * On Linux epoll() is used instead of select(). This removes the FD_SETSIZE
+ * limit on the number of sockets and makes the cost of poll() proportional
+ * to the number of sockets that are actually ready. Define ZT_PHY_NO_EPOLL
+ * to force the use of select().
+ *
+ * Also on Linux, UDP sockets are drained with recvmmsg() and datagrams sent
+ * with udpSendQueued() are coalesced into sendmmsg() calls. Define
+ * ZT_PHY_NO_MMSG to disable this.
+ *
  * This isn't thread-safe with the exception of whack(), which is safe to
  * call from another thread to abort poll().
  */
 template <typename HANDLER_PTR_TYPE>
 class Phy
 {
+public:
+	/**
+	 * Counters for batched UDP I/O
+	 *
+	 * These are only incremented on platforms that support recvmmsg() and
+	 * sendmmsg(). Average batch size is datagrams divided by calls.
+	 */
+	struct UdpBatchCounters
+	{
+		uint64_t rxCalls; // recvmmsg() calls that returned at least one datagram
+		uint64_t rxDatagrams; // datagrams received by recvmmsg()
+		uint64_t rxMaxBatch; // largest number of datagrams returned by one recvmmsg()
+		uint64_t txCalls; // sendmmsg() calls that sent at least one datagram
+		uint64_t txDatagrams; // datagrams sent by sendmmsg()
+		uint64_t txMaxBatch; // largest number of datagrams sent by one sendmmsg()
+	};
+
 private:
 	HANDLER_PTR_TYPE _handler;
 
@@ -153,21 +215,61 @@ private:
 		ZT_PHY_SOCKET_UNIX_LISTEN = 0x08
 	};
 
+#ifdef ZT_PHY_USE_MMSG
+	struct UdpRxBatch
+	{
+		struct mmsghdr msgs[ZT_PHY_UDP_BATCH_SIZE];
+		struct iovec iov[ZT_PHY_UDP_BATCH_SIZE];
+		struct sockaddr_storage from[ZT_PHY_UDP_BATCH_SIZE];
+		char data[ZT_PHY_UDP_BATCH_SIZE][ZT_PHY_UDP_BATCH_MAX_RX_DATAGRAM];
+	};
+
+	struct UdpTxQueue
+	{
+		unsigned int count;
+		unsigned int failedCount; // destinations in failed[]
+		struct sockaddr_storage failed[ZT_PHY_UDP_BATCH_SIZE]; // destinations of queued datagrams that could not be sent
+		struct mmsghdr msgs[ZT_PHY_UDP_BATCH_SIZE];
+		struct iovec iov[ZT_PHY_UDP_BATCH_SIZE];
+		struct sockaddr_storage to[ZT_PHY_UDP_BATCH_SIZE];
+		char data[ZT_PHY_UDP_BATCH_SIZE][ZT_PHY_UDP_BATCH_MAX_TX_DATAGRAM];
+	};
+#endif
+
 	struct PhySocketImpl
 	{
 		PhySocketType type;
 		ZT_PHY_SOCKFD_TYPE sock;
 		void *uptr; // user-settable pointer
 		ZT_PHY_SOCKADDR_STORAGE_TYPE saddr; // remote for TCP_OUT and TCP_IN, local for TCP_LISTEN, RAW, and UDP
+#ifdef ZT_PHY_USE_EPOLL
+		uint32_t events; // epoll events we are currently registered for (0 if not in epoll set)
+#endif
+#ifdef ZT_PHY_USE_MMSG
+		UdpTxQueue *txq; // datagrams queued by udpSendQueued(), allocated on first use
+#endif
 	};
 
 	std::list<PhySocketImpl> _socks;
+#ifdef ZT_PHY_USE_EPOLL
+	int _epfd;
+	bool _haveClosed; // true if _socks contains CLOSED entries awaiting removal
+#else
 	fd_set _readfds;
 	fd_set _writefds;
 #if defined(_WIN32) || defined(_WIN64)
 	fd_set _exceptfds;
 #endif
 	long _nfds;
+#endif
+
+#ifdef ZT_PHY_USE_MMSG
+	UdpRxBatch *_udpRx;
+	std::vector<PhySocketImpl *> _udpTxPending; // UDP sockets with non-empty txq
+	pthread_t _pollThread;
+	bool _pollThreadKnown;
+	bool _mmsgUnavailable; // set if the kernel lacks recvmmsg()/sendmmsg()
+#endif
 
 	ZT_PHY_SOCKFD_TYPE _whackReceiveSocket;
 	ZT_PHY_SOCKFD_TYPE _whackSendSocket;
@@ -175,6 +277,8 @@ private:
 	bool _noDelay;
 	bool _noCheck;
 
+	UdpBatchCounters _udpBatchCounters;
+
 public:
 	/**
 	 * @param handler Pointer of type HANDLER_PTR_TYPE to handler
@@ -184,8 +288,10 @@ public:
 	Phy(HANDLER_PTR_TYPE handler,bool noDelay,bool noCheck) :
 		_handler(handler)
 	{
+#ifndef ZT_PHY_USE_EPOLL
 		FD_ZERO(&_readfds);
 		FD_ZERO(&_writefds);
+#endif
 
 #if defined(_WIN32) || defined(_WIN64)
 		FD_ZERO(&_exceptfds);
@@ -221,11 +327,35 @@ public:
 			throw std::runtime_error("unable to create pipes for select() abort");
 #endif // Windows or not
 
+#ifdef ZT_PHY_USE_EPOLL
+		_epfd = ::epoll_create1(EPOLL_CLOEXEC);
+		if (_epfd < 0) {
+			::close(pipes[0]);
+			::close(pipes[1]);
+			throw std::runtime_error("unable to create epoll descriptor");
+		}
+		{
+			struct epoll_event e;
+			memset(&e,0,sizeof(e));
+			e.events = EPOLLIN;
+			e.data.ptr = (void *)0; // NULL data identifies the whack pipe
+			::epoll_ctl(_epfd,EPOLL_CTL_ADD,pipes[0],&e);
+		}
+		fcntl(pipes[0],F_SETFL,O_NONBLOCK);
+		_haveClosed = false;
+#else
 		_nfds = (pipes[0] > pipes[1]) ? (long)pipes[0] : (long)pipes[1];
+#endif
 		_whackReceiveSocket = pipes[0];
 		_whackSendSocket = pipes[1];
 		_noDelay = noDelay;
 		_noCheck = noCheck;
+		memset(&_udpBatchCounters,0,sizeof(_udpBatchCounters));
+#ifdef ZT_PHY_USE_MMSG
+		_udpRx = new UdpRxBatch;
+		_pollThreadKnown = false;
+		_mmsgUnavailable = false;
+#endif
 	}
 
 	~Phy()
@@ -236,6 +366,12 @@ public:
 		}
 		ZT_PHY_CLOSE_SOCKET(_whackReceiveSocket);
 		ZT_PHY_CLOSE_SOCKET(_whackSendSocket);
+#ifdef ZT_PHY_USE_EPOLL
+		::close(_epfd);
+#endif
+#ifdef ZT_PHY_USE_MMSG
+		delete _udpRx;
+#endif
 	}
 
 	/**
@@ -300,14 +436,12 @@ public:
 			return (PhySocket *)0;
 		}
 		PhySocketImpl &sws = _socks.back();
-		if ((long)fd > _nfds)
-			_nfds = (long)fd;
-		FD_SET(fd,&_readfds);
 		sws.type = ZT_PHY_SOCKET_FD;
 		sws.sock = fd;
 		sws.uptr = uptr;
 		memset(&(sws.saddr),0,sizeof(struct sockaddr_storage));
 		// no sockaddr for this socket type, leave saddr null
+		_setInterest(sws,true,false);
 		return (PhySocket *)&sws;
 	}
 
@@ -317,9 +451,10 @@ public:
 	 * @param localAddress Local endpoint address and port
 	 * @param uptr Initial value of user pointer associated with this socket (default: NULL)
 	 * @param bufferSize Desired socket receive/send buffer size -- will set as close to this as possible (default: 0, leave alone)
+	 * @param reusePort If true, set SO_REUSEPORT so several sockets can share this address and port (if supported, default: false)
 	 * @return Socket or NULL on failure to bind
 	 */
-	inline PhySocket *udpBind(const struct sockaddr *localAddress,void *uptr = (void *)0,int bufferSize = 0)
+	inline PhySocket *udpBind(const struct sockaddr *localAddress,void *uptr = (void *)0,int bufferSize = 0,bool reusePort = false)
 	{
 		if (_socks.size() >= ZT_PHY_MAX_SOCKETS)
 			return (PhySocket *)0;
@@ -355,6 +490,10 @@ public:
 			f = FALSE; setsockopt(s,SOL_SOCKET,SO_REUSEADDR,(const char *)&f,sizeof(f));
 			f = TRUE; setsockopt(s,SOL_SOCKET,SO_BROADCAST,(const char *)&f,sizeof(f));
 		}
+		if (reusePort) { // not supported on Windows
+			ZT_PHY_CLOSE_SOCKET(s);
+			return (PhySocket *)0;
+		}
 #else // not Windows
 		{
 			int f;
@@ -369,6 +508,20 @@ public:
 			}
 			f = 0; setsockopt(s,SOL_SOCKET,SO_REUSEADDR,(void *)&f,sizeof(f));
 			f = 1; setsockopt(s,SOL_SOCKET,SO_BROADCAST,(void *)&f,sizeof(f));
+#ifdef SO_REUSEPORT
+			if (reusePort) {
+				f = 1;
+				if (setsockopt(s,SOL_SOCKET,SO_REUSEPORT,(void *)&f,sizeof(f)) != 0) {
+					ZT_PHY_CLOSE_SOCKET(s);
+					return (PhySocket *)0;
+				}
+			}
+#else
+			if (reusePort) {
+				ZT_PHY_CLOSE_SOCKET(s);
+				return (PhySocket *)0;
+			}
+#endif
 #ifdef IP_DONTFRAG
 			f = 0; setsockopt(s,IPPROTO_IP,IP_DONTFRAG,&f,sizeof(f));
 #endif
@@ -402,14 +555,12 @@ public:
 		}
 		PhySocketImpl &sws = _socks.back();
 
-		if ((long)s > _nfds)
-			_nfds = (long)s;
-		FD_SET(s,&_readfds);
 		sws.type = ZT_PHY_SOCKET_UDP;
 		sws.sock = s;
 		sws.uptr = uptr;
 		memset(&(sws.saddr),0,sizeof(struct sockaddr_storage));
 		memcpy(&(sws.saddr),localAddress,(localAddress->sa_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+		_setInterest(sws,true,false);
 
 		return (PhySocket *)&sws;
 	}
@@ -451,6 +602,93 @@ public:
 #endif
 	}
 
+	/**
+	 * Queue a UDP packet to be sent in a batch
+	 *
+	 * Where sendmmsg() is available, packets queued from the thread that
+	 * runs poll() are copied into a per-socket queue and sent together in
+	 * one system call when the queue fills, right before poll() waits, or
+	 * after poll() has dispatched all events. When called from any other
+	 * thread, or if the packet is too large to queue, or if batching is
+	 * not supported, this is the same as udpSend().
+	 *
+	 * A queued packet is reported as sent, so an error sending it can't
+	 * be returned here. Instead its destination is remembered and the
+	 * next packet queued for that destination is sent at once with
+	 * udpSend() and its real result returned. A destination that has
+	 * become unreachable is thus reported as failing one packet late,
+	 * as if the first packet had been lost on the wire.
+	 *
+	 * @param sock UDP socket
+	 * @param remoteAddress Destination address (must be correct type for socket)
+	 * @param data Data to send
+	 * @param len Length of packet
+	 * @return True if packet appears to have been sent or was queued
+	 */
+	inline bool udpSendQueued(PhySocket *sock,const struct sockaddr *remoteAddress,const void *data,unsigned long len)
+	{
+#ifdef ZT_PHY_USE_MMSG
+		PhySocketImpl &sws = *(reinterpret_cast<PhySocketImpl *>(sock));
+		if ((len > ZT_PHY_UDP_BATCH_MAX_TX_DATAGRAM)||(_mmsgUnavailable)||(!_pollThreadKnown)||(!pthread_equal(pthread_self(),_pollThread)))
+			return udpSend(sock,remoteAddress,data,len);
+		if (!sws.txq) {
+			try {
+				sws.txq = new UdpTxQueue;
+			} catch ( ... ) {
+				return udpSend(sock,remoteAddress,data,len);
+			}
+			sws.txq->count = 0;
+			sws.txq->failedCount = 0;
+		}
+		UdpTxQueue &q = *sws.txq;
+		const socklen_t alen = (remoteAddress->sa_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+		for(unsigned int f=0;f<q.failedCount;++f) {
+			if (memcmp(&(q.failed[f]),remoteAddress,alen) == 0) {
+				q.failed[f] = q.failed[--q.failedCount];
+				return udpSend(sock,remoteAddress,data,len);
+			}
+		}
+		if (q.count >= ZT_PHY_UDP_BATCH_SIZE)
+			_udpFlush(sws); // socket remains in _udpTxPending
+		else if (!q.count)
+			_udpTxPending.push_back(&sws);
+		const unsigned int i = q.count++;
+		memcpy(&(q.to[i]),remoteAddress,alen);
+		memcpy(q.data[i],data,len);
+		q.iov[i].iov_base = q.data[i];
+		q.iov[i].iov_len = len;
+		memset(&(q.msgs[i]),0,sizeof(struct mmsghdr));
+		q.msgs[i].msg_hdr.msg_name = &(q.to[i]);
+		q.msgs[i].msg_hdr.msg_namelen = alen;
+		q.msgs[i].msg_hdr.msg_iov = &(q.iov[i]);
+		q.msgs[i].msg_hdr.msg_iovlen = 1;
+		return true;
+#else
+		return udpSend(sock,remoteAddress,data,len);
+#endif
+	}
+
+	/**
+	 * Send all packets queued with udpSendQueued() now
+	 *
+	 * This is done automatically by poll(), so it only needs to be called
+	 * explicitly if packets are queued and poll() will not be called soon.
+	 * It must only be called from the thread that runs poll().
+	 */
+	inline void udpFlushQueued()
+	{
+#ifdef ZT_PHY_USE_MMSG
+		for(typename std::vector<PhySocketImpl *>::const_iterator s(_udpTxPending.begin());s!=_udpTxPending.end();++s)
+			_udpFlush(**s);
+		_udpTxPending.clear();
+#endif
+	}
+
+	/**
+	 * @return Counters for batched UDP receive and send
+	 */
+	inline const UdpBatchCounters &udpBatchCounters() const throw() { return _udpBatchCounters; }
+
 #ifdef __UNIX_LIKE__
 	/**
 	 * Listen for connections on a Unix domain socket
@@ -496,14 +734,12 @@ public:
 		}
 		PhySocketImpl &sws = _socks.back();
 
-		if ((long)s > _nfds)
-			_nfds = (long)s;
-		FD_SET(s,&_readfds);
 		sws.type = ZT_PHY_SOCKET_UNIX_LISTEN;
 		sws.sock = s;
 		sws.uptr = uptr;
 		memset(&(sws.saddr),0,sizeof(struct sockaddr_storage));
 		memcpy(&(sws.saddr),&sun,sizeof(struct sockaddr_un));
+		_setInterest(sws,true,false);
 
 		return (PhySocket *)&sws;
 	}
@@ -562,14 +798,12 @@ public:
 		}
 		PhySocketImpl &sws = _socks.back();
 
-		if ((long)s > _nfds)
-			_nfds = (long)s;
-		FD_SET(s,&_readfds);
 		sws.type = ZT_PHY_SOCKET_TCP_LISTEN;
 		sws.sock = s;
 		sws.uptr = uptr;
 		memset(&(sws.saddr),0,sizeof(struct sockaddr_storage));
 		memcpy(&(sws.saddr),localAddress,(localAddress->sa_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+		_setInterest(sws,true,false);
 
 		return (PhySocket *)&sws;
 	}
@@ -647,22 +881,20 @@ public:
 		}
 		PhySocketImpl &sws = _socks.back();
 
-		if ((long)s > _nfds)
-			_nfds = (long)s;
+		sws.sock = s;
+		sws.uptr = uptr;
+		memset(&(sws.saddr),0,sizeof(struct sockaddr_storage));
+		memcpy(&(sws.saddr),remoteAddress,(remoteAddress->sa_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
 		if (connected) {
-			FD_SET(s,&_readfds);
 			sws.type = ZT_PHY_SOCKET_TCP_OUT_CONNECTED;
+			_setInterest(sws,true,false);
 		} else {
-			FD_SET(s,&_writefds);
+			sws.type = ZT_PHY_SOCKET_TCP_OUT_PENDING;
+			_setInterest(sws,false,true);
 #if defined(_WIN32) || defined(_WIN64)
 			FD_SET(s,&_exceptfds);
 #endif
-			sws.type = ZT_PHY_SOCKET_TCP_OUT_PENDING;
 		}
-		sws.sock = s;
-		sws.uptr = uptr;
-		memset(&(sws.saddr),0,sizeof(struct sockaddr_storage));
-		memcpy(&(sws.saddr),remoteAddress,(remoteAddress->sa_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
 
 		if ((callConnectHandler)&&(connected)) {
 			try {
@@ -810,11 +1042,7 @@ public:
 	inline const void setNotifyWritable(PhySocket *sock,bool notifyWritable)
 	{
 		PhySocketImpl &sws = *(reinterpret_cast<PhySocketImpl *>(sock));
-		if (notifyWritable) {
-			FD_SET(sws.sock,&_writefds);
-		} else {
-			FD_CLR(sws.sock,&_writefds);
-		}
+		_setInterest(sws,_readInterest(sws),notifyWritable);
 	}
 
 	/**
@@ -830,11 +1058,7 @@ public:
 	inline const void setNotifyReadable(PhySocket *sock,bool notifyReadable)
 	{
 		PhySocketImpl &sws = *(reinterpret_cast<PhySocketImpl *>(sock));
-		if (notifyReadable) {
-			FD_SET(sws.sock,&_readfds);
-		} else {
-			FD_CLR(sws.sock,&_readfds);
-		}
+		_setInterest(sws,notifyReadable,_writeInterest(sws));
 	}
 
 	/**
@@ -850,6 +1074,46 @@ public:
 	{
 		char buf[131072];
 		struct sockaddr_storage ss;
+
+#ifdef ZT_PHY_USE_MMSG
+		if (!_pollThreadKnown) {
+			_pollThread = pthread_self();
+			_pollThreadKnown = true;
+		}
+		udpFlushQueued();
+#endif
+
+#ifdef ZT_PHY_USE_EPOLL
+		struct epoll_event events[ZT_PHY_EPOLL_MAX_EVENTS];
+
+		const int n = ::epoll_wait(_epfd,events,ZT_PHY_EPOLL_MAX_EVENTS,(timeout > 0) ? (int)timeout : -1);
+		for(int i=0;i<n;++i) {
+			PhySocketImpl *const s = reinterpret_cast<PhySocketImpl *>(events[i].data.ptr);
+			if (!s) {
+				char tmp[16];
+				while (::read(_whackReceiveSocket,tmp,16) == 16) {}
+				continue;
+			}
+			if (s->type == ZT_PHY_SOCKET_CLOSED) // may have been closed by a handler earlier in this loop
+				continue;
+			// Errors and hangups are reported as readability/writability as with select()
+			const uint32_t ev = events[i].events;
+			_dispatch(*s,((ev & (EPOLLIN | EPOLLERR | EPOLLHUP)) != 0)&&(_readInterest(*s)),((ev & (EPOLLOUT | EPOLLERR | EPOLLHUP)) != 0)&&(_writeInterest(*s)),buf,sizeof(buf),ss);
+		}
+
+		if (_haveClosed) {
+			_haveClosed = false;
+			for(typename std::list<PhySocketImpl>::iterator s(_socks.begin());s!=_socks.end();) {
+				if (s->type == ZT_PHY_SOCKET_CLOSED)
+					_socks.erase(s++);
+				else ++s;
+			}
+		}
+
+#ifdef ZT_PHY_USE_MMSG
+		udpFlushQueued();
+#endif
+#else // select()
 		struct timeval tv;
 		fd_set rfds,wfds,efds;
 
@@ -876,171 +1140,25 @@ public:
 		}
 
 		for(typename std::list<PhySocketImpl>::iterator s(_socks.begin());s!=_socks.end();) {
-			switch (s->type) {
-
-				case ZT_PHY_SOCKET_TCP_OUT_PENDING:
-#if defined(_WIN32) || defined(_WIN64)
-					if (FD_ISSET(s->sock,&efds)) {
-						this->close((PhySocket *)&(*s),true);
-					} else // ... if
-#endif
-					if (FD_ISSET(s->sock,&wfds)) {
-						socklen_t slen = sizeof(ss);
-						if (::getpeername(s->sock,(struct sockaddr *)&ss,&slen) != 0) {
-							this->close((PhySocket *)&(*s),true);
-						} else {
-							s->type = ZT_PHY_SOCKET_TCP_OUT_CONNECTED;
-							FD_SET(s->sock,&_readfds);
-							FD_CLR(s->sock,&_writefds);
+			if (s->type != ZT_PHY_SOCKET_CLOSED) {
+				const ZT_PHY_SOCKFD_TYPE sock = s->sock;
 #if defined(_WIN32) || defined(_WIN64)
-							FD_CLR(s->sock,&_exceptfds);
+				if ((s->type == ZT_PHY_SOCKET_TCP_OUT_PENDING)&&(FD_ISSET(sock,&efds))) {
+					this->close((PhySocket *)&(*s),true);
+				} else
 #endif
-							try {
-								_handler->phyOnTcpConnect((PhySocket *)&(*s),&(s->uptr),true);
-							} catch ( ... ) {}
-						}
-					}
-					break;
-
-				case ZT_PHY_SOCKET_TCP_OUT_CONNECTED:
-				case ZT_PHY_SOCKET_TCP_IN: {
-					ZT_PHY_SOCKFD_TYPE sock = s->sock; // if closed, s->sock becomes invalid as s is no longer dereferencable
-					if (FD_ISSET(sock,&rfds)) {
-						long n = (long)::recv(sock,buf,sizeof(buf),0);
-						if (n <= 0) {
-							this->close((PhySocket *)&(*s),true);
-						} else {
-							try {
-								_handler->phyOnTcpData((PhySocket *)&(*s),&(s->uptr),(void *)buf,(unsigned long)n);
-							} catch ( ... ) {}
-						}
-					}
-					if ((FD_ISSET(sock,&wfds))&&(FD_ISSET(sock,&_writefds))) {
-						try {
-							_handler->phyOnTcpWritable((PhySocket *)&(*s),&(s->uptr));
-						} catch ( ... ) {}
-					}
-				}	break;
-
-				case ZT_PHY_SOCKET_TCP_LISTEN:
-					if (FD_ISSET(s->sock,&rfds)) {
-						memset(&ss,0,sizeof(ss));
-						socklen_t slen = sizeof(ss);
-						ZT_PHY_SOCKFD_TYPE newSock = ::accept(s->sock,(struct sockaddr *)&ss,&slen);
-						if (ZT_PHY_SOCKFD_VALID(newSock)) {
-							if (_socks.size() >= ZT_PHY_MAX_SOCKETS) {
-								ZT_PHY_CLOSE_SOCKET(newSock);
-							} else {
-#if defined(_WIN32) || defined(_WIN64)
-								{ BOOL f = (_noDelay ? TRUE : FALSE); setsockopt(newSock,IPPROTO_TCP,TCP_NODELAY,(char *)&f,sizeof(f)); }
-								{ u_long iMode=1; ioctlsocket(newSock,FIONBIO,&iMode); }
-#else
-								{ int f = (_noDelay ? 1 : 0); setsockopt(newSock,IPPROTO_TCP,TCP_NODELAY,(char *)&f,sizeof(f)); }
-								fcntl(newSock,F_SETFL,O_NONBLOCK);
-#endif
-								_socks.push_back(PhySocketImpl());
-								PhySocketImpl &sws = _socks.back();
-								FD_SET(newSock,&_readfds);
-								if ((long)newSock > _nfds)
-									_nfds = (long)newSock;
-								sws.type = ZT_PHY_SOCKET_TCP_IN;
-								sws.sock = newSock;
-								sws.uptr = (void *)0;
-								memcpy(&(sws.saddr),&ss,sizeof(struct sockaddr_storage));
-								try {
-									_handler->phyOnTcpAccept((PhySocket *)&(*s),(PhySocket *)&(_socks.back()),&(s->uptr),&(sws.uptr),(const struct sockaddr *)&(sws.saddr));
-								} catch ( ... ) {}
-							}
-						}
-					}
-					break;
-
-				case ZT_PHY_SOCKET_UDP:
-					if (FD_ISSET(s->sock,&rfds)) {
-						for(;;) {
-							memset(&ss,0,sizeof(ss));
-							socklen_t slen = sizeof(ss);
-							long n = (long)::recvfrom(s->sock,buf,sizeof(buf),0,(struct sockaddr *)&ss,&slen);
-							if (n > 0) {
-								try {
-									_handler->phyOnDatagram((PhySocket *)&(*s),&(s->uptr),(const struct sockaddr *)&ss,(void *)buf,(unsigned long)n);
-								} catch ( ... ) {}
-							} else if (n < 0)
-								break;
-						}
-					}
-					break;
-
-				case ZT_PHY_SOCKET_UNIX_IN: {
-#ifdef __UNIX_LIKE__
-					ZT_PHY_SOCKFD_TYPE sock = s->sock; // if closed, s->sock becomes invalid as s is no longer dereferencable
-					if (FD_ISSET(sock,&rfds)) {
-						long n = (long)::read(sock,buf,sizeof(buf));
-						if (n <= 0) {
-							this->close((PhySocket *)&(*s),true);
-						} else {
-							try {
-								_handler->phyOnUnixData((PhySocket *)&(*s),&(s->uptr),(void *)buf,(unsigned long)n);
-							} catch ( ... ) {}
-						}
-					}
-					if ((FD_ISSET(sock,&wfds))&&(FD_ISSET(sock,&_writefds))) {
-						try {
-							//_handler->phyOnUnixWritable((PhySocket *)&(*s),&(s->uptr));
-						} catch ( ... ) {}
-					}
-#endif // __UNIX_LIKE__
-				}	break;
-
-				case ZT_PHY_SOCKET_UNIX_LISTEN:
-#ifdef __UNIX_LIKE__
-					if (FD_ISSET(s->sock,&rfds)) {
-						memset(&ss,0,sizeof(ss));
-						socklen_t slen = sizeof(ss);
-						ZT_PHY_SOCKFD_TYPE newSock = ::accept(s->sock,(struct sockaddr *)&ss,&slen);
-						if (ZT_PHY_SOCKFD_VALID(newSock)) {
-							if (_socks.size() >= ZT_PHY_MAX_SOCKETS) {
-								ZT_PHY_CLOSE_SOCKET(newSock);
-							} else {
-								fcntl(newSock,F_SETFL,O_NONBLOCK);
-								_socks.push_back(PhySocketImpl());
-								PhySocketImpl &sws = _socks.back();
-								FD_SET(newSock,&_readfds);
-								if ((long)newSock > _nfds)
-									_nfds = (long)newSock;
-								sws.type = ZT_PHY_SOCKET_UNIX_IN;
-								sws.sock = newSock;
-								sws.uptr = (void *)0;
-								memcpy(&(sws.saddr),&ss,sizeof(struct sockaddr_storage));
-								try {
-									_handler->phyOnUnixAccept((PhySocket *)&(*s),(PhySocket *)&(_socks.back()),&(s->uptr),&(sws.uptr));
-								} catch ( ... ) {}
-							}
-						}
-					}
-#endif // __UNIX_LIKE__
-					break;
-
-				case ZT_PHY_SOCKET_FD: {
-					ZT_PHY_SOCKFD_TYPE sock = s->sock;
-					const bool readable = ((FD_ISSET(sock,&rfds))&&(FD_ISSET(sock,&_readfds)));
-					const bool writable = ((FD_ISSET(sock,&wfds))&&(FD_ISSET(sock,&_writefds)));
-					if ((readable)||(writable)) {
-						try {
-							_handler->phyOnFileDescriptorActivity((PhySocket *)&(*s),&(s->uptr),readable,writable);
-						} catch ( ... ) {}
-					}
-				}	break;
-
-				default:
-					break;
-
+				_dispatch(*s,((FD_ISSET(sock,&rfds))&&(FD_ISSET(sock,&_readfds))),((FD_ISSET(sock,&wfds))&&(FD_ISSET(sock,&_writefds))),buf,sizeof(buf),ss);
 			}
 
 			if (s->type == ZT_PHY_SOCKET_CLOSED)
 				_socks.erase(s++);
 			else ++s;
 		}
+
+#ifdef ZT_PHY_USE_MMSG
+		udpFlushQueued();
+#endif
+#endif // epoll or select
 	}
 
 	/**
@@ -1055,8 +1173,17 @@ public:
 		if (sws.type == ZT_PHY_SOCKET_CLOSED)
 			return;
 
-		FD_CLR(sws.sock,&_readfds);
-		FD_CLR(sws.sock,&_writefds);
+		// Remove from select/epoll set before closing, since FD sockets are not closed here
+		_setInterest(sws,false,false);
+
+#ifdef ZT_PHY_USE_MMSG
+		if (sws.txq) {
+			_udpFlush(sws);
+			_udpTxPending.erase(std::remove(_udpTxPending.begin(),_udpTxPending.end(),&sws),_udpTxPending.end());
+			delete sws.txq;
+			sws.txq = (UdpTxQueue *)0;
+		}
+#endif
 #if defined(_WIN32) || defined(_WIN64)
 		FD_CLR(sws.sock,&_exceptfds);
 #endif
@@ -1097,6 +1224,9 @@ public:
 		// Causes entry to be deleted from list in poll(), ignored elsewhere
 		sws.type = ZT_PHY_SOCKET_CLOSED;
 
+#ifdef ZT_PHY_USE_EPOLL
+		_haveClosed = true;
+#else
 		if ((long)sws.sock >= (long)_nfds) {
 			long nfds = (long)_whackSendSocket;
 			if ((long)_whackReceiveSocket > nfds)
@@ -1107,6 +1237,294 @@ public:
 			}
 			_nfds = nfds;
 		}
+#endif
+	}
+
+private:
+	inline bool _readInterest(const PhySocketImpl &sws) const
+	{
+#ifdef ZT_PHY_USE_EPOLL
+		return ((sws.events & EPOLLIN) != 0);
+#else
+		return (FD_ISSET(sws.sock,&_readfds) != 0);
+#endif
+	}
+
+	inline bool _writeInterest(const PhySocketImpl &sws) const
+	{
+#ifdef ZT_PHY_USE_EPOLL
+		return ((sws.events & EPOLLOUT) != 0);
+#else
+		return (FD_ISSET(sws.sock,&_writefds) != 0);
+#endif
+	}
+
+	// Set whether we are waiting for readability and/or writability on a socket
+	inline void _setInterest(PhySocketImpl &sws,bool readable,bool writable)
+	{
+		if (sws.type == ZT_PHY_SOCKET_CLOSED)
+			return;
+#ifdef ZT_PHY_USE_EPOLL
+		const uint32_t ev = (readable ? (uint32_t)EPOLLIN : (uint32_t)0) | (writable ? (uint32_t)EPOLLOUT : (uint32_t)0);
+		if (ev != sws.events) {
+			// Sockets with no interest are removed from the epoll set entirely, since
+			// otherwise level-triggered EPOLLERR/EPOLLHUP would wake us continuously.
+			struct epoll_event e;
+			memset(&e,0,sizeof(e));
+			e.events = ev;
+			e.data.ptr = (void *)&sws;
+			if (!sws.events)
+				::epoll_ctl(_epfd,EPOLL_CTL_ADD,sws.sock,&e);
+			else if (!ev)
+				::epoll_ctl(_epfd,EPOLL_CTL_DEL,sws.sock,&e);
+			else ::epoll_ctl(_epfd,EPOLL_CTL_MOD,sws.sock,&e);
+			sws.events = ev;
+		}
+#else
+		if ((readable||writable)&&((long)sws.sock > _nfds))
+			_nfds = (long)sws.sock;
+		if (readable) {
+			FD_SET(sws.sock,&_readfds);
+		} else {
+			FD_CLR(sws.sock,&_readfds);
+		}
+		if (writable) {
+			FD_SET(sws.sock,&_writefds);
+		} else {
+			FD_CLR(sws.sock,&_writefds);
+		}
+#endif
+	}
+
+#ifdef ZT_PHY_USE_MMSG
+	// Send everything in a UDP socket's txq with as few sendmmsg() calls as possible
+	inline void _udpFlush(PhySocketImpl &sws)
+	{
+		UdpTxQueue &q = *sws.txq;
+		unsigned int sent = 0;
+		while (sent < q.count) {
+			const int n = ::sendmmsg(sws.sock,q.msgs + sent,q.count - sent,0);
+			if (n <= 0) {
+				if ((n < 0)&&(errno == ENOSYS)) {
+					_mmsgUnavailable = true;
+					for(;sent<q.count;++sent) {
+						if ((long)::sendto(sws.sock,q.data[sent],q.iov[sent].iov_len,0,(const struct sockaddr *)&(q.to[sent]),q.msgs[sent].msg_hdr.msg_namelen) != (long)q.iov[sent].iov_len)
+							_udpSendFailed(q,sent);
+					}
+					break;
+				}
+				// sendmmsg() stops at the first datagram that fails, so skip it and send the rest
+				_udpSendFailed(q,sent++);
+				continue;
+			}
+			++_udpBatchCounters.txCalls;
+			_udpBatchCounters.txDatagrams += (uint64_t)n;
+			if ((uint64_t)n > _udpBatchCounters.txMaxBatch)
+				_udpBatchCounters.txMaxBatch = (uint64_t)n;
+			sent += (unsigned int)n;
+		}
+		q.count = 0;
+	}
+
+	// Remember the destination of a queued datagram that could not be sent (see udpSendQueued())
+	inline void _udpSendFailed(UdpTxQueue &q,const unsigned int i)
+	{
+		for(unsigned int f=0;f<q.failedCount;++f) {
+			if (memcmp(&(q.failed[f]),&(q.to[i]),q.msgs[i].msg_hdr.msg_namelen) == 0)
+				return;
+		}
+		if (q.failedCount < ZT_PHY_UDP_BATCH_SIZE)
+			memcpy(&(q.failed[q.failedCount++]),&(q.to[i]),q.msgs[i].msg_hdr.msg_namelen);
+	}
+#endif
+
+	// Handle readability and/or writability on a socket, called from poll()
+	inline void _dispatch(PhySocketImpl &s,const bool readable,const bool writable,char *buf,const unsigned long bufSize,struct sockaddr_storage &ss)
+	{
+		switch (s.type) {
+
+			case ZT_PHY_SOCKET_TCP_OUT_PENDING:
+				if (writable) {
+					socklen_t slen = sizeof(ss);
+					if (::getpeername(s.sock,(struct sockaddr *)&ss,&slen) != 0) {
+						this->close((PhySocket *)&s,true);
+					} else {
+						s.type = ZT_PHY_SOCKET_TCP_OUT_CONNECTED;
+						_setInterest(s,true,false);
+#if defined(_WIN32) || defined(_WIN64)
+						FD_CLR(s.sock,&_exceptfds);
+#endif
+						try {
+							_handler->phyOnTcpConnect((PhySocket *)&s,&(s.uptr),true);
+						} catch ( ... ) {}
+					}
+				}
+				break;
+
+			case ZT_PHY_SOCKET_TCP_OUT_CONNECTED:
+			case ZT_PHY_SOCKET_TCP_IN:
+				if (readable) {
+					long n = (long)::recv(s.sock,buf,bufSize,0);
+					if (n <= 0) {
+						this->close((PhySocket *)&s,true);
+					} else {
+						try {
+							_handler->phyOnTcpData((PhySocket *)&s,&(s.uptr),(void *)buf,(unsigned long)n);
+						} catch ( ... ) {}
+					}
+				}
+				// s.type becomes CLOSED if socket was closed above or in a handler
+				if ((writable)&&(s.type != ZT_PHY_SOCKET_CLOSED)&&(_writeInterest(s))) {
+					try {
+						_handler->phyOnTcpWritable((PhySocket *)&s,&(s.uptr));
+					} catch ( ... ) {}
+				}
+				break;
+
+			case ZT_PHY_SOCKET_TCP_LISTEN:
+				if (readable) {
+					memset(&ss,0,sizeof(ss));
+					socklen_t slen = sizeof(ss);
+					ZT_PHY_SOCKFD_TYPE newSock = ::accept(s.sock,(struct sockaddr *)&ss,&slen);
+					if (ZT_PHY_SOCKFD_VALID(newSock)) {
+						if (_socks.size() >= ZT_PHY_MAX_SOCKETS) {
+							ZT_PHY_CLOSE_SOCKET(newSock);
+						} else {
+#if defined(_WIN32) || defined(_WIN64)
+							{ BOOL f = (_noDelay ? TRUE : FALSE); setsockopt(newSock,IPPROTO_TCP,TCP_NODELAY,(char *)&f,sizeof(f)); }
+							{ u_long iMode=1; ioctlsocket(newSock,FIONBIO,&iMode); }
+#else
+							{ int f = (_noDelay ? 1 : 0); setsockopt(newSock,IPPROTO_TCP,TCP_NODELAY,(char *)&f,sizeof(f)); }
+							fcntl(newSock,F_SETFL,O_NONBLOCK);
+#endif
+							_socks.push_back(PhySocketImpl());
+							PhySocketImpl &sws = _socks.back();
+							sws.type = ZT_PHY_SOCKET_TCP_IN;
+							sws.sock = newSock;
+							sws.uptr = (void *)0;
+							memcpy(&(sws.saddr),&ss,sizeof(struct sockaddr_storage));
+							_setInterest(sws,true,false);
+							try {
+								_handler->phyOnTcpAccept((PhySocket *)&s,(PhySocket *)&sws,&(s.uptr),&(sws.uptr),(const struct sockaddr *)&(sws.saddr));
+							} catch ( ... ) {}
+						}
+					}
+				}
+				break;
+
+			case ZT_PHY_SOCKET_UDP:
+#ifdef ZT_PHY_USE_MMSG
+				if ((readable)&&(!_mmsgUnavailable)) {
+					UdpRxBatch &b = *_udpRx;
+					for(;;) {
+						for(unsigned int i=0;i<ZT_PHY_UDP_BATCH_SIZE;++i) {
+							b.iov[i].iov_base = b.data[i];
+							b.iov[i].iov_len = ZT_PHY_UDP_BATCH_MAX_RX_DATAGRAM;
+							memset(&(b.msgs[i]),0,sizeof(struct mmsghdr));
+							b.msgs[i].msg_hdr.msg_name = &(b.from[i]);
+							b.msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+							b.msgs[i].msg_hdr.msg_iov = &(b.iov[i]);
+							b.msgs[i].msg_hdr.msg_iovlen = 1;
+						}
+						const int n = ::recvmmsg(s.sock,b.msgs,ZT_PHY_UDP_BATCH_SIZE,0,(struct timespec *)0);
+						if (n <= 0) {
+							if ((n < 0)&&(errno == ENOSYS))
+								_mmsgUnavailable = true; // fall through to recvfrom() below on next poll
+							break;
+						}
+						++_udpBatchCounters.rxCalls;
+						_udpBatchCounters.rxDatagrams += (uint64_t)n;
+						if ((uint64_t)n > _udpBatchCounters.rxMaxBatch)
+							_udpBatchCounters.rxMaxBatch = (uint64_t)n;
+						for(int i=0;i<n;++i) {
+							if ((b.msgs[i].msg_len > 0)&&((b.msgs[i].msg_hdr.msg_flags & MSG_TRUNC) == 0)) {
+								try {
+									_handler->phyOnDatagram((PhySocket *)&s,&(s.uptr),(const struct sockaddr *)&(b.from[i]),(void *)b.data[i],(unsigned long)b.msgs[i].msg_len);
+								} catch ( ... ) {}
+								if (s.type == ZT_PHY_SOCKET_CLOSED) // closed by handler
+									return;
+							}
+						}
+						if (n < ZT_PHY_UDP_BATCH_SIZE)
+							break;
+					}
+					break;
+				}
+#endif
+				if (readable) {
+					for(;;) {
+						memset(&ss,0,sizeof(ss));
+						socklen_t slen = sizeof(ss);
+						long n = (long)::recvfrom(s.sock,buf,bufSize,0,(struct sockaddr *)&ss,&slen);
+						if (n > 0) {
+							try {
+								_handler->phyOnDatagram((PhySocket *)&s,&(s.uptr),(const struct sockaddr *)&ss,(void *)buf,(unsigned long)n);
+							} catch ( ... ) {}
+						} else if (n < 0)
+							break;
+					}
+				}
+				break;
+
+			case ZT_PHY_SOCKET_UNIX_IN:
+#ifdef __UNIX_LIKE__
+				if (readable) {
+					long n = (long)::read(s.sock,buf,bufSize);
+					if (n <= 0) {
+						this->close((PhySocket *)&s,true);
+					} else {
+						try {
+							_handler->phyOnUnixData((PhySocket *)&s,&(s.uptr),(void *)buf,(unsigned long)n);
+						} catch ( ... ) {}
+					}
+				}
+				if ((writable)&&(s.type != ZT_PHY_SOCKET_CLOSED)&&(_writeInterest(s))) {
+					try {
+						//_handler->phyOnUnixWritable((PhySocket *)&s,&(s.uptr));
+					} catch ( ... ) {}
+				}
+#endif // __UNIX_LIKE__
+				break;
+
+			case ZT_PHY_SOCKET_UNIX_LISTEN:
+#ifdef __UNIX_LIKE__
+				if (readable) {
+					memset(&ss,0,sizeof(ss));
+					socklen_t slen = sizeof(ss);
+					ZT_PHY_SOCKFD_TYPE newSock = ::accept(s.sock,(struct sockaddr *)&ss,&slen);
+					if (ZT_PHY_SOCKFD_VALID(newSock)) {
+						if (_socks.size() >= ZT_PHY_MAX_SOCKETS) {
+							ZT_PHY_CLOSE_SOCKET(newSock);
+						} else {
+							fcntl(newSock,F_SETFL,O_NONBLOCK);
+							_socks.push_back(PhySocketImpl());
+							PhySocketImpl &sws = _socks.back();
+							sws.type = ZT_PHY_SOCKET_UNIX_IN;
+							sws.sock = newSock;
+							sws.uptr = (void *)0;
+							memcpy(&(sws.saddr),&ss,sizeof(struct sockaddr_storage));
+							_setInterest(sws,true,false);
+							try {
+								_handler->phyOnUnixAccept((PhySocket *)&s,(PhySocket *)&sws,&(s.uptr),&(sws.uptr));
+							} catch ( ... ) {}
+						}
+					}
+				}
+#endif // __UNIX_LIKE__
+				break;
+
+			case ZT_PHY_SOCKET_FD:
+				if ((readable)||(writable)) {
+					try {
+						_handler->phyOnFileDescriptorActivity((PhySocket *)&s,&(s.uptr),readable,writable);
+					} catch ( ... ) {}
+				}
+				break;
+
+			default:
+				break;
+
+		}
 	}
 };
 
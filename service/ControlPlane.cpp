@@ -39,6 +39,7 @@
 
 #include "../node/InetAddress.hpp"
 #include "../node/Node.hpp"
+#include "../node/IncomingPacket.hpp"
 #include "../node/Utils.hpp"
 #include "../osdep/OSUtils.hpp"
 
@@ -386,6 +387,20 @@ unsigned int ControlPlane::handleRequest(
 				}
 #endif
 
+				uint64_t poolHits = 0,poolMisses = 0;
+				IncomingPacket::Pool::stats(poolHits,poolMisses);
+				uint64_t comCacheHits = 0,comCacheMisses = 0;
+				unsigned long comCacheEntries = 0;
+				_node->verifiedComCacheStats(comCacheHits,comCacheMisses,comCacheEntries);
+				uint64_t idCacheHits = 0,idCacheMisses = 0;
+				unsigned long idCacheEntries = 0;
+				_node->validatedIdentityCacheStats(idCacheHits,idCacheMisses,idCacheEntries);
+				unsigned long txQueuePackets = 0,txQueuePeers = 0,rxQueuePackets = 0,rxQueuePeers = 0;
+				uint64_t txQueueOldest = 0,rxQueueOldest = 0;
+				_node->pendingQueueStats(txQueuePackets,txQueuePeers,txQueueOldest,rxQueuePackets,rxQueuePeers,rxQueueOldest);
+				uint64_t udpRxCalls = 0,udpRxDatagrams = 0,udpRxMaxBatch = 0,udpTxCalls = 0,udpTxDatagrams = 0,udpTxMaxBatch = 0;
+				_svc->udpBatchStats(udpRxCalls,udpRxDatagrams,udpRxMaxBatch,udpTxCalls,udpTxDatagrams,udpTxMaxBatch);
+
 				Utils::snprintf(json,sizeof(json),
 					"{\n"
 					"\t\"address\": \"%.10llx\",\n"
@@ -399,6 +414,12 @@ unsigned int ControlPlane::handleRequest(
 					"\t\"versionRev\": %d,\n"
 					"\t\"version\": \"%d.%d.%d\",\n"
 					"\t\"clock\": %llu,\n"
+					"\t\"packetPool\": { \"hits\": %llu, \"misses\": %llu },\n"
+					"\t\"comCache\": { \"hits\": %llu, \"misses\": %llu, \"entries\": %lu },\n"
+					"\t\"identityCache\": { \"hits\": %llu, \"misses\": %llu, \"entries\": %lu },\n"
+					"\t\"txQueue\": { \"packets\": %lu, \"peers\": %lu, \"oldest\": %llu },\n"
+					"\t\"rxQueue\": { \"packets\": %lu, \"peers\": %lu, \"oldest\": %llu },\n"
+					"\t\"udpBatch\": { \"rxCalls\": %llu, \"rxDatagrams\": %llu, \"rxMaxBatch\": %llu, \"txCalls\": %llu, \"txDatagrams\": %llu, \"txMaxBatch\": %llu },\n"
 					"\t\"cluster\": %s\n"
 					"}\n",
 					status.address,
@@ -412,6 +433,12 @@ unsigned int ControlPlane::handleRequest(
 					ZEROTIER_ONE_VERSION_REVISION,
 					ZEROTIER_ONE_VERSION_MAJOR,ZEROTIER_ONE_VERSION_MINOR,ZEROTIER_ONE_VERSION_REVISION,
 					(unsigned long long)OSUtils::now(),
+					(unsigned long long)poolHits,(unsigned long long)poolMisses,
+					(unsigned long long)comCacheHits,(unsigned long long)comCacheMisses,comCacheEntries,
+					(unsigned long long)idCacheHits,(unsigned long long)idCacheMisses,idCacheEntries,
+					txQueuePackets,txQueuePeers,(unsigned long long)txQueueOldest,
+					rxQueuePackets,rxQueuePeers,(unsigned long long)rxQueueOldest,
+					(unsigned long long)udpRxCalls,(unsigned long long)udpRxDatagrams,(unsigned long long)udpRxMaxBatch,(unsigned long long)udpTxCalls,(unsigned long long)udpTxDatagrams,(unsigned long long)udpTxMaxBatch,
 					((clusterJson.length() > 0) ? clusterJson.c_str() : "null"));
 				responseBody = json;
 				scode = 200;
@@ -431,10 +431,101 @@ struct TcpConnection
 #define ZT_UDP_DESIRED_BUF_SIZE 131072
 #endif
 
+// Multiple UDP receive threads require SO_REUSEPORT (Linux 3.9+)
+#if defined(__LINUX__) && defined(SO_REUSEPORT)
+#define ZT_UDP_RECEIVE_THREADS_SUPPORTED 1
+#endif
+
+// Maximum number of UDP receive threads on the primary port
+#define ZT_MAX_UDP_RECEIVE_THREADS 64
+
+// Timestamps shared by the main loop and UDP receive threads are read and
+// written whole, since a plain 64-bit access isn't atomic everywhere
+static inline uint64_t _sharedTimeGet(volatile uint64_t &t)
+{
+#ifdef ZT_UDP_RECEIVE_THREADS_SUPPORTED
+	return __sync_or_and_fetch(&t,0);
+#else
+	return t;
+#endif
+}
+static inline void _sharedTimeSet(volatile uint64_t &t,const uint64_t v)
+{
+#ifdef ZT_UDP_RECEIVE_THREADS_SUPPORTED
+	uint64_t o = t;
+	while (!__sync_bool_compare_and_swap(&t,o,v))
+		o = t;
+#else
+	t = v;
+#endif
+}
+
+// Receive threads update their Phy<> batch counters while the main loop
+// reads them for status reports, so read each whole; a stale value is fine
+static inline uint64_t _sharedCounterGet(const uint64_t &c)
+{
+#ifdef ZT_UDP_RECEIVE_THREADS_SUPPORTED
+	return __sync_or_and_fetch(const_cast<uint64_t *>(&c),0);
+#else
+	return c;
+#endif
+}
+
+#ifdef ZT_UDP_RECEIVE_THREADS_SUPPORTED
+/**
+ * An additional UDP receive loop with its own SO_REUSEPORT sockets
+ *
+ * Each of these binds its own sockets to the primary port and runs its own
+ * Phy<> loop in its own thread. The kernel hashes each remote address and
+ * port to one socket in the group, so packets from a given peer are always
+ * handled by the same thread.
+ */
+struct UdpReceiveThread
+{
+	UdpReceiveThread(OneServiceImpl *p) :
+		parent(p),
+		phy(this,false,true),
+		v4UdpSocket((PhySocket *)0),
+		v6UdpSocket((PhySocket *)0),
+		nextBackgroundTaskDeadline(0),
+		run(true) {}
+
+	void threadMain() throw();
+
+	void phyOnDatagram(PhySocket *sock,void **uptr,const struct sockaddr *from,void *data,unsigned long len);
+	inline void phyOnTcpConnect(PhySocket *sock,void **uptr,bool success) {}
+	inline void phyOnTcpAccept(PhySocket *sockL,PhySocket *sockN,void **uptrL,void **uptrN,const struct sockaddr *from) {}
+	inline void phyOnTcpClose(PhySocket *sock,void **uptr) {}
+	inline void phyOnTcpData(PhySocket *sock,void **uptr,void *data,unsigned long len) {}
+	inline void phyOnTcpWritable(PhySocket *sock,void **uptr) {}
+	inline void phyOnFileDescriptorActivity(PhySocket *sock,void **uptr,bool readable,bool writable) {}
+	inline void phyOnUnixAccept(PhySocket *sockL,PhySocket *sockN,void **uptrL,void **uptrN) {}
+	inline void phyOnUnixClose(PhySocket *sock,void **uptr) {}
+	inline void phyOnUnixData(PhySocket *sock,void **uptr,void *data,unsigned long len) {}
+	inline void phyOnUnixWritable(PhySocket *sock,void **uptr) {}
+
+	OneServiceImpl *const parent;
+	Phy<UdpReceiveThread *> phy;
+	PhySocket *v4UdpSocket;
+	PhySocket *v6UdpSocket;
+	volatile uint64_t nextBackgroundTaskDeadline; // not used, background tasks are run by the main loop
+	Thread thread;
+	volatile bool run;
+};
+
+// Receive thread whose loop is running in the current thread, if any
+static __thread UdpReceiveThread *_currentUdpReceiveThread = (UdpReceiveThread *)0;
+#endif // ZT_UDP_RECEIVE_THREADS_SUPPORTED
+
+#ifdef __LINUX__
+// True if this thread's poll loop calls _flushQueuedTapFrames() after each poll
+static __thread bool _queueTapFrames = false;
+#endif
+
 class OneServiceImpl : public OneService
 {
 public:
-	OneServiceImpl(const char *hp,unsigned int port) :
+	OneServiceImpl(const char *hp,unsigned int port,unsigned int udpReceiveThreads,unsigned int tapQueues,bool tapOffload) :
 		_homePath((hp) ? hp : ".")
 		,_tcpFallbackResolver(ZT_TCP_FALLBACK_RELAY)
 #ifdef ZT_ENABLE_NETWORK_CONTROLLER
@@ -450,6 +541,9 @@ public:
 		,_tcpFallbackTunnel((TcpConnection *)0)
 		,_termReason(ONE_STILL_RUNNING)
 		,_port(0)
+		,_udpReceiveThreadCount(1)
+		,_tapQueues(tapQueues)
+		,_tapOffload(tapOffload)
 #ifdef ZT_USE_MINIUPNPC
 		,_v4UpnpUdpSocket((PhySocket *)0)
 		,_upnpClient((UPNPClient *)0)
@@ -462,6 +556,15 @@ public:
 #endif
 		,_run(true)
 	{
+#ifdef ZT_UDP_RECEIVE_THREADS_SUPPORTED
+		if (udpReceiveThreads > ZT_MAX_UDP_RECEIVE_THREADS)
+			_udpReceiveThreadCount = ZT_MAX_UDP_RECEIVE_THREADS;
+		else if (udpReceiveThreads > 1)
+			_udpReceiveThreadCount = udpReceiveThreads;
+#endif
+		// Primary UDP sockets must have SO_REUSEPORT set if others will join them later
+		const bool reusePort = (_udpReceiveThreadCount > 1);
+
 		const int portTrials = (port == 0) ? 256 : 1; // if port is 0, pick random
 		for(int k=0;k<portTrials;++k) {
 			if (port == 0) {
@@ -471,7 +574,7 @@ public:
 			}
 
 			_v4LocalAddress = InetAddress((uint32_t)0,port);
-			_v4UdpSocket = _phy.udpBind((const struct sockaddr *)&_v4LocalAddress,reinterpret_cast<void *>(&_v4LocalAddress),ZT_UDP_DESIRED_BUF_SIZE);
+			_v4UdpSocket = _phy.udpBind((const struct sockaddr *)&_v4LocalAddress,reinterpret_cast<void *>(&_v4LocalAddress),ZT_UDP_DESIRED_BUF_SIZE,reusePort);
 
 			if (_v4UdpSocket) {
 				struct sockaddr_in in4;
@@ -483,7 +586,7 @@ public:
 
 				if (_v4TcpListenSocket) {
 					_v6LocalAddress = InetAddress("\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0",16,port);
-					_v6UdpSocket = _phy.udpBind((const struct sockaddr *)&_v6LocalAddress,reinterpret_cast<void *>(&_v6LocalAddress),ZT_UDP_DESIRED_BUF_SIZE);
+					_v6UdpSocket = _phy.udpBind((const struct sockaddr *)&_v6LocalAddress,reinterpret_cast<void *>(&_v6LocalAddress),ZT_UDP_DESIRED_BUF_SIZE,reusePort);
 
 					struct sockaddr_in6 in6;
 					memset((void *)&in6,0,sizeof(in6));
@@ -580,6 +683,9 @@ public:
 				SnodeVirtualNetworkConfigFunction,
 				SnodeEventCallback);
 
+			// Received packets are dearmored in batches, flushed after each poll
+			_node->setWirePacketStaging(true);
+
 #ifdef ZT_ENABLE_NETWORK_CONTROLLER
 			_controller = new SqliteNetworkController(_node,(_homePath + ZT_PATH_SEPARATOR_S + ZT_CONTROLLER_DB_PATH).c_str(),(_homePath + ZT_PATH_SEPARATOR_S + "circuitTestResults.d").c_str());
 			_node->setNetconfMaster((void *)_controller);
@@ -669,6 +775,26 @@ public:
 			Thread::start(_node);
 			Thread::start(_node);
 
+#ifdef ZT_UDP_RECEIVE_THREADS_SUPPORTED
+			// Start additional UDP receive threads, if enabled; this thread is the first
+			for(unsigned int t=1;t<_udpReceiveThreadCount;++t) {
+				UdpReceiveThread *urt = new UdpReceiveThread(this);
+				urt->v4UdpSocket = urt->phy.udpBind((const struct sockaddr *)&_v4LocalAddress,reinterpret_cast<void *>(&_v4LocalAddress),ZT_UDP_DESIRED_BUF_SIZE,true);
+				if (_v6UdpSocket)
+					urt->v6UdpSocket = urt->phy.udpBind((const struct sockaddr *)&_v6LocalAddress,reinterpret_cast<void *>(&_v6LocalAddress),ZT_UDP_DESIRED_BUF_SIZE,true);
+				if (!urt->v4UdpSocket) {
+					delete urt;
+					break;
+				}
+				urt->thread = Thread::start(urt);
+				_udpReceiveThreads.push_back(urt);
+			}
+#endif
+
+#ifdef __LINUX__
+			_queueTapFrames = _tapOffload;
+#endif
+
 			_nextBackgroundTaskDeadline = 0;
 			uint64_t clockShouldBe = OSUtils::now();
 			_lastRestart = clockShouldBe;
@@ -712,7 +838,7 @@ public:
 					_tcpFallbackResolver.resolveNow();
 				}
 
-				if ((_tcpFallbackTunnel)&&((now - _lastDirectReceiveFromGlobal) < (ZT_TCP_FALLBACK_AFTER / 2)))
+				if ((_tcpFallbackTunnel)&&((now - _sharedTimeGet(_lastDirectReceiveFromGlobal)) < (ZT_TCP_FALLBACK_AFTER / 2)))
 					_phy.close(_tcpFallbackTunnel->sock);
 
 				if ((now - lastTapMulticastGroupCheck) >= ZT_TAP_CHECK_MULTICAST_INTERVAL) {
@@ -809,6 +935,8 @@ public:
 				const unsigned long delay = (dl > now) ? (unsigned long)(dl - now) : 100;
 				clockShouldBe = now + (uint64_t)delay;
 				_phy.poll(delay);
+				_flushStagedWirePackets();
+				_flushQueuedTapFrames();
 			}
 		} catch (std::exception &exc) {
 			Mutex::Lock _l(_termReason_m);
@@ -825,6 +953,16 @@ public:
 				_phy.close((*_tcpConnections.begin())->sock);
 		} catch ( ... ) {}
 
+#ifdef ZT_UDP_RECEIVE_THREADS_SUPPORTED
+		for(std::vector<UdpReceiveThread *>::iterator urt(_udpReceiveThreads.begin());urt!=_udpReceiveThreads.end();++urt) {
+			(*urt)->run = false;
+			(*urt)->phy.whack();
+			Thread::join((*urt)->thread);
+			delete *urt;
+		}
+		_udpReceiveThreads.clear();
+#endif
+
 		{
 			Mutex::Lock _l(_taps_m);
 			for(std::map< uint64_t,EthernetTap * >::iterator t(_taps.begin());t!=_taps.end();++t)
@@ -866,6 +1004,16 @@ public:
 		return (_tcpFallbackTunnel != (TcpConnection *)0);
 	}
 
+	virtual void udpBatchStats(uint64_t &rxCalls,uint64_t &rxDatagrams,uint64_t &rxMaxBatch,uint64_t &txCalls,uint64_t &txDatagrams,uint64_t &txMaxBatch) const
+	{
+		rxCalls = rxDatagrams = rxMaxBatch = txCalls = txDatagrams = txMaxBatch = 0;
+		_addUdpBatchCounters(_phy.udpBatchCounters(),rxCalls,rxDatagrams,rxMaxBatch,txCalls,txDatagrams,txMaxBatch);
+#ifdef ZT_UDP_RECEIVE_THREADS_SUPPORTED
+		for(std::vector<UdpReceiveThread *>::const_iterator urt(_udpReceiveThreads.begin());urt!=_udpReceiveThreads.end();++urt)
+			_addUdpBatchCounters((*urt)->phy.udpBatchCounters(),rxCalls,rxDatagrams,rxMaxBatch,txCalls,txDatagrams,txMaxBatch);
+#endif
+	}
+
 	virtual void terminate()
 	{
 		_run_m.lock();
@@ -880,7 +1028,7 @@ public:
 	{
 #ifdef ZT_ENABLE_CLUSTER
 		if (sock == _clusterMessageSocket) {
-			_lastDirectReceiveFromGlobal = OSUtils::now();
+			_sharedTimeSet(_lastDirectReceiveFromGlobal,OSUtils::now());
 			_node->clusterHandleIncomingMessage(data,len);
 			return;
 		}
@@ -892,14 +1040,14 @@ public:
 #endif
 
 		if ((len >= 16)&&(reinterpret_cast<const InetAddress *>(from)->ipScope() == InetAddress::IP_SCOPE_GLOBAL))
-			_lastDirectReceiveFromGlobal = OSUtils::now();
+			_sharedTimeSet(_lastDirectReceiveFromGlobal,OSUtils::now());
 		ZT_ResultCode rc = _node->processWirePacket(
 			OSUtils::now(),
 			reinterpret_cast<const struct sockaddr_storage *>(*uptr),
 			(const struct sockaddr_storage *)from, // Phy<> uses sockaddr_storage, so it'll always be that big
 			data,
 			len,
-			&_nextBackgroundTaskDeadline);
+			_backgroundTaskDeadline());
 		if (ZT_ResultCode_isFatal(rc)) {
 			char tmp[256];
 			Utils::snprintf(tmp,sizeof(tmp),"fatal error code from processWirePacket: %d",(int)rc);
@@ -1000,7 +1148,7 @@ public:
 			case TcpConnection::TCP_TUNNEL_OUTGOING:
 				tc->body.append((const char *)data,len);
 				while (tc->body.length() >= 5) {
-					const char *data = tc->body.data();
+					char *data = &(tc->body[0]);
 					const unsigned long mlen = ( ((((unsigned long)data[3]) & 0xff) << 8) | (((unsigned long)data[4]) & 0xff) );
 					if (tc->body.length() >= (mlen + 5)) {
 						InetAddress from;
@@ -1118,7 +1266,12 @@ public:
 							nwid,
 							friendlyName,
 							StapFrameHandler,
-							(void *)this))).first;
+							(void *)this
+#ifdef __LINUX__
+							,_tapQueues
+							,_tapOffload
+#endif
+							))).first;
 					} catch (std::exception &exc) {
 #ifdef __WINDOWS__
 						FILE *tapFailLog = fopen((_homePath + ZT_PATH_SEPARATOR_S"port_error_log.txt").c_str(),"a");
@@ -1261,6 +1414,7 @@ public:
 			if (!OSUtils::fileExists("/tmp/ZT_BREAK_UDP")) {
 #endif
 				if (addr->ss_family == AF_INET) {
+					Mutex::Lock _l(_v4UpnpUdpSocket_m);
 					if (ttl)
 						_phy.setIp4UdpTtl(_v4UpnpUdpSocket,ttl);
 					const int result = ((_phy.udpSend(_v4UpnpUdpSocket,(const struct sockaddr *)addr,data,len) != 0) ? 0 : -1);
@@ -1283,11 +1437,11 @@ public:
 				if (!OSUtils::fileExists("/tmp/ZT_BREAK_UDP")) {
 #endif
 					if (_v4UdpSocket) {
-						if (ttl)
-							_phy.setIp4UdpTtl(_v4UdpSocket,ttl);
-						result = ((_phy.udpSend(_v4UdpSocket,(const struct sockaddr *)addr,data,len) != 0) ? 0 : -1);
-						if (ttl)
-							_phy.setIp4UdpTtl(_v4UdpSocket,255);
+						if (ttl) {
+							result = _udpSendWithTtl(addr,data,len,ttl);
+						} else {
+							result = _udpSend(false,addr,data,len);
+						}
 					}
 #ifdef ZT_BREAK_UDP
 				}
@@ -1301,7 +1455,7 @@ public:
 					// Engage TCP tunnel fallback if we haven't received anything valid from a global
 					// IP address in ZT_TCP_FALLBACK_AFTER milliseconds. If we do start getting
 					// valid direct traffic we'll stop using it and close the socket after a while.
-					if (((now - _lastDirectReceiveFromGlobal) > ZT_TCP_FALLBACK_AFTER)&&((now - _lastRestart) > ZT_TCP_FALLBACK_AFTER)) {
+					if (((now - _sharedTimeGet(_lastDirectReceiveFromGlobal)) > ZT_TCP_FALLBACK_AFTER)&&((now - _lastRestart) > ZT_TCP_FALLBACK_AFTER)) {
 						if (_tcpFallbackTunnel) {
 							Mutex::Lock _l(_tcpFallbackTunnel->writeBuf_m);
 							if (!_tcpFallbackTunnel->writeBuf.length())
@@ -1317,7 +1471,7 @@ public:
 							_tcpFallbackTunnel->writeBuf.append(reinterpret_cast<const char *>(reinterpret_cast<const void *>(&(reinterpret_cast<const struct sockaddr_in *>(addr)->sin_port))),2);
 							_tcpFallbackTunnel->writeBuf.append((const char *)data,len);
 							result = 0;
-						} else if (((now - _lastSendToGlobal) < ZT_TCP_FALLBACK_AFTER)&&((now - _lastSendToGlobal) > (ZT_PING_CHECK_INVERVAL / 2))) {
+						} else if (((now - _sharedTimeGet(_lastSendToGlobal)) < ZT_TCP_FALLBACK_AFTER)&&((now - _sharedTimeGet(_lastSendToGlobal)) > (ZT_PING_CHECK_INVERVAL / 2))) {
 							std::vector<InetAddress> tunnelIps(_tcpFallbackResolver.get());
 							if (tunnelIps.empty()) {
 								if (!_tcpFallbackResolver.running())
@@ -1331,7 +1485,7 @@ public:
 						}
 					}
 
-					_lastSendToGlobal = now;
+					_sharedTimeSet(_lastSendToGlobal,now);
 				}
 #endif // ZT_TCP_FALLBACK_RELAY
 
@@ -1342,7 +1496,7 @@ public:
 				if (!OSUtils::fileExists("/tmp/ZT_BREAK_UDP")) {
 #endif
 				if (_v6UdpSocket)
-					result = ((_phy.udpSend(_v6UdpSocket,(const struct sockaddr *)addr,data,len) != 0) ? 0 : -1);
+					result = _udpSend(true,addr,data,len);
 #ifdef ZT_BREAK_UDP
 				}
 #endif
@@ -1354,12 +1508,103 @@ public:
 		return result;
 	}
 
+	/* TTL is a socket option, so packets with a custom TTL can't be queued
+	 * and are sent right away between two TTL changes. Each receive thread
+	 * does this on its own socket, whose queue only it flushes, so the
+	 * change can't leak onto another thread's batched sends. */
+	inline int _udpSendWithTtl(const struct sockaddr_storage *addr,const void *data,unsigned int len,unsigned int ttl)
+	{
+#ifdef ZT_UDP_RECEIVE_THREADS_SUPPORTED
+		UdpReceiveThread *const urt = _currentUdpReceiveThread;
+		if ((urt)&&(urt->v4UdpSocket)) {
+			urt->phy.setIp4UdpTtl(urt->v4UdpSocket,ttl);
+			const int result = ((urt->phy.udpSend(urt->v4UdpSocket,(const struct sockaddr *)addr,data,len) != 0) ? 0 : -1);
+			urt->phy.setIp4UdpTtl(urt->v4UdpSocket,255);
+			return result;
+		}
+#endif
+		_phy.setIp4UdpTtl(_v4UdpSocket,ttl);
+		const int result = ((_phy.udpSend(_v4UdpSocket,(const struct sockaddr *)addr,data,len) != 0) ? 0 : -1);
+		_phy.setIp4UdpTtl(_v4UdpSocket,255);
+		return result;
+	}
+
+	// Add one Phy<>'s batch counters to udpBatchStats() totals
+	template<typename C>
+	static inline void _addUdpBatchCounters(const C &c,uint64_t &rxCalls,uint64_t &rxDatagrams,uint64_t &rxMaxBatch,uint64_t &txCalls,uint64_t &txDatagrams,uint64_t &txMaxBatch)
+	{
+		rxCalls += _sharedCounterGet(c.rxCalls);
+		rxDatagrams += _sharedCounterGet(c.rxDatagrams);
+		rxMaxBatch = std::max(rxMaxBatch,_sharedCounterGet(c.rxMaxBatch));
+		txCalls += _sharedCounterGet(c.txCalls);
+		txDatagrams += _sharedCounterGet(c.txDatagrams);
+		txMaxBatch = std::max(txMaxBatch,_sharedCounterGet(c.txMaxBatch));
+	}
+
+	// Deadline to hand the core: the main loop's, or a receive thread's own so they don't share one
+	inline volatile uint64_t *_backgroundTaskDeadline()
+	{
+#ifdef ZT_UDP_RECEIVE_THREADS_SUPPORTED
+		UdpReceiveThread *const urt = _currentUdpReceiveThread;
+		if (urt)
+			return &(urt->nextBackgroundTaskDeadline);
+#endif
+		return &_nextBackgroundTaskDeadline;
+	}
+
+	// Send a UDP packet from the primary port, via the current receive thread's socket if called from one
+	inline int _udpSend(bool v6,const struct sockaddr_storage *addr,const void *data,unsigned int len)
+	{
+#ifdef ZT_UDP_RECEIVE_THREADS_SUPPORTED
+		UdpReceiveThread *const urt = _currentUdpReceiveThread;
+		if (urt) {
+			PhySocket *const s = (v6) ? urt->v6UdpSocket : urt->v4UdpSocket;
+			if (s)
+				return ((urt->phy.udpSendQueued(s,(const struct sockaddr *)addr,data,len) != 0) ? 0 : -1);
+		}
+#endif
+		return ((_phy.udpSendQueued((v6) ? _v6UdpSocket : _v4UdpSocket,(const struct sockaddr *)addr,data,len) != 0) ? 0 : -1);
+	}
+
 	inline void nodeVirtualNetworkFrameFunction(uint64_t nwid,uint64_t sourceMac,uint64_t destMac,unsigned int etherType,unsigned int vlanId,const void *data,unsigned int len)
 	{
 		Mutex::Lock _l(_taps_m);
 		std::map< uint64_t,EthernetTap * >::const_iterator t(_taps.find(nwid));
-		if (t != _taps.end())
+		if (t != _taps.end()) {
+#ifdef __LINUX__
+			if (_queueTapFrames) {
+				t->second->putQueued(MAC(sourceMac),MAC(destMac),etherType,data,len);
+				return;
+			}
+#endif
 			t->second->put(MAC(sourceMac),MAC(destMac),etherType,data,len);
+		}
+	}
+
+	// Decode packets staged by processWirePacket() during the last poll cycle
+	inline void _flushStagedWirePackets()
+	{
+		ZT_ResultCode rc = _node->flushWirePackets(OSUtils::now(),_backgroundTaskDeadline());
+		if (ZT_ResultCode_isFatal(rc)) {
+			char tmp[256];
+			Utils::snprintf(tmp,sizeof(tmp),"fatal error code from flushWirePackets: %d",(int)rc);
+			Mutex::Lock _l(_termReason_m);
+			_termReason = ONE_UNRECOVERABLE_ERROR;
+			_fatalErrorMessage = tmp;
+			this->terminate();
+		}
+	}
+
+	// Write out frames queued to taps during the last poll cycle
+	inline void _flushQueuedTapFrames()
+	{
+#ifdef __LINUX__
+		if (_tapOffload) {
+			Mutex::Lock _l(_taps_m);
+			for(std::map< uint64_t,EthernetTap * >::const_iterator t(_taps.begin());t!=_taps.end();++t)
+				t->second->flushQueued();
+		}
+#endif
 	}
 
 	inline void tapFrameHandler(uint64_t nwid,const MAC &from,const MAC &to,unsigned int etherType,unsigned int vlanId,const void *data,unsigned int len)
@@ -1449,8 +1694,8 @@ public:
 	PhySocket *_v4TcpListenSocket;
 	PhySocket *_v6TcpListenSocket;
 	ControlPlane *_controlPlane;
-	uint64_t _lastDirectReceiveFromGlobal;
-	uint64_t _lastSendToGlobal;
+	volatile uint64_t _lastDirectReceiveFromGlobal; // see _sharedTimeGet()
+	volatile uint64_t _lastSendToGlobal;
 	uint64_t _lastRestart;
 	volatile uint64_t _nextBackgroundTaskDeadline;
 
@@ -1467,9 +1712,17 @@ public:
 
 	unsigned int _port;
 
+	unsigned int _udpReceiveThreadCount;
+	unsigned int _tapQueues;
+	bool _tapOffload;
+#ifdef ZT_UDP_RECEIVE_THREADS_SUPPORTED
+	std::vector<UdpReceiveThread *> _udpReceiveThreads;
+#endif
+
 #ifdef ZT_USE_MINIUPNPC
 	InetAddress _v4UpnpLocalAddress;
 	PhySocket *_v4UpnpUdpSocket;
+	Mutex _v4UpnpUdpSocket_m; // sends may toggle its TTL and can come from any thread
 	UPNPClient *_upnpClient;
 #endif
 
@@ -1515,6 +1768,22 @@ static int SclusterGeoIpFunction(void *uptr,const struct sockaddr_storage *addr,
 static void StapFrameHandler(void *uptr,uint64_t nwid,const MAC &from,const MAC &to,unsigned int etherType,unsigned int vlanId,const void *data,unsigned int len)
 { reinterpret_cast<OneServiceImpl *>(uptr)->tapFrameHandler(nwid,from,to,etherType,vlanId,data,len); }
 
+#ifdef ZT_UDP_RECEIVE_THREADS_SUPPORTED
+void UdpReceiveThread::threadMain()
+	throw()
+{
+	_currentUdpReceiveThread = this;
+	_queueTapFrames = parent->_tapOffload;
+	while (run) {
+		phy.poll(0);
+		parent->_flushStagedWirePackets();
+		parent->_flushQueuedTapFrames();
+	}
+}
+void UdpReceiveThread::phyOnDatagram(PhySocket *sock,void **uptr,const struct sockaddr *from,void *data,unsigned long len)
+{ parent->phyOnDatagram(sock,uptr,from,data,len); }
+#endif
+
 static int ShttpOnMessageBegin(http_parser *parser)
 {
 	TcpConnection *tc = reinterpret_cast<TcpConnection *>(parser->data);
@@ -1660,7 +1929,7 @@ std::string OneService::autoUpdateUrl()
 	return std::string();
 }
 
-OneService *OneService::newInstance(const char *hp,unsigned int port) { return new OneServiceImpl(hp,port); }
+OneService *OneService::newInstance(const char *hp,unsigned int port,unsigned int udpReceiveThreads,unsigned int tapQueues,bool tapOffload) { return new OneServiceImpl(hp,port,udpReceiveThreads,tapQueues,tapOffload); }
 OneService::~OneService() {}
 
 } // namespace ZeroTier
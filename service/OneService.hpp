@@ -28,6 +28,8 @@
 #ifndef ZT_ONESERVICE_HPP
 #define ZT_ONESERVICE_HPP
 
+#include <stdint.h>
+
 #include <string>
 
 namespace ZeroTier {
@@ -96,12 +98,30 @@ public:
 	 * which is used by the CLI and can be used to see which port was chosen if
 	 * 0 (random port) is picked.
 	 *
+	 * If udpReceiveThreads is greater than one, that many sockets are bound
+	 * to the UDP port with SO_REUSEPORT and each is serviced by its own
+	 * thread. This is only supported on Linux and is ignored elsewhere.
+	 *
+	 * If tapQueues is greater than one, Linux tap devices are created with
+	 * IFF_MULTI_QUEUE and that many queues, each with its own reader thread.
+	 * This is ignored on other platforms.
+	 *
+	 * If tapOffload is true, Linux tap devices are opened with IFF_VNET_HDR
+	 * and advertise checksum and TCP segmentation offload. Large TCP frames
+	 * from the OS are segmented by the tap before reaching the core.
+	 *
 	 * @param hp Home path
 	 * @param port TCP and UDP port for packets and HTTP control (if 0, pick random port)
+	 * @param udpReceiveThreads Number of threads receiving UDP packets on port (default: 1)
+	 * @param tapQueues Number of queues per tap device (default: 1)
+	 * @param tapOffload Enable tap checksum/TSO offload mode (default: false)
 	 */
 	static OneService *newInstance(
 		const char *hp,
-		unsigned int port);
+		unsigned int port,
+		unsigned int udpReceiveThreads = 1,
+		unsigned int tapQueues = 1,
+		bool tapOffload = false);
 
 	virtual ~OneService();
 
@@ -134,6 +154,15 @@ public:
 	 */
 	virtual bool tcpFallbackActive() const = 0;
 
+	/**
+	 * Get counters for batched UDP receive and send (recvmmsg()/sendmmsg())
+	 *
+	 * Calls and datagrams are summed over the main loop and all receive
+	 * threads, and max batch sizes are the largest seen by any of them.
+	 * These stay zero where batched UDP I/O isn't supported.
+	 */
+	virtual void udpBatchStats(uint64_t &rxCalls,uint64_t &rxDatagrams,uint64_t &rxMaxBatch,uint64_t &txCalls,uint64_t &txDatagrams,uint64_t &txMaxBatch) const = 0;
+
 	/**
 	 * Terminate background service (can be called from other threads)
 	 */
@@ -25,16 +25,8 @@
  * LLC. Start here: http://www.zerotier.com/
  */
 
-// HACK! Will eventually use epoll() or something in Phy<> instead of select().
-// Also be sure to change ulimit -n and fs.file-max in /etc/sysctl.conf on relays.
-#if defined(__linux__) || defined(__LINUX__) || defined(__LINUX) || defined(LINUX)
-#include <linux/posix_types.h>
-#include <bits/types.h>
-#undef __FD_SETSIZE
-#define __FD_SETSIZE 1048576
-#undef FD_SETSIZE
-#define FD_SETSIZE 1048576
-#endif
+// Phy<> uses epoll() on Linux so there is no FD_SETSIZE limit, but be sure to
+// change ulimit -n and fs.file-max in /etc/sysctl.conf on relays.
 
 #include <stdio.h>
 #include <stdlib.h>